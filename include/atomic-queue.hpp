@@ -3,6 +3,8 @@
 
 #include <mutex>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <list>
 #include <memory>
 #include <trillek-allocator.hpp>
@@ -22,7 +24,7 @@ class AtomicQueue final {
         /** \brief Default constructor
          *
          */
-        AtomicQueue() {};
+        AtomicQueue() : count(0), waiters(0) {};
 
         /** \brief Destructor
          *
@@ -45,6 +47,7 @@ class AtomicQueue final {
             }
             auto ret = atomic_queue<T>{};
             std::swap(ret,q);
+            count.store(0, std::memory_order_relaxed);
             return ret;
         }
 
@@ -56,6 +59,11 @@ class AtomicQueue final {
         void Push(U&& element) const {
             std::unique_lock<std::mutex> locker(mtx);
             q.push_back(std::forward<U>(element));
+            count.store(q.size(), std::memory_order_relaxed);
+            if (waiters) {
+                locker.unlock();
+                available.notify_one();
+            }
         }
 
         /** \brief Put a list of element at the end of the queue
@@ -66,6 +74,11 @@ class AtomicQueue final {
         void PushList(U&& list) const {
             std::unique_lock<std::mutex> locker(mtx);
             q.splice(q.end(), std::forward<U>(list));
+            count.store(q.size(), std::memory_order_relaxed);
+            if (waiters) {
+                locker.unlock();
+                available.notify_all();
+            }
         }
 
         /** \brief Pop an element from the end of the queue
@@ -80,6 +93,54 @@ class AtomicQueue final {
             }
             element = std::move(q.front());
             q.pop_front();
+            count.store(q.size(), std::memory_order_relaxed);
+            return true;
+        }
+
+        /** \brief Pop elements from the front of the queue into a buffer
+         *
+         * The lock is taken once for all elements.
+         *
+         * \param out OutputIt the first position of the buffer, e.g. a T* or a std::back_inserter
+         * \param max size_t the max number of elements to pop
+         * \return size_t the number of elements popped
+         */
+        template<class OutputIt>
+        size_t PopBulk(OutputIt out, size_t max) const {
+            std::unique_lock<std::mutex> locker(mtx);
+            size_t popped = 0;
+            while (popped < max && ! q.empty()) {
+                *out = std::move(q.front());
+                ++out;
+                q.pop_front();
+                ++popped;
+            }
+            count.store(q.size(), std::memory_order_relaxed);
+            return popped;
+        }
+
+        /** \brief Pop an element, waiting for one if the queue is empty
+         *
+         * The thread sleeps until an element is pushed or the timeout expires.
+         *
+         * \param element T& reference that will contain the element popped
+         * \param timeout const std::chrono::duration<Rep,Period>& the max time to wait
+         * \return bool true if an element was popped, false on timeout
+         */
+        template<class Rep, class Period>
+        bool WaitPop(T& element, const std::chrono::duration<Rep,Period>& timeout) const {
+            std::unique_lock<std::mutex> locker(mtx);
+            if (q.empty()) {
+                ++waiters;
+                available.wait_for(locker, timeout, [this]() { return ! q.empty(); });
+                --waiters;
+                if (q.empty()) {
+                    return false;
+                }
+            }
+            element = std::move(q.front());
+            q.pop_front();
+            count.store(q.size(), std::memory_order_relaxed);
             return true;
         }
 
@@ -93,12 +154,29 @@ class AtomicQueue final {
             return q.empty();
         }
 
+        /** \brief Get the number of elements without locking
+         *
+         * The value may be outdated when other threads use the queue.
+         *
+         * \return size_t the number of elements
+         *
+         */
+        size_t SizeApprox() const {
+            return count.load(std::memory_order_relaxed);
+        }
+
     private:
 
         // the queue
         mutable atomic_queue<T> q;
         // the mutex protecting the queue
         mutable std::mutex mtx;
+        // notified when elements are pushed and a thread waits
+        mutable std::condition_variable available;
+        // number of elements, mirrored to be read without the lock
+        mutable std::atomic<size_t> count;
+        // number of threads in WaitPop(), protected by the mutex
+        mutable unsigned int waiters;
 
 };
 }
@@ -0,0 +1,454 @@
+#ifndef BITMAPEXPRESSION_HPP_INCLUDED
+#define BITMAPEXPRESSION_HPP_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include "bitmap.hpp"
+#include "util/bit-kernels.hpp"
+
+namespace trillek {
+
+/** \brief A lazy boolean expression of BitMap
+ *
+ * The operators &, |, ^ and ~ applied to Lazy(bitmap) build an expression
+ * instead of a BitMap:
+ *
+ *     auto query = Lazy(a) & b & ~Lazy(c);
+ *
+ * Nothing is computed until the expression is read. The blocks are then
+ * evaluated by chunks of CHUNK_BLOCKS in buffers on the stack, with the bit
+ * kernels, in a single pass over the operands:
+ * - BitMap<T> bitmap = query; materializes the result,
+ * - query.TrueBits() and query.ForEachTrue() stream the true bits,
+ * - query.countTrue() counts them.
+ *
+ * The expression keeps references to the BitMap operands, which must
+ * outlive it.
+ *
+ * When the default value of the result is false, only the blocks stored by
+ * the operands that can hold a true bit are evaluated, e.g. the blocks
+ * stored by both a and b for a & b.
+ */
+template<class E, class T>
+class BitMapExpression {
+public:
+    // number of blocks evaluated at once
+    static const size_t CHUNK_BLOCKS = 64;
+
+    const E& derived() const {
+        return static_cast<const E&>(*this);
+    }
+
+    size_t size() const {
+        return derived().size();
+    }
+
+    bool DefaultValue() const {
+        return derived().DefaultValue();
+    }
+
+    // the blocks out of [FirstBlock(), LastBlock()) are equal to the default value
+    size_t FirstBlock() const {
+        return derived().FirstBlock();
+    }
+
+    size_t LastBlock() const {
+        return derived().LastBlock();
+    }
+
+    static size_t BlockSize() {
+        return sizeof(T) << 3;
+    }
+
+    /** \brief Evaluate consecutive blocks
+     *
+     * \param b size_t the first block
+     * \param n size_t the number of blocks, at most CHUNK_BLOCKS
+     * \param out T* the blocks
+     */
+    void Fill(size_t b, size_t n, T* out) const {
+        derived().Fill(b, n, out);
+    }
+
+    bool at(size_t idx) const {
+        T block;
+        Fill(idx / BlockSize(), 1, &block);
+        return (block & (T(1) << (idx % BlockSize()))) != 0;
+    }
+
+    /** \brief Call a function with the blocks evaluated in a range
+     *
+     * The bits out of the range are cleared.
+     *
+     * \param first size_t the first index
+     * \param last size_t the index after the last one
+     * \param f F&& the function called with the first block, the blocks and their number
+     */
+    template<class F>
+    void ForEachChunk(size_t first, size_t last, F&& f) const {
+        size_t b, end;
+        if (! ScanBlocks(first, last, b, end)) {
+            return;
+        }
+        T buffer[CHUNK_BLOCKS];
+        for (; b < end; b += CHUNK_BLOCKS) {
+            const size_t n = (std::min)(end - b, size_t(CHUNK_BLOCKS));
+            Load(b, n, first, last, buffer);
+            f(b, static_cast<const T*>(buffer), n);
+        }
+    }
+
+    /** \brief Call a function with the index of each true bit of a range
+     *
+     * \param first size_t the first index
+     * \param last size_t the index after the last one
+     * \param f F&& the function called with the index
+     */
+    template<class F>
+    void ForEachTrue(size_t first, size_t last, F&& f) const {
+        ForEachChunk(first, last, [&](size_t b, const T* blocks, size_t n) {
+            for (size_t i = 0; i < n; ++i) {
+                for (T word = blocks[i]; word; word &= word - 1) {
+                    f((b + i) * BlockSize() + util::Ctz<T>(word));
+                }
+            }
+        });
+    }
+
+    size_t countTrue() const {
+        size_t stored_first = 0, stored_last = 0;
+        if (FirstBlock() < LastBlock()) {
+            stored_first = (std::min)(FirstBlock() * BlockSize(), size());
+            stored_last = (std::min)(LastBlock() * BlockSize(), size());
+        }
+        size_t sum = DefaultValue() ? size() - (stored_last - stored_first) : 0;
+        ForEachChunk(stored_first, stored_last, [&](size_t, const T* blocks, size_t n) {
+            sum += util::PopCountBlocks(blocks, n);
+        });
+        return sum;
+    }
+
+    /** \brief An iterator on the indices of the true bits of the expression
+     *
+     * The blocks are evaluated by chunks in a buffer of the iterator.
+     */
+    class iterator final {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef size_t value_type;
+        typedef ptrdiff_t difference_type;
+        typedef const size_t* pointer;
+        typedef size_t reference;
+
+        iterator(const BitMapExpression& expression, size_t first, size_t last) : expression(&expression),
+                first(first), last(last), block(0), end(0), n(0), i(0), word(0), current(last) {
+            if (! expression.ScanBlocks(first, last, block, end)) {
+                return;
+            }
+            n = (std::min)(end - block, size_t(CHUNK_BLOCKS));
+            expression.Load(block, n, first, last, buffer);
+            word = buffer[0];
+            ++(*this);
+        };
+
+        size_t operator*() const {
+            return current;
+        }
+
+        iterator& operator++() {
+            while (! word) {
+                if (++i == n) {
+                    block += n;
+                    if (block >= end) {
+                        current = last;
+                        return *this;
+                    }
+                    n = (std::min)(end - block, size_t(CHUNK_BLOCKS));
+                    expression->Load(block, n, first, last, buffer);
+                    i = 0;
+                }
+                word = buffer[i];
+            }
+            current = (block + i) * BlockSize() + util::Ctz<T>(word);
+            word &= word - 1;
+            return *this;
+        }
+
+        iterator operator++(int) {
+            auto ret = *this;
+            ++(*this);
+            return ret;
+        }
+
+        bool operator==(const iterator& rhs) const {
+            return current == rhs.current;
+        }
+
+        bool operator!=(const iterator& rhs) const {
+            return current != rhs.current;
+        }
+
+    private:
+        const BitMapExpression* expression;
+        size_t first;
+        size_t last;
+        // the first block of the buffer
+        size_t block;
+        // the block after the blocks to scan
+        size_t end;
+        // the number of blocks in the buffer
+        size_t n;
+        // the block scanned in the buffer
+        size_t i;
+        T buffer[CHUNK_BLOCKS];
+        // the bits of the block not visited yet
+        T word;
+        // the index of the bit, last at the end
+        size_t current;
+    };
+
+    /** \brief The true bits of a range, for range-based for loops
+     *
+     * The range holds a copy of the expression, which can be a temporary.
+     */
+    class range final {
+    public:
+        range(const E& expression, size_t first, size_t last) :
+                expression(expression), first(first), last(last) {};
+
+        iterator begin() const {
+            return iterator(expression, first, last);
+        }
+
+        iterator end() const {
+            return iterator(expression, last, last);
+        }
+
+    private:
+        const E expression;
+        const size_t first;
+        const size_t last;
+    };
+
+    /** \brief Get the indices of the true bits of a range
+     *
+     * \param first size_t the first index
+     * \param last size_t the index after the last one
+     * \return range the range to iterate
+     */
+    range TrueBits(size_t first, size_t last) const {
+        return range(derived(), first, last);
+    }
+
+    // Get the indices of the true bits below size()
+    range TrueBits() const {
+        return range(derived(), 0, size());
+    }
+
+protected:
+    BitMapExpression() {};
+
+private:
+    // get the blocks holding the true bits of a range, return false if there is none
+    bool ScanBlocks(size_t first, size_t last, size_t& b, size_t& end) const {
+        if (first >= last) {
+            return false;
+        }
+        b = first / BlockSize();
+        end = (last + BlockSize() - 1) / BlockSize();
+        if (! DefaultValue()) {
+            b = (std::max)(b, FirstBlock());
+            end = (std::min)(end, LastBlock());
+        }
+        return b < end;
+    }
+
+    // evaluate the blocks and clear the bits out of [first, last)
+    void Load(size_t b, size_t n, size_t first, size_t last, T* buffer) const {
+        Fill(b, n, buffer);
+        if (b * BlockSize() < first) {
+            buffer[0] &= ~T(0) << (first - b * BlockSize());
+        }
+        if ((b + n) * BlockSize() > last) {
+            buffer[n - 1] &= (T(1) << (last - (b + n - 1) * BlockSize())) - 1;
+        }
+    }
+};
+
+template<class E, class T>
+const size_t BitMapExpression<E, T>::CHUNK_BLOCKS;
+
+/** \brief A BitMap operand of an expression
+ */
+template<class T>
+class BitMapTerm final : public BitMapExpression<BitMapTerm<T>, T> {
+public:
+    explicit BitMapTerm(const BitMap<T>& bitmap) : bitmap(&bitmap) {};
+
+    size_t size() const {
+        return bitmap->size();
+    }
+
+    bool DefaultValue() const {
+        return bitmap->DefaultValue();
+    }
+
+    size_t FirstBlock() const {
+        return bitmap->FirstBlock();
+    }
+
+    size_t LastBlock() const {
+        return bitmap->LastBlock();
+    }
+
+    void Fill(size_t b, size_t n, T* out) const {
+        const T def_block = bitmap->DefaultValue() ? T(~T(0)) : T(0);
+        const size_t lo = (std::min)((std::max)(bitmap->FirstBlock(), b), b + n);
+        const size_t hi = (std::max)((std::min)(bitmap->LastBlock(), b + n), lo);
+        std::fill(out, out + (lo - b), def_block);
+        if (lo < hi) {
+            std::copy(bitmap->data() + (lo - bitmap->FirstBlock()), bitmap->data() + (hi - bitmap->FirstBlock()),
+                      out + (lo - b));
+        }
+        std::fill(out + (hi - b), out + n, def_block);
+    }
+
+private:
+    const BitMap<T>* bitmap;
+};
+
+/** \brief The combination of 2 expressions with util::BitAnd, util::BitOr or util::BitXor
+ */
+template<class L, class R, class Op, class T>
+class BitMapBinaryExpression final : public BitMapExpression<BitMapBinaryExpression<L, R, Op, T>, T> {
+public:
+    BitMapBinaryExpression(const L& lhs, const R& rhs) : lhs(lhs), rhs(rhs) {
+        const bool a = lhs.DefaultValue();
+        const bool b = rhs.DefaultValue();
+        const bool lhs_empty = lhs.FirstBlock() >= lhs.LastBlock();
+        const bool rhs_empty = rhs.FirstBlock() >= rhs.LastBlock();
+        // an operand absorbing the other one out of its blocks bounds the result
+        const bool lhs_bounds = Op()(a, true) == Op()(a, false);
+        const bool rhs_bounds = Op()(b, true) == Op()(b, false);
+        if (lhs_bounds && rhs_bounds) {
+            first_block = (std::max)(lhs.FirstBlock(), rhs.FirstBlock());
+            last_block = (std::min)(lhs.LastBlock(), rhs.LastBlock());
+        }
+        else if (lhs_bounds || rhs_empty) {
+            first_block = lhs.FirstBlock();
+            last_block = lhs.LastBlock();
+        }
+        else if (rhs_bounds || lhs_empty) {
+            first_block = rhs.FirstBlock();
+            last_block = rhs.LastBlock();
+        }
+        else {
+            first_block = (std::min)(lhs.FirstBlock(), rhs.FirstBlock());
+            last_block = (std::max)(lhs.LastBlock(), rhs.LastBlock());
+        }
+        if (first_block >= last_block) {
+            first_block = last_block = 0;
+        }
+    };
+
+    size_t size() const {
+        return (std::max)(lhs.size(), rhs.size());
+    }
+
+    bool DefaultValue() const {
+        return Op()(lhs.DefaultValue(), rhs.DefaultValue());
+    }
+
+    size_t FirstBlock() const {
+        return first_block;
+    }
+
+    size_t LastBlock() const {
+        return last_block;
+    }
+
+    void Fill(size_t b, size_t n, T* out) const {
+        T buffer[BitMapExpression<BitMapBinaryExpression, T>::CHUNK_BLOCKS];
+        lhs.Fill(b, n, out);
+        rhs.Fill(b, n, buffer);
+        util::MixBlocks(out, static_cast<const T*>(buffer), n, Op());
+    }
+
+private:
+    const L lhs;
+    const R rhs;
+    size_t first_block;
+    size_t last_block;
+};
+
+/** \brief The negation of an expression
+ */
+template<class E, class T>
+class BitMapNotExpression final : public BitMapExpression<BitMapNotExpression<E, T>, T> {
+public:
+    explicit BitMapNotExpression(const E& operand) : operand(operand) {};
+
+    size_t size() const {
+        return operand.size();
+    }
+
+    bool DefaultValue() const {
+        return ! operand.DefaultValue();
+    }
+
+    size_t FirstBlock() const {
+        return operand.FirstBlock();
+    }
+
+    size_t LastBlock() const {
+        return operand.LastBlock();
+    }
+
+    void Fill(size_t b, size_t n, T* out) const {
+        operand.Fill(b, n, out);
+        util::NotBlocks(out, static_cast<const T*>(out), n);
+    }
+
+private:
+    const E operand;
+};
+
+/** \brief Start a lazy expression with a BitMap
+ *
+ * \param bitmap const BitMap<T>& the bitmap, which must outlive the expression
+ * \return BitMapTerm<T> the expression
+ */
+template<class T>
+BitMapTerm<T> Lazy(const BitMap<T>& bitmap) {
+    return BitMapTerm<T>(bitmap);
+}
+
+// Operators building the expressions, from expressions and BitMap
+#define TRILLEK_BITMAP_EXPRESSION_OPERATOR(OPERATOR, OP) \
+template<class L, class R, class T> \
+BitMapBinaryExpression<L, R, OP, T> OPERATOR(const BitMapExpression<L, T>& lhs, const BitMapExpression<R, T>& rhs) { \
+    return BitMapBinaryExpression<L, R, OP, T>(lhs.derived(), rhs.derived()); \
+} \
+template<class L, class T> \
+BitMapBinaryExpression<L, BitMapTerm<T>, OP, T> OPERATOR(const BitMapExpression<L, T>& lhs, const BitMap<T>& rhs) { \
+    return BitMapBinaryExpression<L, BitMapTerm<T>, OP, T>(lhs.derived(), BitMapTerm<T>(rhs)); \
+} \
+template<class R, class T> \
+BitMapBinaryExpression<BitMapTerm<T>, R, OP, T> OPERATOR(const BitMap<T>& lhs, const BitMapExpression<R, T>& rhs) { \
+    return BitMapBinaryExpression<BitMapTerm<T>, R, OP, T>(BitMapTerm<T>(lhs), rhs.derived()); \
+}
+
+TRILLEK_BITMAP_EXPRESSION_OPERATOR(operator&, util::BitAnd)
+TRILLEK_BITMAP_EXPRESSION_OPERATOR(operator|, util::BitOr)
+TRILLEK_BITMAP_EXPRESSION_OPERATOR(operator^, util::BitXor)
+
+#undef TRILLEK_BITMAP_EXPRESSION_OPERATOR
+
+template<class E, class T>
+BitMapNotExpression<E, T> operator~(const BitMapExpression<E, T>& operand) {
+    return BitMapNotExpression<E, T>(operand.derived());
+}
+}
+
+#endif // BITMAPEXPRESSION_HPP_INCLUDED
@@ -1,10 +1,14 @@
 #ifndef BITMAP_H_INCLUDED
 #define BITMAP_H_INCLUDED
 
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
 #include <vector>
 #include <stdexcept>
 #include <memory>
 #include "util/utiltype.hpp"
+#include "util/bit-kernels.hpp"
 #include "logging.hpp"
 
 #if defined(_MSC_VER)
@@ -76,6 +80,153 @@ private:
 template<class T>
 class BitMapEnumerator;
 
+template<class T>
+class BitMap;
+
+template<class E, class T>
+class BitMapExpression;
+
+/** \brief An iterator on the indices of the true bits of a BitMap
+ *
+ * A block is scanned with Ctz() and cleared bit by bit, blocks equal to 0
+ * are skipped. Outside the stored blocks, the bits take the default value:
+ * the iterator jumps over them if it is false.
+ */
+template<class T>
+class SetBitIterator final {
+public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef size_t value_type;
+    typedef ptrdiff_t difference_type;
+    typedef const size_t* pointer;
+    typedef size_t reference;
+
+    SetBitIterator(const BitMap<T>& bitmap, size_t first, size_t last) : data(bitmap.data()),
+            first_block(bitmap.FirstBlock()), last_block(bitmap.LastBlock()),
+            end_block((last + bitmap.BlockSize() - 1) / bitmap.BlockSize()),
+            stored_end((std::max)(first_block, (std::min)(last_block, end_block))),
+            def_block(bitmap.DefaultValue() ? T(~T(0)) : T(0)), block(first / bitmap.BlockSize()), last(last),
+            word(0), current(last) {
+        if (first >= last) {
+            return;
+        }
+        word = Block(block) & (~T(0) << (first % bitmap.BlockSize()));
+        ++(*this);
+    };
+
+    size_t operator*() const {
+        return current;
+    }
+
+    SetBitIterator& operator++() {
+        while (! word) {
+            ++block;
+            if (block - first_block < stored_end - first_block) {
+                // the stored blocks, zero blocks are skipped
+                const T* p = data + (block - first_block);
+                const T* const end = data + (stored_end - first_block);
+                while (p != end && ! *p) {
+                    ++p;
+                }
+                block = first_block + (p - data);
+                if (p == end) {
+                    --block;
+                    continue;
+                }
+                word = *p;
+                if (block + 1 == end_block) {
+                    word = Block(block);
+                }
+                continue;
+            }
+            else if (block >= end_block || (! def_block && block >= last_block)) {
+                current = last;
+                return *this;
+            }
+            else if (! def_block) {
+                // before the stored blocks
+                block = first_block - 1;
+                continue;
+            }
+            word = Block(block);
+        }
+        current = block * BlockSize() + util::Ctz<T>(word);
+        word &= word - 1;
+        return *this;
+    }
+
+    SetBitIterator operator++(int) {
+        auto ret = *this;
+        ++(*this);
+        return ret;
+    }
+
+    bool operator==(const SetBitIterator& rhs) const {
+        return current == rhs.current;
+    }
+
+    bool operator!=(const SetBitIterator& rhs) const {
+        return current != rhs.current;
+    }
+
+private:
+    static size_t BlockSize() {
+        return sizeof(T) << 3;
+    }
+
+    // the block b, the bits from last cleared
+    T Block(size_t b) const {
+        T w = b >= first_block && b < last_block ? data[b - first_block] : def_block;
+        if (b + 1 >= end_block && (b + 1) * BlockSize() > last) {
+            w &= (T(1) << (last - b * BlockSize())) - 1;
+        }
+        return w;
+    }
+
+    const T* data;
+    size_t first_block;
+    size_t last_block;
+    // the block after the range
+    size_t end_block;
+    // the block after the stored blocks of the range
+    size_t stored_end;
+    // the blocks outside the stored ones
+    T def_block;
+    // the block scanned
+    size_t block;
+    // the index after the range
+    size_t last;
+    // the bits of the block not visited yet
+    T word;
+    // the index of the bit, last at the end
+    size_t current;
+};
+
+/** \brief The true bits of a range of a BitMap, for range-based for loops
+ *
+ *     for (auto id : bitmap.TrueBits()) {
+ *         ...
+ *     }
+ */
+template<class T>
+class SetBitRange final {
+public:
+    SetBitRange(const BitMap<T>& bitmap, size_t first, size_t last) : bitmap(bitmap), first(first), last(last) {};
+
+    SetBitIterator<T> begin() const {
+        return SetBitIterator<T>(bitmap, first, last);
+    }
+
+    SetBitIterator<T> end() const {
+        return SetBitIterator<T>(bitmap, last, last);
+    }
+
+private:
+    const BitMap<T>& bitmap;
+    const size_t first;
+    const size_t last;
+};
+
 /** \brief A bitset like boost::dynamic_bitset
  */
 template<class T>
@@ -93,17 +244,33 @@ public:
     // Constructor with initial size and default value
     BitMap(const size_t s, const bool b) :
             bsize(s), def_value(b ? -1 : 0),
-                                     last_block(0), first_block(0) {};
+                                     last_block(0), first_block(0), base_block(0) {};
+
+    /** \brief Evaluate a lazy expression, see bitmap-expression.hpp
+     *
+     * \param expression const BitMapExpression<E, T>& the expression
+     */
+    template<class E>
+    BitMap(const BitMapExpression<E, T>& expression) : bsize(expression.size()),
+            first_block(expression.FirstBlock()), last_block(expression.LastBlock()),
+            base_block(expression.FirstBlock()), def_value(expression.DefaultValue() ? -1 : 0) {
+        const size_t chunk = BitMapExpression<E, T>::CHUNK_BLOCKS;
+        bitarray.resize(last_block - first_block);
+        for (size_t b = first_block; b < last_block; b += chunk) {
+            expression.Fill(b, (std::min)(last_block - b, chunk), bitarray.data() + (b - first_block));
+        }
+    }
 
     // Default destructor
     ~BitMap() {};
 
-    // Copy constructor
+    // Copy constructor, the free blocks are not copied
     BitMap(const BitMap& ba) {
-        bitarray = ba.bitarray;
+        bitarray.assign(ba.blocks(), ba.blocks() + ba.stored());
         def_value = ba.def_value;
         first_block = ba.first_block;
         last_block = ba.last_block;
+        base_block = ba.first_block;
         bsize = ba.bsize;
     }
     // Move Constructor
@@ -112,15 +279,20 @@ public:
         def_value = std::move(ba.def_value);
         first_block = std::move(ba.first_block);
         last_block = std::move(ba.last_block);
+        base_block = std::move(ba.base_block);
         bsize = std::move(ba.bsize);
+        ba.first_block = ba.last_block = ba.base_block = 0;
     }
     // Copy assignment
     BitMap& operator=(const BitMap& ba) {
-        bitarray = ba.bitarray;
-        def_value = ba.def_value;
-        first_block = ba.first_block;
-        last_block = ba.last_block;
-        bsize = ba.bsize;
+        if (this != &ba) {
+            bitarray.assign(ba.blocks(), ba.blocks() + ba.stored());
+            def_value = ba.def_value;
+            first_block = ba.first_block;
+            last_block = ba.last_block;
+            base_block = ba.first_block;
+            bsize = ba.bsize;
+        }
         return *this;
     }
     // Move assignment
@@ -129,26 +301,29 @@ public:
         def_value = std::move(ba.def_value);
         first_block = std::move(ba.first_block);
         last_block = std::move(ba.last_block);
+        base_block = std::move(ba.base_block);
         bsize = std::move(ba.bsize);
+        ba.first_block = ba.last_block = ba.base_block = 0;
         return *this;
     }
 
-    // Compound assignment operators
+    // Compound assignment operators, in place: the blocks are reallocated
+    // only when the other BitSet stores blocks out of the range of this one
     // OR combination between 2 BitSets
     BitMap& operator|=(const BitMap& ba) {
-        MixArray(*this, ba, lambda_OR);
+        MixArray(ba, util::BitOr());
         return *this;
     }
 
     // AND combination between 2 BitSets
     BitMap& operator&=(const BitMap& ba) {
-        MixArray(*this, ba, lambda_AND);
+        MixArray(ba, util::BitAnd());
         return *this;
     }
 
     // XOR combination between 2 BitSets
     BitMap& operator^=(const BitMap& ba) {
-        MixArray(*this, ba, lambda_XOR);
+        MixArray(ba, util::BitXor());
         return *this;
     }
 
@@ -157,15 +332,21 @@ public:
         BitMap<T> ret;
         ret.first_block = this->first_block;
         ret.last_block = this->last_block;
+        ret.base_block = this->first_block;
         ret.bsize = this->bsize;
-        ret.bitarray.reserve(this->bitarray.size());
-        for (auto& c : this->bitarray) {
-           ret.bitarray.push_back(~c);
-        }
+        ret.bitarray.resize(stored());
+        util::NotBlocks(ret.bitarray.data(), blocks(), stored());
         ret.def_value = ~this->def_value;
         return ret;
     }
 
+    // NOT operation in place
+    BitMap& flip() {
+        util::NotBlocks(blocks(), blocks(), stored());
+        def_value = ~def_value;
+        return *this;
+    }
+
     // Access to an element of the BitSet
     bool at(size_t idx) const {
         auto offset = idx / BlockSize();
@@ -173,33 +354,44 @@ public:
             return def_value;
         }
         auto bit_id = idx % BlockSize();
-        return ((bitarray[offset - first_block] & (T(1) << bit_id)) != 0);
+        return ((bitarray[offset - base_block] & (T(1) << bit_id)) != 0);
     }
 
-    // left-side reference
+    // left-side reference, the blocks grow in amortized constant time on both sides
     reference<T> operator[](size_t idx) {
         auto offset = idx / BlockSize();
-        if (offset >= last_block) {
-            if (! last_block) {
-                first_block = offset;
-            }
-            bitarray.resize(offset - first_block + 1, def_value);
-            last_block = offset + 1;
+        if (offset >= last_block || offset < first_block) {
+            Extend(offset, offset + 1);
         }
         if (idx >= bsize) {
             bsize = idx + 1;
         }
-        else if (offset < first_block) {
-            auto bitarray2 = std::vector<T>(last_block - offset, def_value);
-            auto temp = first_block - offset;
-            for (auto i = 0; i < bitarray.size(); ++i) {
-                bitarray2[temp + i] = std::move(bitarray[i]);
-            }
-            bitarray = std::move(bitarray2);
-            first_block = offset;
-        }
         auto bit_id = idx % BlockSize();
-        return reference<T>(bitarray[offset - first_block], bit_id);
+        return reference<T>(bitarray[offset - base_block], bit_id);
+    }
+
+    /** \brief Allocate the blocks of a range of indices
+     *
+     * The writes in the range do not reallocate the blocks. The size and the
+     * bits are unchanged.
+     *
+     * \param min_id size_t the first index
+     * \param max_id size_t the last index, included in the range. Nothing is
+     * allocated if it is lower than min_id.
+     */
+    void reserve(size_t min_id, size_t max_id) {
+        if (min_id > max_id) {
+            return;
+        }
+        auto from = min_id / BlockSize();
+        auto to = max_id / BlockSize() + 1;
+        if (first_block != last_block) {
+            from = (std::min)(from, first_block);
+            to = (std::max)(to, last_block);
+        }
+        if (from < base_block || to > base_block + bitarray.size()) {
+            Reallocate(from, to - from);
+        }
     }
 
     void erase(size_t idx) {
@@ -209,8 +401,8 @@ public:
         }
     }
 
+    // the allocated blocks are kept
     void clear() {
-        bitarray.clear();
         first_block = 0;
         last_block = 0;
         bsize = 0;
@@ -221,13 +413,32 @@ public:
     }
 
     const T* data() const {
-        return bitarray.data();
+        return blocks();
     }
 
     BitMapEnumerator<T> enumerator(size_t max_iterations) const {
         return BitMapEnumerator<T>(*this, max_iterations);
     };
 
+    /** \brief Get the indices of the true bits of a range
+     *
+     * \param first size_t the first index
+     * \param last size_t the index after the last one
+     * \return SetBitRange<T> the range to iterate
+     */
+    SetBitRange<T> TrueBits(size_t first, size_t last) const {
+        return SetBitRange<T>(*this, first, last);
+    }
+
+    /** \brief Get the indices of the true bits below size()
+     *
+     * With a default value true, the bits from size() are true but not
+     * returned.
+     */
+    SetBitRange<T> TrueBits() const {
+        return SetBitRange<T>(*this, 0, size());
+    }
+
     const size_t countTrue() const {
         if (first_block == last_block) {
             return def_value ? size() : 0;
@@ -235,28 +446,60 @@ public:
         size_t sum = def_value ? first_block * BlockSize() : 0;
         const auto length = size();
         const auto last_index = (std::min)(length, last_block * BlockSize());
-        #if defined(__GNUG__) || defined(_MSC_VER)
-            const auto start = bitarray.data();
-            const auto end = start + ((last_index- first_block * BlockSize()) >> util::Log2Bin<T>());
-            auto i = start;
-            for (; i < end; ++i) {
-                sum += util::PopCount<T>(*i);
-            }
-            sum += util::PopCount<T>(*i & ( (T(1) << (last_index & (BlockSize() - 1))) -1));
-        #else
-            size_t j = first_block << BlockSize();
-            for (; j < last_index; ++j) {
-                if ((*this)[j]) {
-                    ++sum;
-                }
+        if (last_index > first_block * BlockSize()) {
+            const auto bits = last_index - first_block * BlockSize();
+            const auto full_blocks = bits >> util::Log2Bin<T>();
+            sum += util::PopCountBlocks(blocks(), full_blocks);
+            const auto tail = bits & (BlockSize() - 1);
+            if (tail) {
+                sum += util::PopCount<T>(blocks()[full_blocks] & ((T(1) << tail) - 1));
             }
-        #endif
+        }
         if (length >= last_block * BlockSize()) {
             sum += def_value ? (length  - last_block * BlockSize()) : 0;
         }
         return sum;
     }
 
+    /** \brief Call a function with the index of each true bit of a range
+     *
+     * Blocks are scanned with Ctz(), and the bits outside the stored blocks
+     * take the default value.
+     *
+     * \param first size_t the first index
+     * \param last size_t the index after the last one
+     * \param f F&& the function called with the index
+     */
+    template<class F>
+    void ForEachTrue(size_t first, size_t last, F&& f) const {
+        const size_t bs = BlockSize();
+        const size_t stored_first = first_block * bs;
+        const size_t stored_last = last_block * bs;
+        if (def_value) {
+            for (size_t idx = first; idx < (std::min)(last, stored_first); ++idx) {
+                f(idx);
+            }
+        }
+        for (auto b = (std::max)(first / bs, first_block); b < last_block && b * bs < last; ++b) {
+            T word = bitarray[b - base_block];
+            if (b * bs < first) {
+                word &= ~T(0) << (first - b * bs);
+            }
+            if ((b + 1) * bs > last) {
+                word &= (T(1) << (last - b * bs)) - 1;
+            }
+            while (word) {
+                f(b * bs + util::Ctz<T>(word));
+                word &= word - 1;
+            }
+        }
+        if (def_value) {
+            for (size_t idx = (std::max)(first, stored_last); idx < last; ++idx) {
+                f(idx);
+            }
+        }
+    }
+
     size_t LastBlock() const {
         return last_block;
     }
@@ -274,54 +517,113 @@ public:
     }
 
 private:
-    void MixArray(BitMap<T>& a, const BitMap<T>& b, const std::function<T(const T&,const T&)>& operation) {
-        auto left = std::min(a.first_block, b.first_block);
-        auto right = std::max(a.last_block, b.last_block);
-        auto& first_left = (left == a.first_block ? a : b);
-        auto& last_left = (&first_left == &b ? a : b);
-        auto& last_right = (right == a.last_block ? a : b);
-        auto& first_right = (&last_right == &b ? a : b);
-        auto middle_left = std::min(last_left.first_block, first_right.last_block);
-        auto middle_right = std::max(last_left.first_block, first_right.last_block);
-        std::vector<T> result;
-        result.reserve(right - left);
-        auto first_size = middle_left - left;
-        auto last_size = right - middle_right;
-        for (size_t j = 0; j < first_size; ++j) {
-            result.push_back(operation(first_left.bitarray.at(j), last_left.def_value));
-        }
-        if (a.size() && b.size()) {
-            if (middle_left == last_left.first_block) {
-                for(size_t j = first_size, k = 0 ; k < middle_right - middle_left; ++k, ++j) {
-                    result.push_back(operation(first_left.bitarray.at(j), last_left.bitarray.at(k)));
-                }
-            }
-            else if (first_size && last_size){
-                for(size_t k = 0 ; k < middle_right - middle_left; ++k) {
-                    result.push_back(operation(first_left.def_value, last_left.def_value));
-                }
-            }
+    // the stored blocks
+    T* blocks() {
+        return bitarray.data() + (first_block == last_block ? 0 : first_block - base_block);
+    }
+
+    const T* blocks() const {
+        return bitarray.data() + (first_block == last_block ? 0 : first_block - base_block);
+    }
+
+    size_t stored() const {
+        return last_block - first_block;
+    }
+
+    /** \brief Extend the stored blocks to a range
+     *
+     * The new blocks take the default value. When the allocated blocks do not
+     * cover the range, they are reallocated with as many free blocks as
+     * stored ones, on the side where the range grows, or split on both sides.
+     * Writing in ascending, descending or random order is then amortized
+     * constant time.
+     *
+     * \param from size_t the first block of the range
+     * \param to size_t the block after the range
+     */
+    void Extend(size_t from, size_t to) {
+        const bool empty = first_block == last_block;
+        const bool down = ! empty && from < first_block;
+        const bool up = ! empty && to > last_block;
+        if (! empty) {
+            from = (std::min)(from, first_block);
+            to = (std::max)(to, last_block);
         }
-        for (size_t j = middle_right - left, k = last_right.bitarray.size() - last_size; k < last_right.bitarray.size(); ++j, ++k) {
-            result.push_back(operation(last_right.bitarray.at(k), first_right.def_value));
+        if (from < base_block || to > base_block + bitarray.size()) {
+            const size_t needed = to - from;
+            const size_t slack = (std::max)(needed, bitarray.size());
+            // no free block below block 0
+            const size_t front = (std::min)(down && ! up ? slack : (up && ! down ? 0 : slack / 2), from);
+            Reallocate(from - front, needed + slack);
         }
-        a.def_value = operation(a.def_value, b.def_value);
-        if(result.size()) {
-            a.first_block = first_size ? left : last_left.first_block;
-            a.last_block = last_size ? right : first_right.last_block;
+        if (empty) {
+            std::fill(bitarray.begin() + (from - base_block), bitarray.begin() + (to - base_block), def_value);
         }
         else {
-            a.first_block = 0;
-            a.last_block = 0;
+            std::fill(bitarray.begin() + (from - base_block), bitarray.begin() + (first_block - base_block), def_value);
+            std::fill(bitarray.begin() + (last_block - base_block), bitarray.begin() + (to - base_block), def_value);
         }
-        a.bsize = std::max(a.bsize, b.bsize);
-        a.bitarray = std::move(result);
+        first_block = from;
+        last_block = to;
     }
 
-    const std::function<T(const T&,const T&)> lambda_OR = [](const T& a, const T& b) { return a | b;};
-    const std::function<T(const T&,const T&)> lambda_AND = [](const T& a, const T& b) { return a & b;};
-    const std::function<T(const T&,const T&)> lambda_XOR = [](const T& a, const T& b) { return a ^ b;};
+    /** \brief Move the stored blocks to a new allocation
+     *
+     * \param base size_t the block at the start of the allocation
+     * \param capacity size_t the number of blocks allocated
+     */
+    void Reallocate(size_t base, size_t capacity) {
+        std::vector<T> reallocated(capacity);
+        std::copy(blocks(), blocks() + stored(), reallocated.begin() + (stored() ? first_block - base : 0));
+        bitarray = std::move(reallocated);
+        base_block = base;
+    }
+
+    /** \brief Combine another BitSet into this one
+     *
+     * The blocks of this BitSet are extended to the blocks stored by b, then
+     * combined with the blocks of b, or with the default value of b where b
+     * stores nothing.
+     *
+     * \param b const BitMap<T>& the other BitSet
+     * \param operation Op the operation, util::BitAnd, util::BitOr or util::BitXor
+     */
+    template<class Op>
+    void MixArray(const BitMap<T>& b, Op operation) {
+        if (b.first_block != b.last_block) {
+            Extend(b.first_block, b.last_block);
+            const auto before = b.first_block - first_block;
+            const auto after = b.last_block - first_block;
+            util::MixBlocks(blocks() + before, b.blocks(), b.stored(), operation);
+            MixDefault(blocks(), before, b.def_value, operation);
+            MixDefault(blocks() + after, stored() - after, b.def_value, operation);
+        }
+        else {
+            MixDefault(blocks(), stored(), b.def_value, operation);
+        }
+        def_value = operation(def_value, b.def_value);
+        bsize = (std::max)(bsize, b.bsize);
+    }
 
+    /** \brief Combine blocks with a default value
+     *
+     * A default value has all bits equal: the operation leaves the blocks
+     * unchanged, fills them or inverts them.
+     */
+    template<class Op>
+    static void MixDefault(T* blocks, size_t n, T value, Op operation) {
+        const T zero = operation(T(0), value);
+        const T ones = operation(T(~T(0)), value);
+        if (zero == T(0) && ones == T(~T(0))) {
+            return;
+        }
+        if (zero == ones) {
+            std::fill(blocks, blocks + n, zero);
+        }
+        else {
+            util::NotBlocks(blocks, blocks, n);
+        }
+    }
 
     std::vector<T> bitarray;
     // number of elements
@@ -330,10 +632,14 @@ private:
     size_t first_block;
     // index of "after" last block
     size_t last_block;
+    // index of the block at bitarray[0], the blocks out of
+    // [first_block, last_block) are free
+    size_t base_block;
     T def_value;
 };
 
 // Bitwise logical operators
+// The versions taking a temporary reuse its blocks, e.g. in a & b & c
 template<class T>
 BitMap<T> operator&(const BitMap<T>& lhs, const BitMap<T>& rhs) {
     auto ret = lhs;
@@ -341,6 +647,24 @@ BitMap<T> operator&(const BitMap<T>& lhs, const BitMap<T>& rhs) {
     return ret;
 }
 
+template<class T>
+BitMap<T> operator&(BitMap<T>&& lhs, const BitMap<T>& rhs) {
+    lhs &= rhs;
+    return std::move(lhs);
+}
+
+template<class T>
+BitMap<T> operator&(const BitMap<T>& lhs, BitMap<T>&& rhs) {
+    rhs &= lhs;
+    return std::move(rhs);
+}
+
+template<class T>
+BitMap<T> operator&(BitMap<T>&& lhs, BitMap<T>&& rhs) {
+    lhs &= rhs;
+    return std::move(lhs);
+}
+
 template<class T>
 BitMap<T> operator|(const BitMap<T>& lhs, const BitMap<T>& rhs) {
     auto ret = lhs;
@@ -348,6 +672,24 @@ BitMap<T> operator|(const BitMap<T>& lhs, const BitMap<T>& rhs) {
     return ret;
 }
 
+template<class T>
+BitMap<T> operator|(BitMap<T>&& lhs, const BitMap<T>& rhs) {
+    lhs |= rhs;
+    return std::move(lhs);
+}
+
+template<class T>
+BitMap<T> operator|(const BitMap<T>& lhs, BitMap<T>&& rhs) {
+    rhs |= lhs;
+    return std::move(rhs);
+}
+
+template<class T>
+BitMap<T> operator|(BitMap<T>&& lhs, BitMap<T>&& rhs) {
+    lhs |= rhs;
+    return std::move(lhs);
+}
+
 template<class T>
 BitMap<T> operator^(const BitMap<T>& lhs, const BitMap<T>& rhs) {
     auto ret = lhs;
@@ -355,6 +697,24 @@ BitMap<T> operator^(const BitMap<T>& lhs, const BitMap<T>& rhs) {
     return ret;
 }
 
+template<class T>
+BitMap<T> operator^(BitMap<T>&& lhs, const BitMap<T>& rhs) {
+    lhs ^= rhs;
+    return std::move(lhs);
+}
+
+template<class T>
+BitMap<T> operator^(const BitMap<T>& lhs, BitMap<T>&& rhs) {
+    rhs ^= lhs;
+    return std::move(rhs);
+}
+
+template<class T>
+BitMap<T> operator^(BitMap<T>&& lhs, BitMap<T>&& rhs) {
+    lhs ^= rhs;
+    return std::move(lhs);
+}
+
 #if defined(__GNUG__) || defined(_MSC_VER) // define BitMapEnumerator per compiler
 template<class T>
 class BitMapEnumerator final {
@@ -0,0 +1,304 @@
+#ifndef BOUNDEDQUEUE_HPP_INCLUDED
+#define BOUNDEDQUEUE_HPP_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <list>
+#include <utility>
+#include <vector>
+#include <trillek-allocator.hpp>
+
+namespace trillek {
+
+// indices written by different threads are kept on different cache lines
+const size_t QUEUE_CACHE_LINE = 64;
+
+/** \brief A lock-free multi-producer multi-consumer queue of fixed capacity
+ *
+ * Each cell of the ring buffer carries a sequence number telling whether it
+ * can be written or read at a given position, so producers and consumers only
+ * contend on one compare-and-swap of the position they advance (D. Vyukov's
+ * bounded queue). The buffer is allocated once: Push() and Pop() never
+ * allocate memory and never take a lock.
+ *
+ * The interface is the one of AtomicQueue, except that Push() fails when the
+ * queue is full. T must be default-constructible and move-assignable. A cell
+ * keeps its moved-from element until it is written again.
+ */
+template<class T>
+class BoundedQueue final {
+
+    template<class U>
+    using atomic_queue = std::list<U, TrillekAllocator<U>>;
+
+    struct Cell {
+        Cell() : sequence(0) {};
+
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    public:
+
+        /** \brief Constructor
+         *
+         * \param capacity size_t the max number of elements, rounded up to a power of 2
+         */
+        explicit BoundedQueue(size_t capacity = 1024) : cells(RoundUp(capacity)), mask(cells.size() - 1),
+                                                        enqueue_pos(0), dequeue_pos(0) {
+            for (size_t i = 0; i < cells.size(); ++i) {
+                cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        };
+
+        /** \brief Destructor
+         *
+         */
+        ~BoundedQueue() {};
+
+        // disable copy functions
+        BoundedQueue(BoundedQueue&) = delete;
+        BoundedQueue& operator=(BoundedQueue&) = delete;
+
+        /** \brief Empty the queue and return the content
+         *
+         * Elements pushed during the call may be returned too.
+         *
+         * \return atomic_queue<T> A list of the content
+         *
+         */
+        atomic_queue<T> Poll() const {
+            auto ret = atomic_queue<T>{};
+            T element;
+            while (Pop(element)) {
+                ret.push_back(std::move(element));
+            }
+            return ret;
+        }
+
+        /** \brief Put an element at the end of the queue
+         *
+         * \param element U&& element to put in the queue
+         * \return bool false if the queue is full, the element is not moved
+         */
+        template<class U>
+        bool Push(U&& element) const {
+            auto pos = enqueue_pos.load(std::memory_order_relaxed);
+            while (true) {
+                auto& cell = cells[pos & mask];
+                const auto sequence = cell.sequence.load(std::memory_order_acquire);
+                const auto diff = static_cast<std::ptrdiff_t>(sequence - pos);
+                if (! diff) {
+                    // the cell is free for this position, claim it
+                    if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        cell.data = std::forward<U>(element);
+                        cell.sequence.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0) {
+                    // the cell still holds the element of the previous lap
+                    return false;
+                }
+                else {
+                    pos = enqueue_pos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        /** \brief Pop an element from the front of the queue
+         *
+         * \param element T& reference that will contain the element popped
+         * \return bool true if an element was popped, false otherwise
+         */
+        bool Pop(T& element) const {
+            auto pos = dequeue_pos.load(std::memory_order_relaxed);
+            while (true) {
+                auto& cell = cells[pos & mask];
+                const auto sequence = cell.sequence.load(std::memory_order_acquire);
+                const auto diff = static_cast<std::ptrdiff_t>(sequence - (pos + 1));
+                if (! diff) {
+                    if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        element = std::move(cell.data);
+                        // free the cell for the next lap
+                        cell.sequence.store(pos + mask + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0) {
+                    return false;
+                }
+                else {
+                    pos = dequeue_pos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        /** \brief Test if the queue is empty
+         *
+         * The result may be outdated when other threads use the queue.
+         *
+         * \return bool true if the queue is empty, false otherwise
+         *
+         */
+        bool Empty() const {
+            return dequeue_pos.load(std::memory_order_acquire) >= enqueue_pos.load(std::memory_order_acquire);
+        }
+
+        /** \brief Get the max number of elements
+         *
+         */
+        size_t Capacity() const {
+            return cells.size();
+        }
+
+    private:
+
+        static size_t RoundUp(size_t capacity) {
+            size_t size = 2;
+            while (size < capacity) {
+                size <<= 1;
+            }
+            return size;
+        }
+
+        mutable std::vector<Cell, TrillekAllocator<Cell>> cells;
+        const size_t mask;
+        char pad0[QUEUE_CACHE_LINE];
+        // the next position to write
+        mutable std::atomic<size_t> enqueue_pos;
+        char pad1[QUEUE_CACHE_LINE];
+        // the next position to read
+        mutable std::atomic<size_t> dequeue_pos;
+        char pad2[QUEUE_CACHE_LINE];
+};
+
+/** \brief A lock-free queue of fixed capacity between one producer and one consumer
+ *
+ * Use it as a pipe between two systems: only one thread may push and only one
+ * thread may pop, not necessarily the same ones during the whole life of the
+ * queue if the handover is synchronized. Each side keeps a copy of the index
+ * of the other side and only reads the shared index when the copy tells the
+ * queue is full or empty.
+ *
+ * T must be default-constructible and move-assignable.
+ */
+template<class T>
+class SpscQueue final {
+
+    template<class U>
+    using atomic_queue = std::list<U, TrillekAllocator<U>>;
+
+    public:
+
+        /** \brief Constructor
+         *
+         * \param capacity size_t the max number of elements, rounded up to a power of 2
+         */
+        explicit SpscQueue(size_t capacity = 1024) : q(RoundUp(capacity)), mask(q.size() - 1),
+                                                    tail(0), cached_head(0), head(0), cached_tail(0) {};
+
+        /** \brief Destructor
+         *
+         */
+        ~SpscQueue() {};
+
+        // disable copy functions
+        SpscQueue(SpscQueue&) = delete;
+        SpscQueue& operator=(SpscQueue&) = delete;
+
+        /** \brief Empty the queue and return the content (consumer side)
+         *
+         * \return atomic_queue<T> A list of the content
+         *
+         */
+        atomic_queue<T> Poll() const {
+            auto ret = atomic_queue<T>{};
+            const auto pos = head.load(std::memory_order_relaxed);
+            const auto end = tail.load(std::memory_order_acquire);
+            for (auto p = pos; p != end; ++p) {
+                ret.push_back(std::move(q[p & mask]));
+            }
+            cached_tail = end;
+            head.store(end, std::memory_order_release);
+            return ret;
+        }
+
+        /** \brief Put an element at the end of the queue (producer side)
+         *
+         * \param element U&& element to put in the queue
+         * \return bool false if the queue is full, the element is not moved
+         */
+        template<class U>
+        bool Push(U&& element) const {
+            const auto pos = tail.load(std::memory_order_relaxed);
+            if (pos - cached_head == q.size()) {
+                cached_head = head.load(std::memory_order_acquire);
+                if (pos - cached_head == q.size()) {
+                    return false;
+                }
+            }
+            q[pos & mask] = std::forward<U>(element);
+            tail.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        /** \brief Pop an element from the front of the queue (consumer side)
+         *
+         * \param element T& reference that will contain the element popped
+         * \return bool true if an element was popped, false otherwise
+         */
+        bool Pop(T& element) const {
+            const auto pos = head.load(std::memory_order_relaxed);
+            if (pos == cached_tail) {
+                cached_tail = tail.load(std::memory_order_acquire);
+                if (pos == cached_tail) {
+                    return false;
+                }
+            }
+            element = std::move(q[pos & mask]);
+            head.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        /** \brief Test if the queue is empty
+         *
+         * \return bool true if the queue is empty, false otherwise
+         *
+         */
+        bool Empty() const {
+            return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+        }
+
+        /** \brief Get the max number of elements
+         *
+         */
+        size_t Capacity() const {
+            return q.size();
+        }
+
+    private:
+
+        static size_t RoundUp(size_t capacity) {
+            size_t size = 2;
+            while (size < capacity) {
+                size <<= 1;
+            }
+            return size;
+        }
+
+        mutable std::vector<T, TrillekAllocator<T>> q;
+        const size_t mask;
+        char pad0[QUEUE_CACHE_LINE];
+        // producer side: the next position to write and the last head read
+        mutable std::atomic<size_t> tail;
+        mutable size_t cached_head;
+        char pad1[QUEUE_CACHE_LINE];
+        // consumer side: the next position to read and the last tail read
+        mutable std::atomic<size_t> head;
+        mutable size_t cached_tail;
+        char pad2[QUEUE_CACHE_LINE];
+};
+}
+
+#endif // BOUNDEDQUEUE_HPP_INCLUDED
@@ -85,6 +85,18 @@ std::shared_ptr<const T> Get(const std::shared_ptr<const Container>& ct) {
     return std::shared_ptr<const T>(ct,&std::static_pointer_cast<const ContainerObject<C>>(ct)->Get());
 }
 
+/** \brief Get the memory tag of a component type
+ *
+ * \return MemoryTag the tag charged with the containers of the component
+ *
+ */
+template<Component C>
+MemoryTag Tag() {
+    static const MemoryTag tag = MemoryAccounting::Tag(std::string("component ")
+                                    + reflection::GetTypeName<std::integral_constant<Component,C>>());
+    return tag;
+}
+
 /** \brief Put a component data in a component container
  *
  * T must match the component data type or can be implicitly cast to it.
@@ -95,7 +107,7 @@ std::shared_ptr<const T> Get(const std::shared_ptr<const Container>& ct) {
  */
 template<Component C, class T=typename type_trait<C>::value_type>
 std::shared_ptr<Container> Create(T&& comp) {
-    return std::static_pointer_cast<Container>(std::allocate_shared<ContainerObject<C,T>>(TrillekAllocator<ContainerObject<C,T>>(), std::forward<T>(comp)));
+    return std::static_pointer_cast<Container>(std::allocate_shared<ContainerObject<C,T>>(TrillekAllocator<ContainerObject<C,T>>(Tag<C>()), std::forward<T>(comp)));
 }
 
 /** \brief Put a component data in a component container
@@ -110,7 +122,7 @@ std::shared_ptr<Container> Create(T&& comp) {
  */
 template<Component C, class T=typename type_trait<C>::value_type>
 std::shared_ptr<const Container> CreateConst(T&& comp) {
-    return std::static_pointer_cast<const Container>(std::allocate_shared<ContainerObject<C,T>>(TrillekAllocator<ContainerObject<C,T>>(), std::forward<T>(comp)));
+    return std::static_pointer_cast<const Container>(std::allocate_shared<ContainerObject<C,T>>(TrillekAllocator<ContainerObject<C,T>>(Tag<C>()), std::forward<T>(comp)));
 }
 
 } // namespace component
@@ -1,9 +1,13 @@
 #ifndef COMPONENT_HPP_INCLUDED
 #define COMPONENT_HPP_INCLUDED
 
+#include <stdexcept>
 #include <vector>
 #include "systems/physics.hpp"
 #include "bitmap.hpp"
+#include "bitmap-expression.hpp"
+#include "compressed-bitmap.hpp"
+#include "trillek-scheduler.hpp"
 #include "components/component-enum.hpp"
 #include "components/component-container.hpp"
 
@@ -28,6 +32,9 @@ public:
 
 namespace component {
 
+// Minimal number of entities processed by a task in bulk operations
+#define BULK_GRAIN      4096
+
 // A class to hold a container reference
 template<class T>
 struct ContainerRef {
@@ -65,21 +72,114 @@ typename type_trait<C>::value_type Initialize(bool& result, const std::vector<Pr
     return typename type_trait<C>::value_type();
 }
 
-/** \brief Apply a function to all entities in the bitmap
+/** \brief Get the end of the entities of a bitmap used without range
+ *
+ * A bitmap with a default value true, e.g. ~Bitmap<C>(), has no end: the
+ * caller must give the number of entities.
  *
  * \param bitmap the bitmap
+ * \return size_t bitmap.size()
+ * \throw std::invalid_argument if the default value of the bitmap is true
+ *
+ */
+template<class B>
+static size_t UnboundedEnd(const B& bitmap) {
+    if (bitmap.DefaultValue()) {
+        throw std::invalid_argument("A bitmap with a default value true needs the number of entities");
+    }
+    return bitmap.size();
+}
+
+/** \brief Apply a function to all entities in the bitmap
+ *
+ * \param bitmap the bitmap, with a default value false. Use the overload
+ * with a range for a default value true, e.g. for ~Bitmap<C>().
  * \param operation the function executed
+ * \throw std::invalid_argument if the default value of the bitmap is true
  *
  */
-template<class T>
-static void OnTrue(const BitMap<T>& bitmap, const std::function<void(id_t)>& operation) {
-    // TODO replace 10000 by the number of entities in the game.
-    auto end = bitmap.DefaultValue() ? std::max(bitmap.size(), size_t(10000)) : bitmap.size();
-    for (auto i = bitmap.enumerator(10000); *i < end; ++i) {
-        operation(*i);
+template<class T, class F>
+static void OnTrue(const BitMap<T>& bitmap, F&& operation) {
+    UnboundedEnd(bitmap);
+    for (auto id : bitmap.TrueBits()) {
+        operation(static_cast<id_t>(id));
     }
 }
 
+/** \brief Apply a function to the entities in a range of the bitmap
+ *
+ * \param bitmap the bitmap
+ * \param first the first entity id of the range
+ * \param last the entity id after the range
+ * \param operation the function executed
+ *
+ */
+template<class T, class F>
+static void OnTrue(const BitMap<T>& bitmap, size_t first, size_t last, F&& operation) {
+    bitmap.ForEachTrue(first, last, std::forward<F>(operation));
+}
+
+/** \brief Apply a function to the entities in a range of a compressed bitmap
+ *
+ * \param bitmap the bitmap
+ * \param first the first entity id of the range
+ * \param last the entity id after the range
+ * \param operation the function executed
+ *
+ */
+template<class F>
+static void OnTrue(const CompressedBitMap& bitmap, size_t first, size_t last, F&& operation) {
+    bitmap.ForEachTrue(first, last, std::forward<F>(operation));
+}
+
+/** \brief Apply a function to all entities in a compressed bitmap
+ *
+ * \param bitmap the bitmap, with a default value false
+ * \param operation the function executed
+ * \throw std::invalid_argument if the default value of the bitmap is true
+ *
+ */
+template<class F>
+static void OnTrue(const CompressedBitMap& bitmap, F&& operation) {
+    bitmap.ForEachTrue(0, UnboundedEnd(bitmap), std::forward<F>(operation));
+}
+
+/** \brief Apply a function to the entities in a range of a lazy bitmap expression
+ *
+ * The expression is evaluated on the range only.
+ *
+ * \param bitmap the expression, e.g. Lazy(Bitmap<C1>()) & Bitmap<C2>()
+ * \param first the first entity id of the range
+ * \param last the entity id after the range
+ * \param operation the function executed
+ *
+ */
+template<class E, class T, class F>
+static void OnTrue(const BitMapExpression<E, T>& bitmap, size_t first, size_t last, F&& operation) {
+    bitmap.ForEachTrue(first, last, std::forward<F>(operation));
+}
+
+/** \brief Apply a function to all entities in a lazy bitmap expression
+ *
+ * \param bitmap the expression, with a default value false
+ * \param operation the function executed
+ * \throw std::invalid_argument if the default value of the expression is true
+ *
+ */
+template<class E, class T, class F>
+static void OnTrue(const BitMapExpression<E, T>& bitmap, F&& operation) {
+    bitmap.ForEachTrue(0, UnboundedEnd(bitmap), std::forward<F>(operation));
+}
+
+/** \brief Get the scheduler used to split bulk operations
+ *
+ * \return TrillekScheduler& the scheduler
+ *
+ */
+static TrillekScheduler& Scheduler() {
+    return ContainerRef<TrillekScheduler>::container;
+}
+
 /** \brief Get the components container
  *
  * Use this to make a copy of all components.
@@ -255,10 +355,100 @@ static const std::map<id_t,const typename type_trait<C>::value_type, std::less<i
  *
  */
 template<Component C>
-static const BitMap<uint32_t>& GetLastPositiveBitMap() {
+static const CompressedBitMap& GetLastPositiveBitMap() {
     return GetRawContainer<C>().template GetLastPositiveBitMap<C>();
 }
 
+/** \brief Return a bitmap of the entities of a bitmap verifying a predicate
+ *
+ * The bitmap is split in ranges tested by all threads, and the partial
+ * bitmaps are merged.
+ *
+ * \param bitmap the entities to test, a BitMap, a CompressedBitMap or a lazy expression
+ * \param entities the number of entities, the ids tested are lower
+ * \param predicate a thread-safe function taking an entity id and returning a bool
+ * \return BitMap<uint32_t> the entities verifying the predicate
+ *
+ */
+template<class B, class P>
+static BitMap<uint32_t> Filter(const B& bitmap, size_t entities, P&& predicate) {
+    return Scheduler().ParallelReduce(0, entities, BULK_GRAIN, BitMap<uint32_t>(),
+        [&](size_t first, size_t last) -> BitMap<uint32_t> {
+            BitMap<uint32_t> partial;
+            OnTrue(bitmap, first, last,
+                [&](id_t id) {
+                    if (predicate(id)) {
+                        partial[id] = true;
+                    }
+                }
+            );
+            return partial;
+        },
+        [](BitMap<uint32_t>&& ret, BitMap<uint32_t>&& partial) -> BitMap<uint32_t> {
+            ret |= partial;
+            return std::move(ret);
+        }
+    );
+}
+
+/** \brief Return a bitmap of the entities of a bitmap verifying a predicate
+ *
+ * \param bitmap the entities to test, with a default value false
+ * \param predicate a thread-safe function taking an entity id and returning a bool
+ * \return BitMap<uint32_t> the entities verifying the predicate
+ * \throw std::invalid_argument if the default value of the bitmap is true
+ *
+ */
+template<class B, class P>
+static BitMap<uint32_t> Filter(const B& bitmap, P&& predicate) {
+    return Filter(bitmap, UnboundedEnd(bitmap), std::forward<P>(predicate));
+}
+
+/** \brief Replace the value of the components matching a bitmap
+ *
+ * New values are computed by all threads, then the updates are applied by
+ * the calling thread since containers do not support concurrent writes.
+ *
+ * \param bitmap the entities to update, a BitMap, a CompressedBitMap or a lazy expression
+ * \param entities the number of entities, the ids updated are lower
+ * \param operation a thread-safe function taking the current value and returning the new one
+ *
+ */
+template<Component C, class B, class F>
+static void Apply(const B& bitmap, size_t entities, F&& operation) {
+    typedef std::vector<std::pair<id_t,typename type_trait<C>::value_type>> update_list;
+    auto updates = Scheduler().ParallelReduce(0, entities, BULK_GRAIN, update_list(),
+        [&](size_t first, size_t last) -> update_list {
+            update_list partial;
+            OnTrue(bitmap, first, last,
+                [&](id_t id) {
+                    partial.emplace_back(id, operation(Get<C>(id)));
+                }
+            );
+            return partial;
+        },
+        [](update_list&& ret, update_list&& partial) -> update_list {
+            ret.insert(ret.end(), std::make_move_iterator(partial.begin()), std::make_move_iterator(partial.end()));
+            return std::move(ret);
+        }
+    );
+    for (auto& u : updates) {
+        Update<C>(u.first, std::move(u.second));
+    }
+}
+
+/** \brief Replace the value of the components matching a bitmap
+ *
+ * \param bitmap the entities to update, with a default value false
+ * \param operation a thread-safe function taking the current value and returning the new one
+ * \throw std::invalid_argument if the default value of the bitmap is true
+ *
+ */
+template<Component C, class B, class F>
+static void Apply(const B& bitmap, F&& operation) {
+    Apply<C>(bitmap, UnboundedEnd(bitmap), std::forward<F>(operation));
+}
+
 /** \brief Return a bitmap of component comparison
  *
  * The bitmap returns true for each entity verifying 'value < n'
@@ -269,15 +459,11 @@ static const BitMap<uint32_t>& GetLastPositiveBitMap() {
  */
 template<Component C, class T>
 static BitMap<uint32_t> Lower(const T& n) {
-    BitMap<uint32_t> ret;
-    OnTrue(Bitmap<C>(),
+    return Filter(Bitmap<C>(),
         [&](id_t id) {
-            if (Get<C>(id) < n) {
-                ret[id] = true;
-            }
+            return Get<C>(id) < n;
         }
     );
-    return ret;
 }
 
 /** \brief Return a bitmap of component comparison
@@ -290,15 +476,11 @@ static BitMap<uint32_t> Lower(const T& n) {
  */
 template<Component C, class T>
 static BitMap<uint32_t> LowerOrEqual(const T& n) {
-    BitMap<uint32_t> ret;
-    OnTrue(Bitmap<C>(),
+    return Filter(Bitmap<C>(),
         [&](id_t id) {
-            if (Get<C>(id) <= n) {
-                ret[id] = true;
-            }
+            return Get<C>(id) <= n;
         }
     );
-    return ret;
 }
 
 /** \brief Return a bitmap of component comparison
@@ -311,15 +493,11 @@ static BitMap<uint32_t> LowerOrEqual(const T& n) {
  */
 template<Component C, class T>
 static BitMap<uint32_t> Greater(const T& n) {
-    BitMap<uint32_t> ret;
-    OnTrue(Bitmap<C>(),
+    return Filter(Bitmap<C>(),
         [&](id_t id) {
-            if (Get<C>(id) > n) {
-                ret[id] = true;
-            }
+            return Get<C>(id) > n;
         }
     );
-    return ret;
 }
 
 /** \brief Return a bitmap of component comparison
@@ -332,15 +510,11 @@ static BitMap<uint32_t> Greater(const T& n) {
  */
 template<Component C, class T>
 static BitMap<uint32_t> GreaterOrEqual(const T& n) {
-    BitMap<uint32_t> ret;
-    OnTrue(Bitmap<C>(),
+    return Filter(Bitmap<C>(),
         [&](id_t id) {
-            if (Get<C>(id) >= n) {
-                ret[id] = true;
-            }
+            return Get<C>(id) >= n;
         }
     );
-    return ret;
 }
 
 /** \brief Return a bitmap of component comparison
@@ -353,15 +527,11 @@ static BitMap<uint32_t> GreaterOrEqual(const T& n) {
  */
 template<Component C, class T>
 static BitMap<uint32_t> Equal(const T& n) {
-    BitMap<uint32_t> ret;
-    OnTrue(Bitmap<C>(),
+    return Filter(Bitmap<C>(),
         [&](id_t id) {
-            if (Get<C>(id) == n) {
-                ret[id] = true;
-            }
+            return Get<C>(id) == n;
         }
     );
-    return ret;
 }
 
 /** \brief Return a bitmap of component comparison
@@ -374,15 +544,11 @@ static BitMap<uint32_t> Equal(const T& n) {
  */
 template<Component C, class T>
 static BitMap<uint32_t> NotEqual(const T& n) {
-    BitMap<uint32_t> ret;
-    OnTrue(Bitmap<C>(),
+    return Filter(Bitmap<C>(),
         [&](id_t id) {
-            if (Get<C>(id) != n) {
-                ret[id] = true;
-            }
+            return Get<C>(id) != n;
         }
     );
-    return ret;
 }
 
 /** \brief Return a bitmap of component comparison
@@ -394,15 +560,11 @@ static BitMap<uint32_t> NotEqual(const T& n) {
  */
 template<Component C1, Component C2>
 static BitMap<uint32_t> Lower() {
-    BitMap<uint32_t> ret;
-    OnTrue(Bitmap<C1>() & Bitmap<C2>(),
+    return Filter(Lazy(Bitmap<C1>()) & Bitmap<C2>(),
         [&](id_t id) {
-            if (Get<C1>(id) < Get<C2>(id)) {
-                ret[id] = true;
-            }
+            return Get<C1>(id) < Get<C2>(id);
         }
     );
-    return ret;
 }
 
 /** \brief Return a bitmap of component comparison
@@ -414,15 +576,11 @@ static BitMap<uint32_t> Lower() {
  */
 template<Component C1, Component C2>
 static BitMap<uint32_t> LowerOrEqual() {
-    BitMap<uint32_t> ret;
-    OnTrue(Bitmap<C1>() & Bitmap<C2>(),
+    return Filter(Lazy(Bitmap<C1>()) & Bitmap<C2>(),
         [&](id_t id) {
-            if (Get<C1>(id) <= Get<C2>(id)) {
-                ret[id] = true;
-            }
+            return Get<C1>(id) <= Get<C2>(id);
         }
     );
-    return ret;
 }
 
 /** \brief Return a bitmap of component comparison
@@ -434,15 +592,11 @@ static BitMap<uint32_t> LowerOrEqual() {
  */
 template<Component C1, Component C2>
 static BitMap<uint32_t> Greater() {
-    BitMap<uint32_t> ret;
-    OnTrue(Bitmap<C1>() & Bitmap<C2>(),
+    return Filter(Lazy(Bitmap<C1>()) & Bitmap<C2>(),
         [&](id_t id) {
-            if (Get<C1>(id) > Get<C2>(id)) {
-                ret[id] = true;
-            }
+            return Get<C1>(id) > Get<C2>(id);
         }
     );
-    return ret;
 }
 
 /** \brief Return a bitmap of component comparison
@@ -454,15 +608,11 @@ static BitMap<uint32_t> Greater() {
  */
 template<Component C1, Component C2>
 static BitMap<uint32_t> GeaterOrEqual() {
-    BitMap<uint32_t> ret;
-    OnTrue(Bitmap<C1>() & Bitmap<C2>(),
+    return Filter(Lazy(Bitmap<C1>()) & Bitmap<C2>(),
         [&](id_t id) {
-            if (Get<C1>(id) >= Get<C2>(id)) {
-                ret[id] = true;
-            }
+            return Get<C1>(id) >= Get<C2>(id);
         }
     );
-    return ret;
 }
 
 /** \brief Return a bitmap of component comparison
@@ -474,15 +624,11 @@ static BitMap<uint32_t> GeaterOrEqual() {
  */
 template<Component C1, Component C2>
 static BitMap<uint32_t> Equal() {
-    BitMap<uint32_t> ret;
-    OnTrue(Bitmap<C1>() & Bitmap<C2>(),
+    return Filter(Lazy(Bitmap<C1>()) & Bitmap<C2>(),
         [&](id_t id) {
-            if (Get<C1>(id) == Get<C2>(id)) {
-                ret[id] = true;
-            }
+            return Get<C1>(id) == Get<C2>(id);
         }
     );
-    return ret;
 }
 
 /** \brief Return a bitmap of component comparison
@@ -494,15 +640,11 @@ static BitMap<uint32_t> Equal() {
  */
 template<Component C1, Component C2>
 static BitMap<uint32_t> NotEqual() {
-    BitMap<uint32_t> ret;
-    OnTrue(Bitmap<C1>() & Bitmap<C2>(),
+    return Filter(Lazy(Bitmap<C1>()) & Bitmap<C2>(),
         [&](id_t id) {
-            if (Get<C1>(id) != Get<C2>(id)) {
-                ret[id] = true;
-            }
+            return Get<C1>(id) != Get<C2>(id);
         }
     );
-    return ret;
 }
 
 /** \brief Add a constant to all components
@@ -512,9 +654,9 @@ static BitMap<uint32_t> NotEqual() {
  */
 template<Component C, class T>
 static void Add(const T& n) {
-    OnTrue(Bitmap<C>(),
-        [&](id_t id) {
-            Update<C>(id, Get<C>(id) + n);
+    Apply<C>(Bitmap<C>(),
+        [&](const typename type_trait<C>::value_type& value) {
+            return value + n;
         }
     );
 }
@@ -527,9 +669,9 @@ static void Add(const T& n) {
  */
 template<Component C, class T>
 static void Add(const T& n, const BitMap<uint32_t>& bitmap) {
-    OnTrue(bitmap,
-        [&](id_t id) {
-            Update<C>(id, Get<C>(id) + n);
+    Apply<C>(bitmap,
+        [&](const typename type_trait<C>::value_type& value) {
+            return value + n;
         }
     );
 }
@@ -541,9 +683,9 @@ static void Add(const T& n, const BitMap<uint32_t>& bitmap) {
  */
 template<Component C, class T>
 static void Multiply(const T& n) {
-    OnTrue(Bitmap<C>(),
-        [&](id_t id) {
-            Update<C>(id, Get<C>(id) * n);
+    Apply<C>(Bitmap<C>(),
+        [&](const typename type_trait<C>::value_type& value) {
+            return value * n;
         }
     );
 }
@@ -556,9 +698,9 @@ static void Multiply(const T& n) {
  */
 template<Component C, class T>
 static void Multiply(const T& n, const BitMap<uint32_t>& bitmap) {
-    OnTrue(bitmap,
-        [&](id_t id) {
-            Update<C>(id, Get<C>(id) * n);
+    Apply<C>(bitmap,
+        [&](const typename type_trait<C>::value_type& value) {
+            return value * n;
         }
     );
 }
@@ -570,9 +712,9 @@ static void Multiply(const T& n, const BitMap<uint32_t>& bitmap) {
  */
 template<Component C, class T>
 static void Divide(const T& n) {
-    OnTrue(Bitmap<C>(),
-        [&](id_t id) {
-            Update<C>(id, Get<C>(id) / n);
+    Apply<C>(Bitmap<C>(),
+        [&](const typename type_trait<C>::value_type& value) {
+            return value / n;
         }
     );
 }
@@ -585,9 +727,9 @@ static void Divide(const T& n) {
  */
 template<Component C, class T>
 static void Divide(const T& n, const BitMap<uint32_t>& bitmap) {
-    OnTrue(bitmap,
-        [&](id_t id) {
-            Update<C>(id, Get<C>(id) / n);
+    Apply<C>(bitmap,
+        [&](const typename type_trait<C>::value_type& value) {
+            return value / n;
         }
     );
 }
@@ -89,7 +89,7 @@ public:
     }
 
     template<Component C>
-    const BitMap<uint32_t>& GetLastPositiveBitMap() {
+    const CompressedBitMap& GetLastPositiveBitMap() {
         return Map<C>().GetLastPositiveBitMap();
     }
 
@@ -18,7 +18,8 @@ public:
 };
 
 template<Component C, class T>
-typename SystemValueContainer<C,T>::container_type SystemValueContainer<C,T>::container;
+typename SystemValueContainer<C,T>::container_type SystemValueContainer<C,T>::container{std::less<id_t>(),
+    typename SystemValueContainer<C,T>::container_type::allocator_type(Tag<C>())};
 
 template<Component C, class T>
 BitMap<uint32_t> SystemValueContainer<C,T>::bitmap;
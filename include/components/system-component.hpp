@@ -19,7 +19,8 @@ public:
 };
 
 template<Component type>
-typename SystemContainer<type>::container_type SystemContainer<type>::container;
+typename SystemContainer<type>::container_type SystemContainer<type>::container{std::less<id_t>(),
+    typename SystemContainer<type>::container_type::allocator_type(Tag<type>())};
 
 template<Component C>
 BitMap<uint32_t> SystemContainer<C>::bitmap;
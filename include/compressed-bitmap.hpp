@@ -0,0 +1,386 @@
+#ifndef COMPRESSEDBITMAP_HPP_INCLUDED
+#define COMPRESSEDBITMAP_HPP_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "bitmap.hpp"
+
+namespace trillek {
+
+/** \brief A compressed bitset with the interface of BitMap
+ *
+ * The ids are split in chunks of 65536 bits, as in Roaring bitmaps. Only the
+ * chunks holding bits different from the default value are stored, each in
+ * the smallest of 3 containers:
+ * - an array of the sorted 16-bit offsets, up to ARRAY_MAX bits,
+ * - a bitset of 1024 words,
+ * - a list of runs of consecutive bits.
+ *
+ * The container of a chunk is selected by its density when the chunk is
+ * built by an operation, or grows past ARRAY_MAX bits. Optimize() selects
+ * the containers of all chunks again, e.g. after many writes.
+ *
+ * A few hundred ids scattered over a million cost a few bytes per id, where
+ * a BitMap stores all the blocks between the first and the last id.
+ * Operations combine the chunks, so their cost follows the stored chunks,
+ * not the range of ids.
+ */
+class CompressedBitMap final {
+public:
+    static const size_t CHUNK_BITS = 1 << 16;
+    // max number of bits of an array container
+    static const size_t ARRAY_MAX = 4096;
+    static const size_t BITSET_WORDS = CHUNK_BITS / 64;
+
+    /** \brief A reference to simulate an lvalue
+     */
+    class bit_reference final {
+    public:
+        bit_reference(CompressedBitMap& bitmap, size_t idx) : bitmap(bitmap), idx(idx) {};
+
+        bit_reference& operator=(bool b) {
+            bitmap.Set(idx, b);
+            return *this;
+        }
+
+        bit_reference& operator=(const bit_reference& r) {
+            bitmap.Set(idx, bool(r));
+            return *this;
+        }
+
+        bit_reference& operator|=(bool b) {
+            if (b) {
+                bitmap.Set(idx, true);
+            }
+            return *this;
+        }
+
+        bit_reference& operator&=(bool b) {
+            if (! b) {
+                bitmap.Set(idx, false);
+            }
+            return *this;
+        }
+
+        operator bool() const {
+            return bitmap.at(idx);
+        }
+
+    private:
+        CompressedBitMap& bitmap;
+        const size_t idx;
+    };
+
+    // Default constructor
+    CompressedBitMap() : bsize(0), def_value(false) {};
+    // Constructor with default value
+    explicit CompressedBitMap(const bool b) : bsize(0), def_value(b) {};
+    // Constructor with initial size
+    explicit CompressedBitMap(const size_t s) : bsize(s), def_value(false) {};
+    // Constructor with initial size and default value
+    CompressedBitMap(const size_t s, const bool b) : bsize(s), def_value(b) {};
+
+    /** \brief Compress a BitMap
+     *
+     * \param bitmap const BitMap<T>& the bitmap
+     */
+    template<class T>
+    explicit CompressedBitMap(const BitMap<T>& bitmap) : bsize(bitmap.size()), def_value(bitmap.DefaultValue()) {
+        const T def_block = def_value ? T(~T(0)) : T(0);
+        const auto data = bitmap.data();
+        const size_t bs = bitmap.BlockSize();
+        Builder builder(*this);
+        for (size_t b = bitmap.FirstBlock(); b < bitmap.LastBlock(); ++b) {
+            const T word = data[b - bitmap.FirstBlock()] ^ def_block;
+            if (word) {
+                builder.Add(b * bs, static_cast<uint64_t>(word));
+            }
+        }
+        builder.Flush();
+    }
+
+    /** \brief Decompress to a BitMap
+     *
+     * \return BitMap<T> the bitmap
+     */
+    template<class T>
+    BitMap<T> ToBitMap() const {
+        BitMap<T> ret(bsize, def_value);
+        ForEachException(0, static_cast<size_t>(-1), [&](size_t idx) {
+            ret[idx] = ! def_value;
+        });
+        return ret;
+    }
+
+    // Compound assignment operators
+    CompressedBitMap& operator&=(const CompressedBitMap& b);
+    CompressedBitMap& operator|=(const CompressedBitMap& b);
+    CompressedBitMap& operator^=(const CompressedBitMap& b);
+
+    // NOT operation, in constant time
+    CompressedBitMap operator~() const {
+        CompressedBitMap ret(*this);
+        ret.flip();
+        return ret;
+    }
+
+    // NOT operation in place
+    CompressedBitMap& flip() {
+        def_value = ! def_value;
+        return *this;
+    }
+
+    // Access to an element of the BitSet
+    bool at(size_t idx) const;
+
+    // left-side reference
+    bit_reference operator[](size_t idx) {
+        return bit_reference(*this, idx);
+    }
+
+    /** \brief Write an element
+     *
+     * \param idx size_t the index
+     * \param b bool the value
+     */
+    void Set(size_t idx, bool b);
+
+    void erase(size_t idx) {
+        if (idx < bsize) {
+            Set(idx, def_value);
+        }
+    }
+
+    void clear() {
+        chunks.clear();
+        bsize = 0;
+    }
+
+    size_t size() const {
+        return bsize;
+    }
+
+    bool DefaultValue() const {
+        return def_value;
+    }
+
+    size_t countTrue() const;
+
+    /** \brief Call a function with the index of each true bit of a range
+     *
+     * \param first size_t the first index
+     * \param last size_t the index after the last one
+     * \param f F&& the function called with the index
+     */
+    template<class F>
+    void ForEachTrue(size_t first, size_t last, F&& f) const {
+        if (! def_value) {
+            ForEachException(first, last, f);
+            return;
+        }
+        // the bits between the exceptions
+        size_t next = first;
+        ForEachException(first, last, [&](size_t idx) {
+            for (; next < idx; ++next) {
+                f(next);
+            }
+            next = idx + 1;
+        });
+        for (; next < last; ++next) {
+            f(next);
+        }
+    }
+
+    /** \brief Select the smallest container for each chunk
+     *
+     */
+    void Optimize();
+
+    /** \brief Get the number of bytes taken by the containers
+     *
+     */
+    size_t MemoryUsage() const;
+
+    /** \brief Get the number of chunks stored
+     *
+     */
+    size_t Chunks() const {
+        return chunks.size();
+    }
+
+private:
+    /** \brief The bits of a chunk different from the default value
+     */
+    struct Container {
+        enum Kind : uint8_t { ARRAY, BITSET, RUN };
+
+        Container() : kind(ARRAY), cardinality(0) {};
+
+        bool Contains(uint16_t low) const;
+        // return true if the bit was not set
+        bool Insert(uint16_t low);
+        // return true if the bit was set
+        bool Remove(uint16_t low);
+        // number of bits below low
+        size_t CountBelow(uint32_t low) const;
+        void ToWords(uint64_t* out) const;
+        // build the container from a bitset, runs are allowed if runs is true
+        void FromWords(const uint64_t* in, bool runs);
+        size_t Bytes() const;
+
+        template<class F>
+        void ForEach(size_t base, uint32_t first, uint32_t last, F&& f) const {
+            switch (kind) {
+            case ARRAY:
+                for (auto it = std::lower_bound(values.begin(), values.end(), first); it != values.end() && *it < last; ++it) {
+                    f(base + *it);
+                }
+                break;
+            case BITSET:
+                for (uint32_t w = first / 64; w < BITSET_WORDS && w * 64 < last; ++w) {
+                    uint64_t word = words[w];
+                    if (w * 64 < first) {
+                        word &= ~uint64_t(0) << (first - w * 64);
+                    }
+                    if ((w + 1) * 64 > last) {
+                        word &= (uint64_t(1) << (last - w * 64)) - 1;
+                    }
+                    while (word) {
+                        f(base + w * 64 + util::Ctz<uint64_t>(word));
+                        word &= word - 1;
+                    }
+                }
+                break;
+            case RUN:
+                // values holds the first and the last bit of each run
+                for (size_t r = 0; r < values.size(); r += 2) {
+                    const uint32_t start = (std::max)(uint32_t(values[r]), first);
+                    const uint32_t end = (std::min)(uint32_t(values[r + 1]) + 1, last);
+                    for (uint32_t low = start; low < end; ++low) {
+                        f(base + low);
+                    }
+                }
+                break;
+            }
+        }
+
+        Kind kind;
+        uint32_t cardinality;
+        // ARRAY: the sorted offsets, RUN: the bounds of the runs
+        std::vector<uint16_t> values;
+        // BITSET: the bits
+        std::vector<uint64_t> words;
+    };
+
+    struct Chunk {
+        // the index of the chunk, idx / CHUNK_BITS
+        size_t key;
+        Container container;
+    };
+
+    enum class Operation { AND, OR, XOR, AND_NOT };
+
+    /** \brief Call a function with each bit different from the default value in a range
+     *
+     */
+    template<class F>
+    void ForEachException(size_t first, size_t last, F&& f) const {
+        if (first >= last) {
+            return;
+        }
+        const auto first_key = first / CHUNK_BITS;
+        const auto last_key = (last - 1) / CHUNK_BITS;
+        for (auto it = LowerBound(first_key); it != chunks.end() && it->key <= last_key; ++it) {
+            const auto base = it->key * CHUNK_BITS;
+            const uint32_t low_first = it->key == first_key ? static_cast<uint32_t>(first - base) : 0;
+            const uint32_t low_last = it->key == last_key ? static_cast<uint32_t>(last - 1 - base) + 1 : CHUNK_BITS;
+            it->container.ForEach(base, low_first, low_last, f);
+        }
+    }
+
+    std::vector<Chunk>::const_iterator LowerBound(size_t key) const {
+        return std::lower_bound(chunks.begin(), chunks.end(), key,
+                                [](const Chunk& c, size_t k) { return c.key < k; });
+    }
+
+    /** \brief Build the chunks from words given in increasing order
+     */
+    class Builder final {
+    public:
+        explicit Builder(CompressedBitMap& target) : target(target), words(BITSET_WORDS), key(0), empty(true) {};
+
+        // add the bits of a word starting at first_bit, a multiple of 32
+        void Add(size_t first_bit, uint64_t word);
+        // store the last chunk
+        void Flush();
+
+    private:
+        CompressedBitMap& target;
+        std::vector<uint64_t> words;
+        size_t key;
+        bool empty;
+    };
+
+    /** \brief Combine the exceptions of 2 bitmaps
+     *
+     */
+    static std::vector<Chunk> Combine(const std::vector<Chunk>& a, const std::vector<Chunk>& b, Operation op);
+    static bool CombineContainers(const Container& a, const Container& b, Operation op, Container& result);
+
+    std::vector<Chunk> chunks;
+    // number of elements
+    size_t bsize;
+    bool def_value;
+};
+
+// Bitwise logical operators
+inline CompressedBitMap operator&(CompressedBitMap lhs, const CompressedBitMap& rhs) {
+    lhs &= rhs;
+    return lhs;
+}
+
+inline CompressedBitMap operator|(CompressedBitMap lhs, const CompressedBitMap& rhs) {
+    lhs |= rhs;
+    return lhs;
+}
+
+inline CompressedBitMap operator^(CompressedBitMap lhs, const CompressedBitMap& rhs) {
+    lhs ^= rhs;
+    return lhs;
+}
+
+// Operators with a BitMap, e.g. component::Bitmap<C>() & sparse
+template<class T>
+CompressedBitMap operator&(const CompressedBitMap& lhs, const BitMap<T>& rhs) {
+    return lhs & CompressedBitMap(rhs);
+}
+
+template<class T>
+CompressedBitMap operator&(const BitMap<T>& lhs, const CompressedBitMap& rhs) {
+    return CompressedBitMap(lhs) & rhs;
+}
+
+template<class T>
+CompressedBitMap operator|(const CompressedBitMap& lhs, const BitMap<T>& rhs) {
+    return lhs | CompressedBitMap(rhs);
+}
+
+template<class T>
+CompressedBitMap operator|(const BitMap<T>& lhs, const CompressedBitMap& rhs) {
+    return CompressedBitMap(lhs) | rhs;
+}
+
+template<class T>
+CompressedBitMap operator^(const CompressedBitMap& lhs, const BitMap<T>& rhs) {
+    return lhs ^ CompressedBitMap(rhs);
+}
+
+template<class T>
+CompressedBitMap operator^(const BitMap<T>& lhs, const CompressedBitMap& rhs) {
+    return CompressedBitMap(lhs) ^ rhs;
+}
+}
+
+#endif // COMPRESSEDBITMAP_HPP_INCLUDED
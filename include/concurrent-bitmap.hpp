@@ -0,0 +1,221 @@
+#ifndef CONCURRENTBITMAP_HPP_INCLUDED
+#define CONCURRENTBITMAP_HPP_INCLUDED
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include "bitmap.hpp"
+#include "bitmap-expression.hpp"
+
+namespace trillek {
+
+/** \brief A bitset with a fixed capacity, written by many threads
+ *
+ * The blocks are allocated once for the capacity given to the constructor
+ * or to reserve(), so a write never moves them. Set() is a fetch_or or a
+ * fetch_and on the block of the bit, and all threads can write concurrently,
+ * e.g. to mark the entities updated by the tasks of a parallel system.
+ *
+ * The range of blocks written since the last clear() is tracked, so that
+ * Snapshot() and clear() only touch this range. The bounds are updated with
+ * a compare-and-swap when a write extends them, which is rare once a frame
+ * has started.
+ *
+ * Writes are relaxed: a snapshot taken while other threads write can miss
+ * the last writes. Take it after joining the writers, e.g. at commit.
+ *
+ * Lazy(concurrent_bitmap) reads it in a lazy expression with BitMaps.
+ */
+template<class T>
+class ConcurrentBitMap final {
+public:
+    /** \brief Constructor
+     *
+     * \param capacity size_t the number of bits that can be written
+     * \param b bool the default value
+     */
+    explicit ConcurrentBitMap(size_t capacity = 0, bool b = false) : capacity_blocks(0),
+            def_block(b ? T(~T(0)) : T(0)), first_block(NONE), bsize(0) {
+        reserve(capacity);
+    };
+
+    ConcurrentBitMap(const ConcurrentBitMap&) = delete;
+    ConcurrentBitMap& operator=(const ConcurrentBitMap&) = delete;
+
+    /** \brief Grow the capacity, keeping the bits
+     *
+     * Not thread-safe: no other thread may access the bitmap.
+     *
+     * \param capacity size_t the number of bits that can be written
+     */
+    void reserve(size_t capacity) {
+        const size_t blocks = (capacity + BlockSize() - 1) / BlockSize();
+        if (blocks <= capacity_blocks) {
+            return;
+        }
+        std::unique_ptr<std::atomic<T>[]> grown(new std::atomic<T>[blocks]);
+        for (size_t b = 0; b < blocks; ++b) {
+            grown[b].store(b < capacity_blocks ? bitarray[b].load(std::memory_order_relaxed) : def_block,
+                           std::memory_order_relaxed);
+        }
+        bitarray = std::move(grown);
+        capacity_blocks = blocks;
+    }
+
+    size_t capacity() const {
+        return capacity_blocks * BlockSize();
+    }
+
+    /** \brief Write a bit, thread-safe
+     *
+     * \param idx size_t the index, lower than capacity()
+     * \param b bool the value
+     * \return bool the previous value
+     * \throw std::out_of_range if idx is not lower than capacity()
+     */
+    bool Set(size_t idx, bool b) {
+        const size_t block = idx / BlockSize();
+        if (block >= capacity_blocks) {
+            throw std::out_of_range("ConcurrentBitMap::Set");
+        }
+        const T mask = T(1) << (idx % BlockSize());
+        const T previous = b ? bitarray[block].fetch_or(mask, std::memory_order_relaxed)
+                             : bitarray[block].fetch_and(T(~mask), std::memory_order_relaxed);
+        if (b != bool(def_block)) {
+            Extend(block, idx + 1);
+        }
+        return (previous & mask) != 0;
+    }
+
+    // Read a bit, thread-safe
+    bool at(size_t idx) const {
+        const size_t block = idx / BlockSize();
+        if (block >= capacity_blocks) {
+            return def_block != 0;
+        }
+        return (bitarray[block].load(std::memory_order_relaxed) & (T(1) << (idx % BlockSize()))) != 0;
+    }
+
+    /** \brief Copy the bits into a BitMap
+     *
+     * Only the blocks written since the last clear() are copied.
+     *
+     * \return BitMap<T> the bitmap
+     */
+    BitMap<T> Snapshot() const {
+        return BitMap<T>(ConcurrentBitMapTerm(*this));
+    }
+
+    /** \brief Reset the bits written to the default value
+     *
+     * The capacity is kept. Not thread-safe: no other thread may access the
+     * bitmap.
+     */
+    void clear() {
+        for (size_t b = FirstBlock(); b < LastBlock(); ++b) {
+            bitarray[b].store(def_block, std::memory_order_relaxed);
+        }
+        first_block.store(NONE, std::memory_order_relaxed);
+        bsize.store(0, std::memory_order_relaxed);
+    }
+
+    // the index after the last bit written
+    size_t size() const {
+        return bsize.load(std::memory_order_relaxed);
+    }
+
+    bool DefaultValue() const {
+        return def_block != 0;
+    }
+
+    // the blocks out of [FirstBlock(), LastBlock()) were not written
+    size_t FirstBlock() const {
+        return (std::min)(first_block.load(std::memory_order_relaxed), LastBlock());
+    }
+
+    size_t LastBlock() const {
+        return (size() + BlockSize() - 1) / BlockSize();
+    }
+
+    static size_t BlockSize() {
+        return sizeof(T) << 3;
+    }
+
+    /** \brief A ConcurrentBitMap operand of a lazy expression
+     */
+    class ConcurrentBitMapTerm final : public BitMapExpression<ConcurrentBitMapTerm, T> {
+    public:
+        explicit ConcurrentBitMapTerm(const ConcurrentBitMap& bitmap) : bitmap(&bitmap),
+                last_block(bitmap.LastBlock()), first_block(bitmap.FirstBlock()), bsize(bitmap.size()) {};
+
+        size_t size() const {
+            return bsize;
+        }
+
+        bool DefaultValue() const {
+            return bitmap->DefaultValue();
+        }
+
+        size_t FirstBlock() const {
+            return first_block;
+        }
+
+        size_t LastBlock() const {
+            return last_block;
+        }
+
+        void Fill(size_t b, size_t n, T* out) const {
+            for (size_t i = 0; i < n; ++i) {
+                out[i] = b + i >= first_block && b + i < last_block
+                            ? bitmap->bitarray[b + i].load(std::memory_order_relaxed) : bitmap->def_block;
+            }
+        }
+
+    private:
+        const ConcurrentBitMap* bitmap;
+        // the bounds read when the expression was built
+        size_t last_block;
+        size_t first_block;
+        size_t bsize;
+    };
+
+private:
+    static const size_t NONE = (std::numeric_limits<size_t>::max)();
+
+    // extend the range written to a block and to the index after a bit
+    void Extend(size_t block, size_t end) {
+        auto first = first_block.load(std::memory_order_relaxed);
+        while (block < first && ! first_block.compare_exchange_weak(first, block, std::memory_order_relaxed)) {
+        }
+        auto size = bsize.load(std::memory_order_relaxed);
+        while (end > size && ! bsize.compare_exchange_weak(size, end, std::memory_order_relaxed)) {
+        }
+    }
+
+    std::unique_ptr<std::atomic<T>[]> bitarray;
+    size_t capacity_blocks;
+    const T def_block;
+    // the first block written, NONE if there is none
+    std::atomic<size_t> first_block;
+    // the index after the last bit written
+    std::atomic<size_t> bsize;
+};
+
+template<class T>
+const size_t ConcurrentBitMap<T>::NONE;
+
+/** \brief Read a ConcurrentBitMap in a lazy expression
+ *
+ * \param bitmap const ConcurrentBitMap<T>& the bitmap, which must outlive the expression
+ * \return the expression
+ */
+template<class T>
+typename ConcurrentBitMap<T>::ConcurrentBitMapTerm Lazy(const ConcurrentBitMap<T>& bitmap) {
+    return typename ConcurrentBitMap<T>::ConcurrentBitMapTerm(bitmap);
+}
+}
+
+#endif // CONCURRENTBITMAP_HPP_INCLUDED
@@ -0,0 +1,583 @@
+#ifndef CONCURRENTMAP_HPP_INCLUDED
+#define CONCURRENTMAP_HPP_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace trillek {
+
+/** \brief A thread-safe hash map split in shards
+ *
+ * A key belongs to one of SHARDS shards, each one with its own lock and its
+ * own open-addressing table, so threads only contend when they write keys of
+ * the same shard.
+ *
+ * Writers bump a sequence number around each change of a shard (seqlock).
+ * When K and T are trivially copyable, readers do not take the lock: they read
+ * the slot, and read it again if a writer changed the shard meanwhile. The
+ * slots are then stored in relaxed atomic words, copied one by one, so that
+ * a read racing with a writer is defined and only its copy is torn. The
+ * tables replaced when a shard grows are kept until the map is destroyed,
+ * since a reader may still be probing them; their total size is lower than
+ * the size of the current tables. Other types are read under the lock of the
+ * shard.
+ *
+ * Unlike AtomicMap, the elements are not ordered. K and T must be
+ * default-constructible.
+ */
+template<class K, class T, class Hash = std::hash<K>, unsigned int SHARDS = 16>
+class ConcurrentMap final {
+    static const size_t CACHE_LINE = 64;
+    static const size_t MIN_CAPACITY = 8;
+    // a torn copy of these types can be read and discarded safely
+    static const bool OPTIMISTIC = std::is_trivially_copyable<K>::value && std::is_trivially_copyable<T>::value;
+
+    enum SlotState : uint8_t {
+        EMPTY,
+        FULL,
+        DELETED
+    };
+
+    /** \brief A field of a slot, read under the lock of the shard
+     */
+    template<class U, bool ATOMIC = OPTIMISTIC>
+    class Field {
+    public:
+        Field() : value() {};
+
+        const U& Load() const {
+            return value;
+        }
+
+        U Take() {
+            return std::move(value);
+        }
+
+        template<class V>
+        void Store(V&& v) {
+            value = std::forward<V>(v);
+        }
+
+        template<class F>
+        void Modify(F&& modify) {
+            modify(value);
+        }
+
+    private:
+        U value;
+    };
+
+    /** \brief A field of a slot, read by optimistic readers while it is written
+     *
+     * The value is copied in relaxed atomic words.
+     */
+    template<class U>
+    class Field<U, true> {
+        static const size_t WORDS = (sizeof(U) + sizeof(uintptr_t) - 1) / sizeof(uintptr_t);
+
+    public:
+        Field() {
+            Store(U());
+        };
+
+        U Load() const {
+            uintptr_t copy[WORDS];
+            for (size_t i = 0; i < WORDS; ++i) {
+                copy[i] = words[i].load(std::memory_order_relaxed);
+            }
+            U u;
+            std::memcpy(&u, copy, sizeof(U));
+            return u;
+        }
+
+        U Take() {
+            return Load();
+        }
+
+        void Store(const U& u) {
+            uintptr_t copy[WORDS] = {};
+            std::memcpy(copy, &u, sizeof(U));
+            for (size_t i = 0; i < WORDS; ++i) {
+                words[i].store(copy[i], std::memory_order_relaxed);
+            }
+        }
+
+        template<class F>
+        void Modify(F&& modify) {
+            U u = Load();
+            modify(u);
+            Store(u);
+        }
+
+    private:
+        std::atomic<uintptr_t> words[WORDS];
+    };
+
+    struct Slot {
+        Field<SlotState> state;
+        Field<uint64_t> hash;
+        Field<K> key;
+        Field<T> value;
+    };
+
+    // an element moved to a new table
+    struct Element {
+        Element(uint64_t hash, K&& key, T&& value) : hash(hash), key(std::move(key)), value(std::move(value)) {};
+
+        uint64_t hash;
+        K key;
+        T value;
+    };
+
+    struct Table {
+        explicit Table(size_t capacity) : slots(capacity), mask(capacity - 1), used(0) {};
+
+        std::vector<Slot> slots;
+        const size_t mask;
+        // number of FULL and DELETED slots
+        size_t used;
+    };
+
+    struct Shard {
+        Shard() : table(nullptr), sequence(0), size(0) {
+            tables.emplace_back(new Table(MIN_CAPACITY));
+            table.store(tables.back().get(), std::memory_order_release);
+        };
+
+        std::atomic<Table*> table;
+        // odd while a writer changes the shard
+        std::atomic<unsigned int> sequence;
+        std::atomic<size_t> size;
+        // protects the writers
+        std::mutex mtx;
+        // the current table is the last one
+        std::vector<std::unique_ptr<Table>> tables;
+        char pad[CACHE_LINE];
+    };
+
+    static const size_t NOT_FOUND = ~size_t(0);
+
+public:
+
+    /** \brief Default constructor
+     *
+     */
+    ConcurrentMap() {};
+
+    /** \brief Default destructor
+     *
+     */
+    ~ConcurrentMap() {};
+
+    // disable copy functions
+    ConcurrentMap(ConcurrentMap&) = delete;
+    ConcurrentMap& operator=(ConcurrentMap&) = delete;
+
+    /** \brief Empty the map and return the content
+     *
+     * Each shard is locked in turn, so elements inserted during the call may
+     * or may not be returned. Empty shards are skipped without locking.
+     *
+     * \return std::vector<std::pair<K,T>> the elements, in no particular order
+     *
+     */
+    std::vector<std::pair<K,T>> Poll() const {
+        std::vector<std::pair<K,T>> ret;
+        for (auto& shard : shards) {
+            if (! shard.size.load(std::memory_order_relaxed)) {
+                continue;
+            }
+            std::lock_guard<std::mutex> locker(shard.mtx);
+            auto& table = *shard.tables.back();
+            Write(shard, [&]() {
+                for (auto& slot : table.slots) {
+                    if (slot.state.Load() == FULL) {
+                        ret.emplace_back(slot.key.Take(), slot.value.Take());
+                    }
+                    Reset(slot);
+                }
+                table.used = 0;
+            });
+            shard.size.store(0, std::memory_order_relaxed);
+        }
+        return ret;
+    }
+
+    /** \brief Insert an element, or replace the value of an existing key
+     *
+     * \param key K&& key of the element
+     * \param value T&& value to insert
+     *
+     */
+    template<class L=K,class U=T>
+    void Insert(L&& key, U&& value) const {
+        K k(std::forward<L>(key));
+        const auto hash = HashOf(k);
+        auto& shard = shards[ShardOf(hash)];
+        std::lock_guard<std::mutex> locker(shard.mtx);
+        const auto index = Locate(*shard.tables.back(), hash, k);
+        if (index != NOT_FOUND) {
+            auto& slot = shard.tables.back()->slots[index];
+            Write(shard, [&]() {
+                slot.value.Store(std::forward<U>(value));
+            });
+            return;
+        }
+        Add(shard, hash, std::move(k), std::forward<U>(value));
+    }
+
+    /** \brief Change the value of an element in place
+     *
+     * update is called with a T& under the lock of the shard. Optimistic
+     * readers of the shard wait until it returns: keep it short.
+     *
+     * \param key const K& the key of the element
+     * \param update F&& the function changing the value
+     * \return bool false if there is no element with this key
+     *
+     */
+    template<class F>
+    bool Update(const K& key, F&& update) const {
+        const auto hash = HashOf(key);
+        auto& shard = shards[ShardOf(hash)];
+        std::lock_guard<std::mutex> locker(shard.mtx);
+        const auto index = Locate(*shard.tables.back(), hash, key);
+        if (index == NOT_FOUND) {
+            return false;
+        }
+        auto& slot = shard.tables.back()->slots[index];
+        Write(shard, [&]() {
+            slot.value.Modify(update);
+        });
+        return true;
+    }
+
+    /** \brief Change the value of an element in place, inserting it if needed
+     *
+     * A missing element is default-constructed before update is called.
+     *
+     * \param key const K& the key of the element
+     * \param update F&& the function changing the value
+     * \return bool true if the element was inserted
+     *
+     */
+    template<class F>
+    bool Upsert(const K& key, F&& update) const {
+        const auto hash = HashOf(key);
+        auto& shard = shards[ShardOf(hash)];
+        std::lock_guard<std::mutex> locker(shard.mtx);
+        auto index = Locate(*shard.tables.back(), hash, key);
+        const bool inserted = index == NOT_FOUND;
+        if (inserted) {
+            index = Add(shard, hash, K(key), T());
+        }
+        auto& slot = shard.tables.back()->slots[index];
+        Write(shard, [&]() {
+            slot.value.Modify(update);
+        });
+        return inserted;
+    }
+
+    /** \brief Remove an element
+     *
+     * \param key const K& the key of the element to remove
+     *
+     */
+    void Erase(const K& key) const {
+        T element = T();
+        Pop(key, element);
+    }
+
+    /** \brief Clear the content of the map
+     *
+     */
+    void Clear() const {
+        Poll();
+    }
+
+    /** \brief Remove and get an element
+     *
+     * \param key const K& the key of the element
+     * \param element T& a non-const reference that will contain the element
+     * \return bool true if removed, false otherwise
+     *
+     */
+    bool Pop(const K& key, T& element) const {
+        const auto hash = HashOf(key);
+        auto& shard = shards[ShardOf(hash)];
+        std::lock_guard<std::mutex> locker(shard.mtx);
+        auto& table = *shard.tables.back();
+        const auto index = Locate(table, hash, key);
+        if (index == NOT_FOUND) {
+            return false;
+        }
+        auto& slot = table.slots[index];
+        Write(shard, [&]() {
+            element = slot.value.Take();
+            // the slot stays used to keep the probe sequences of other keys
+            Reset(slot);
+            slot.state.Store(DELETED);
+        });
+        shard.size.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /** \brief Get a copy of an element
+     *
+     * \param key const K& the key of the element
+     * \param element T& a non-const reference that will contain the element
+     * \return bool false if there is no element with this key
+     *
+     */
+    bool Find(const K& key, T& element) const {
+        return Read(key, [&](const T& value) {
+            element = value;
+        });
+    }
+
+    /** \brief Get an element
+     *
+     * \param key const K& the key of the element
+     * \return T the element
+     * \throw std::out_of_range if there is no element with this key
+     *
+     */
+    T At(const K& key) const {
+        T element = T();
+        if (! Find(key, element)) {
+            throw std::out_of_range("ConcurrentMap::At");
+        }
+        return element;
+    }
+
+    /** \brief Get the number of elements having key
+     *
+     * \param key const K& the key
+     * \return size_t the number of elements
+     *
+     */
+    size_t Count(const K& key) const {
+        return Read(key, [](const T&) {}) ? 1 : 0;
+    }
+
+    /** \brief Compare atomically an element with a value
+     *
+     * \param key const K& the key of the element
+     * \param element const T& the value to compare with
+     * \return bool true if equal, false otherwise
+     *
+     */
+    bool Compare(const K& key, const T& element) const {
+        bool equal = false;
+        return Read(key, [&](const T& value) {
+            equal = value == element;
+        }) && equal;
+    }
+
+    /** \brief Get the number of elements without locking
+     *
+     * The value may be outdated when other threads use the map.
+     *
+     * \return size_t the number of elements
+     *
+     */
+    size_t Size() const {
+        size_t size = 0;
+        for (auto& shard : shards) {
+            size += shard.size.load(std::memory_order_relaxed);
+        }
+        return size;
+    }
+
+private:
+
+    static uint64_t HashOf(const K& key) {
+        // spread the bits, std::hash of an integer is the identity
+        uint64_t h = Hash()(key);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    static unsigned int ShardOf(uint64_t hash) {
+        // the low bits choose the slot in the table
+        return static_cast<unsigned int>(hash >> 40) % SHARDS;
+    }
+
+    static void Reset(Slot& slot) {
+        slot.state.Store(EMPTY);
+        slot.key.Store(K());
+        slot.value.Store(T());
+    }
+
+    /** \brief Find the slot of a key
+     *
+     * The probe is bounded by the capacity, so a reader racing with a writer
+     * always terminates.
+     *
+     * \return size_t the index of the slot, NOT_FOUND if the key is missing
+     */
+    static size_t Locate(const Table& table, uint64_t hash, const K& key) {
+        for (size_t i = 0; i <= table.mask; ++i) {
+            const auto index = (hash + i) & table.mask;
+            const auto& slot = table.slots[index];
+            const SlotState state = slot.state.Load();
+            if (state == EMPTY) {
+                return NOT_FOUND;
+            }
+            if (state == FULL && slot.hash.Load() == hash && slot.key.Load() == key) {
+                return index;
+            }
+        }
+        return NOT_FOUND;
+    }
+
+    /** \brief Change a shard between two increments of its sequence number
+     *
+     * The lock of the shard must be held.
+     */
+    template<class F>
+    static void Write(Shard& shard, F&& write) {
+        const auto sequence = shard.sequence.load(std::memory_order_relaxed);
+        shard.sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        write();
+        shard.sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    /** \brief Call read with the value of a key
+     *
+     * With optimistic reads, read may be called several times: only the
+     * last call saw a consistent value.
+     *
+     * \return bool false if there is no element with this key
+     */
+    template<class F>
+    bool Read(const K& key, F&& read) const {
+        const auto hash = HashOf(key);
+        auto& shard = shards[ShardOf(hash)];
+        if (! OPTIMISTIC) {
+            std::lock_guard<std::mutex> locker(shard.mtx);
+            const auto& table = *shard.tables.back();
+            const auto index = Locate(table, hash, key);
+            if (index == NOT_FOUND) {
+                return false;
+            }
+            read(table.slots[index].value.Load());
+            return true;
+        }
+        while (true) {
+            const auto before = shard.sequence.load(std::memory_order_acquire);
+            if (before & 1) {
+                std::this_thread::yield();
+                continue;
+            }
+            const auto& table = *shard.table.load(std::memory_order_acquire);
+            const auto index = Locate(table, hash, key);
+            if (index != NOT_FOUND) {
+                read(table.slots[index].value.Load());
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (shard.sequence.load(std::memory_order_relaxed) == before) {
+                return index != NOT_FOUND;
+            }
+        }
+    }
+
+    /** \brief Insert a key known to be missing
+     *
+     * The lock of the shard must be held.
+     *
+     * \return size_t the index of the new slot
+     */
+    template<class U>
+    size_t Add(Shard& shard, uint64_t hash, K&& key, U&& value) const {
+        auto table = shard.tables.back().get();
+        if ((table->used + 1) * 4 > table->slots.size() * 3) {
+            table = Rehash(shard);
+        }
+        size_t index = hash & table->mask;
+        while (table->slots[index].state.Load() == FULL) {
+            index = (index + 1) & table->mask;
+        }
+        auto& slot = table->slots[index];
+        Write(shard, [&]() {
+            if (slot.state.Load() == EMPTY) {
+                ++table->used;
+            }
+            slot.hash.Store(hash);
+            slot.key.Store(std::move(key));
+            slot.value.Store(std::forward<U>(value));
+            slot.state.Store(FULL);
+        });
+        shard.size.fetch_add(1, std::memory_order_relaxed);
+        return index;
+    }
+
+    /** \brief Make room for one more element
+     *
+     * The table doubles if it is half full, otherwise the deleted slots are
+     * cleaned in place. The lock of the shard must be held.
+     *
+     * \return Table* the current table
+     */
+    Table* Rehash(Shard& shard) const {
+        auto old = shard.tables.back().get();
+        const auto size = shard.size.load(std::memory_order_relaxed);
+        const auto capacity = (size + 1) * 2 > old->slots.size() ? old->slots.size() * 2 : old->slots.size();
+        std::vector<Element> elements;
+        for (auto& slot : old->slots) {
+            if (slot.state.Load() == FULL) {
+                elements.emplace_back(slot.hash.Load(), slot.key.Take(), slot.value.Take());
+            }
+        }
+        auto table = old;
+        if (capacity != old->slots.size()) {
+            shard.tables.emplace_back(new Table(capacity));
+            table = shard.tables.back().get();
+        }
+        Write(shard, [&]() {
+            if (table == old) {
+                for (auto& slot : table->slots) {
+                    Reset(slot);
+                }
+            }
+            table->used = 0;
+            for (auto& element : elements) {
+                size_t index = element.hash & table->mask;
+                while (table->slots[index].state.Load() != EMPTY) {
+                    index = (index + 1) & table->mask;
+                }
+                auto& slot = table->slots[index];
+                slot.hash.Store(element.hash);
+                slot.key.Store(std::move(element.key));
+                slot.value.Store(std::move(element.value));
+                slot.state.Store(FULL);
+                ++table->used;
+            }
+            shard.table.store(table, std::memory_order_relaxed);
+        });
+        if (! OPTIMISTIC && table != old) {
+            // readers take the lock, no one can see the old table
+            shard.tables.erase(shard.tables.begin());
+        }
+        return table;
+    }
+
+    mutable Shard shards[SHARDS];
+};
+}
+
+#endif // CONCURRENTMAP_HPP_INCLUDED
@@ -0,0 +1,325 @@
+#ifndef COROUTINETASK_HPP_INCLUDED
+#define COROUTINETASK_HPP_INCLUDED
+
+#include "trillek-scheduler.hpp"
+#include "task-wait.hpp"
+
+// Coroutines need a C++20 compiler, the rest of the scheduler does not
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define TRILLEK_COROUTINES
+#endif
+#endif
+
+#ifdef TRILLEK_COROUTINES
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include "logging.hpp"
+
+namespace trillek {
+
+/** \brief A coroutine run by the threads of the scheduler
+ *
+ * A coroutine returning CoTask can suspend itself without blocking a thread:
+ *
+ *     CoTask LoadLevel() {
+ *         co_await ParseFiles();              // run another coroutine
+ *         co_await NextFrame();               // resume on the next frame
+ *         co_await Delay(frame_unit(500000)); // resume in 0.5 ms
+ *     }
+ *     scheduler.Spawn(LoadLevel());
+ *
+ * The coroutine does not start before it is spawned or awaited. A spawned
+ * coroutine is destroyed when it returns, an awaited one is destroyed with
+ * its CoTask. Between 2 suspension points, a coroutine may be resumed by any
+ * thread, unless it was spawned with an affinity.
+ */
+class CoTask final {
+public:
+    class promise_type;
+    typedef std::coroutine_handle<promise_type> handle_t;
+
+    /** \brief The state of the coroutine
+     */
+    class promise_type final {
+        friend class CoTask;
+    public:
+        CoTask get_return_object() {
+            return CoTask(handle_t::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+
+        /** \brief Resume the awaiting coroutine, if any
+         *
+         */
+        struct FinalAwaiter {
+            bool await_ready() noexcept {
+                return false;
+            }
+
+            std::coroutine_handle<> await_suspend(handle_t handle) noexcept {
+                auto& promise = handle.promise();
+                if (promise.continuation) {
+                    return promise.continuation;
+                }
+                if (promise.detached) {
+                    handle.destroy();
+                }
+                return std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        FinalAwaiter final_suspend() noexcept {
+            return {};
+        }
+
+        void return_void() {}
+
+        void unhandled_exception() {
+            exception = std::current_exception();
+            if (detached) {
+                LOGMSGC(ERROR) << "Exception thrown by a coroutine spawned on the scheduler";
+            }
+        }
+
+        /** \brief Get the scheduler resuming the coroutine
+         *
+         */
+        TrillekScheduler& Scheduler() const {
+            return *scheduler;
+        }
+
+        int Affinity() const {
+            return affinity;
+        }
+
+    private:
+        TrillekScheduler* scheduler = nullptr;
+        // the coroutine awaiting this one
+        std::coroutine_handle<> continuation;
+        std::exception_ptr exception;
+        int affinity = -1;
+        // destroyed by itself when it returns
+        bool detached = false;
+    };
+
+    /** \brief The task resuming a suspended coroutine
+     */
+    class Resume final : public TaskRequestBase {
+    public:
+        Resume(handle_t handle) :
+            TaskRequestBase(TrillekScheduler::Now()), handle(handle) {
+            SetAffinity(handle.promise().Affinity());
+        };
+
+        Resume(handle_t handle, const frame_unit& delay) :
+            TaskRequestBase(TrillekScheduler::Now() + delay), handle(handle) {
+            SetAffinity(handle.promise().Affinity());
+        };
+
+        void RunTask() override {
+            handle.resume();
+        }
+
+    private:
+        const handle_t handle;
+    };
+
+    CoTask(CoTask&& task) : handle(task.handle) {
+        task.handle = nullptr;
+    }
+
+    CoTask& operator=(CoTask&& task) {
+        std::swap(handle, task.handle);
+        return *this;
+    }
+
+    ~CoTask() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    // disable copy functions
+    CoTask(const CoTask&) = delete;
+    CoTask& operator=(const CoTask&) = delete;
+
+    /** \brief Queue the coroutine and detach it
+     *
+     * Use TrillekScheduler::Spawn().
+     *
+     */
+    void Start(TrillekScheduler& scheduler, int affinity) && {
+        auto& promise = handle.promise();
+        promise.scheduler = &scheduler;
+        promise.affinity = affinity;
+        promise.detached = true;
+        scheduler.Queue(MakeTask<Resume>(std::exchange(handle, nullptr)));
+    }
+
+    /** \brief Tell if the coroutine has returned
+     *
+     */
+    bool Done() const {
+        return ! handle || handle.done();
+    }
+
+    /** \brief Run the coroutine until it returns
+     *
+     * The awaiting coroutine is suspended, and resumed by the same thread
+     * when this one returns. Exceptions are thrown again in the awaiting
+     * coroutine.
+     */
+    struct Awaiter {
+        bool await_ready() noexcept {
+            return ! handle || handle.done();
+        }
+
+        template<class P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> awaiting) noexcept {
+            auto& promise = handle.promise();
+            promise.scheduler = &awaiting.promise().Scheduler();
+            promise.affinity = awaiting.promise().Affinity();
+            promise.continuation = awaiting;
+            return handle;
+        }
+
+        void await_resume() {
+            if (handle && handle.promise().exception) {
+                std::rethrow_exception(handle.promise().exception);
+            }
+        }
+
+        handle_t handle;
+    };
+
+    Awaiter operator co_await() const & noexcept {
+        return Awaiter{handle};
+    }
+
+    Awaiter operator co_await() const && noexcept {
+        return Awaiter{handle};
+    }
+
+private:
+    explicit CoTask(handle_t handle) : handle(handle) {};
+
+    handle_t handle;
+};
+
+/** \brief Suspend the coroutine and queue it again after a delay
+ */
+class Delay final {
+public:
+    /** \brief Constructor
+     *
+     * \param delay const frame_unit& the minimal delay, 0 to let other tasks run first
+     */
+    explicit Delay(const frame_unit& delay) : delay(delay) {};
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    void await_suspend(CoTask::handle_t handle) const {
+        auto& scheduler = handle.promise().Scheduler();
+        if (delay.count() > 0) {
+            scheduler.Queue(MakeTask<CoTask::Resume>(handle, delay));
+        }
+        else {
+            scheduler.Queue(MakeTask<CoTask::Resume>(handle));
+        }
+    }
+
+    void await_resume() const noexcept {}
+
+private:
+    const frame_unit delay;
+};
+
+/** \brief Suspend the coroutine and queue it again at once
+ *
+ */
+inline Delay Requeue() {
+    return Delay(frame_unit(0));
+}
+
+/** \brief Suspend the coroutine for one frame
+ */
+class NextFrame final {
+public:
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    void await_suspend(CoTask::handle_t handle) const {
+        auto& scheduler = handle.promise().Scheduler();
+        scheduler.Queue(MakeTask<CoTask::Resume>(handle, scheduler.FrameDuration()));
+    }
+
+    void await_resume() const noexcept {}
+};
+
+/** \brief Suspend the coroutine until a wait primitive queues it again
+ *
+ * F is called with the scheduler and the task resuming the coroutine.
+ */
+template<class F>
+class Parked final {
+public:
+    explicit Parked(F&& park) : park(std::move(park)) {};
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    void await_suspend(CoTask::handle_t handle) {
+        park(handle.promise().Scheduler(), MakeTask<CoTask::Resume>(handle));
+    }
+
+    void await_resume() const noexcept {}
+
+private:
+    F park;
+};
+
+/** \brief Suspend the coroutine until the counter reaches 0
+ *
+ */
+inline auto WaitFor(TaskCounter& counter) {
+    return Parked([&counter](TrillekScheduler& scheduler, TaskPtr<TaskRequestBase> task) {
+        counter.Wait(scheduler, std::move(task));
+    });
+}
+
+/** \brief Suspend the coroutine until the value of the future is set
+ *
+ */
+template<class T>
+auto WaitFor(const TaskFuture<T>& future) {
+    return Parked([future](TrillekScheduler& scheduler, TaskPtr<TaskRequestBase> task) {
+        future.Wait(scheduler, std::move(task));
+    });
+}
+
+/** \brief Suspend the coroutine until a timepoint is reached
+ *
+ */
+template<class Timepoint>
+auto WaitFor(FrameTrigger<Timepoint>& trigger, Timepoint tp) {
+    return Parked([&trigger, tp](TrillekScheduler& scheduler, TaskPtr<TaskRequestBase> task) {
+        trigger.Wait(tp, scheduler, std::move(task));
+    });
+}
+}
+
+#endif // TRILLEK_COROUTINES
+
+#endif // COROUTINETASK_HPP_INCLUDED
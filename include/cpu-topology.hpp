@@ -0,0 +1,97 @@
+#ifndef CPUTOPOLOGY_HPP_INCLUDED
+#define CPUTOPOLOGY_HPP_INCLUDED
+
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace trillek {
+
+/** \brief A logical CPU and its place in the machine
+ */
+struct CpuInfo {
+    // the index used by the OS
+    unsigned int cpu;
+    // the socket
+    unsigned int package;
+    // the physical core in the package, shared by SMT siblings
+    unsigned int core;
+    // the NUMA node
+    unsigned int node;
+};
+
+/** \brief The logical CPUs available to the process
+ *
+ * On Linux, the topology is read from sysfs and restricted to the affinity
+ * mask of the process. Elsewhere, each logical CPU is reported as a core of
+ * a single node.
+ */
+class CpuTopology final {
+public:
+    /** \brief Constructor
+     *
+     * \param cpus std::vector<CpuInfo>&& the logical CPUs
+     */
+    explicit CpuTopology(std::vector<CpuInfo>&& cpus);
+
+    /** \brief Read the topology of the machine
+     *
+     */
+    static CpuTopology Detect();
+
+    const std::vector<CpuInfo>& Cpus() const {
+        return cpus;
+    }
+
+    unsigned int Packages() const;
+
+    unsigned int Nodes() const;
+
+    unsigned int PhysicalCores() const;
+
+    /** \brief Get the order in which the CPUs receive the workers
+     *
+     * The nodes are filled one after the other. In a node, each physical
+     * core gets a worker before the SMT siblings do: workers sharing a node
+     * share its caches, and a worker only shares a core when all cores are
+     * taken.
+     *
+     * \return std::vector<CpuInfo> the CPUs
+     */
+    std::vector<CpuInfo> PlacementOrder() const;
+
+    /** \brief Describe the topology in a few lines
+     *
+     */
+    std::string Report() const;
+
+    /** \brief Restrict a thread to a logical CPU
+     *
+     * \param thread std::thread& the thread
+     * \param cpu unsigned int the index of the CPU
+     * \return bool false if the OS refused it or if it is not supported
+     */
+    static bool Pin(std::thread& thread, unsigned int cpu);
+
+    /** \brief Parse a list of CPUs as written by Linux, e.g. "0-3,8,10-11"
+     *
+     */
+    static std::vector<unsigned int> ParseCpuList(const std::string& list);
+
+private:
+    std::vector<CpuInfo> cpus;
+};
+
+/** \brief Get the workers a worker steals from, in order
+ *
+ * The workers of the same node come first, then the other ones. In each
+ * group, the order starts after the worker to spread the thieves.
+ *
+ * \param id unsigned int the index of the worker
+ * \param nodes const std::vector<unsigned int>& the node of each worker
+ * \return std::vector<unsigned int> the other workers
+ */
+std::vector<unsigned int> StealOrder(unsigned int id, const std::vector<unsigned int>& nodes);
+}
+
+#endif // CPUTOPOLOGY_HPP_INCLUDED
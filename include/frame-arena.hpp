@@ -0,0 +1,265 @@
+#ifndef FRAMEARENA_HPP_INCLUDED
+#define FRAMEARENA_HPP_INCLUDED
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace trillek {
+
+/** \brief A linear allocator for the temporaries of a frame
+ *
+ * Memory is taken from blocks by moving an offset forward, and is given back
+ * all at once by moving the offset back to a mark. Blocks are kept when the
+ * arena is rewound: once the arena has grown to the needs of a frame, the
+ * following frames do not call the heap allocator.
+ *
+ * Each thread has its own arena, returned by Local(). The scheduler opens a
+ * FrameScope on the arena of the thread running a system frame: memory taken
+ * during HandleEvents() and RunBatch() is valid until the frame ends. Memory
+ * taken outside a frame is valid until the next frame starts on the thread.
+ *
+ * The arena is not thread-safe. A container using it must not outlive the
+ * frame, nor be given to another thread.
+ */
+class FrameArena final {
+public:
+    static const size_t BLOCK_SIZE = 64 * 1024;
+
+    /** \brief A position in the arena
+     */
+    struct Marker {
+        size_t block;
+        size_t offset;
+    };
+
+    /** \brief Constructor
+     *
+     * \param block_size size_t the size of the blocks taken from the heap
+     */
+    explicit FrameArena(size_t block_size = BLOCK_SIZE) : block_size(block_size), current(0), offset(0),
+                                                        consumed(0), high_water(0), depth(0) {};
+
+    ~FrameArena() {};
+
+    // disable copy functions
+    FrameArena(FrameArena&) = delete;
+    FrameArena& operator=(FrameArena&) = delete;
+
+    /** \brief Get the arena of the calling thread
+     *
+     */
+    static FrameArena& Local();
+
+    /** \brief Take memory from the arena
+     *
+     * \param size size_t the number of bytes
+     * \param alignment size_t the alignment, a power of 2
+     * \return void* the memory
+     */
+    void* Allocate(size_t size, size_t alignment);
+
+    /** \brief Give back memory
+     *
+     * Only the last allocation is reclaimed, e.g. a vector freeing the
+     * buffer it just took. Other memory is reclaimed when the arena rewinds.
+     *
+     * \param p void* the memory
+     * \param size size_t the number of bytes
+     */
+    void Deallocate(void* p, size_t size);
+
+    /** \brief Get the current position
+     *
+     */
+    Marker Mark() const {
+        Marker marker = {current, offset};
+        return marker;
+    }
+
+    /** \brief Give back all memory taken since a position
+     *
+     * \param marker const Marker& a position returned by Mark()
+     */
+    void Rewind(const Marker& marker);
+
+    /** \brief Give back all memory
+     *
+     */
+    void Reset();
+
+    /** \brief Get the number of bytes taken since the last reset
+     *
+     */
+    size_t Used() const {
+        return consumed + offset;
+    }
+
+    /** \brief Get the number of bytes taken from the heap
+     *
+     */
+    size_t Capacity() const;
+
+    /** \brief Get the max number of bytes used at a time
+     *
+     */
+    size_t HighWater() const {
+        return high_water;
+    }
+
+private:
+    friend class FrameScope;
+
+    struct Block {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    const size_t block_size;
+    std::vector<Block> blocks;
+    // index of the block in use
+    size_t current;
+    // position in the block in use
+    size_t offset;
+    // size of the blocks before the block in use
+    size_t consumed;
+    size_t high_water;
+    // number of open FrameScope
+    unsigned int depth;
+};
+
+/** \brief Rewind an arena at the end of a frame
+ *
+ * When no other scope is open, the arena is reset first: the memory taken
+ * outside any frame since the previous frame is given back.
+ *
+ *     {
+ *         FrameScope frame(FrameArena::Local());
+ *         std::vector<glm::mat4, FrameAllocator<glm::mat4>> matrices(joints);
+ *         ...
+ *     } // matrices must be gone here
+ */
+class FrameScope final {
+public:
+    explicit FrameScope(FrameArena& arena) : arena(arena) {
+        if (! arena.depth) {
+            arena.Reset();
+        }
+        ++arena.depth;
+        marker = arena.Mark();
+    };
+
+    ~FrameScope() {
+        arena.Rewind(marker);
+        --arena.depth;
+    };
+
+    // disable copy functions
+    FrameScope(FrameScope&) = delete;
+    FrameScope& operator=(FrameScope&) = delete;
+
+private:
+    FrameArena& arena;
+    FrameArena::Marker marker;
+};
+
+/** \brief An allocator taking memory from a FrameArena
+ *
+ * It has the interface of TrillekAllocator. The allocator keeps the arena
+ * of the thread creating it, deallocate() does not free memory.
+ */
+template<typename T>
+class FrameAllocator {
+public:
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef T value_type;
+
+    /// Default constructor, uses the arena of the thread
+    FrameAllocator() throw() : arena(&FrameArena::Local()) { }
+    /// Constructor with an arena
+    explicit FrameAllocator(FrameArena& arena) throw() : arena(&arena) { }
+    /// Copy constructor
+    FrameAllocator(const FrameAllocator& other) throw() : arena(other.arena) { }
+    /// Copy constructor with another type
+    template<typename U>
+    FrameAllocator(const FrameAllocator<U>& other) throw() : arena(other.arena) { }
+
+    /// Destructor
+    ~FrameAllocator() { }
+
+    /// Copy
+    FrameAllocator<T>& operator=(const FrameAllocator& other) {
+        arena = other.arena;
+        return *this;
+    }
+
+    bool operator==(const FrameAllocator& rhs) const {
+        return arena == rhs.arena;
+    }
+
+    bool operator!=(const FrameAllocator& rhs) const {
+        return arena != rhs.arena;
+    }
+
+    /// Get address of reference
+    pointer address(reference x) const {
+        return &x;
+    }
+    /// Get const address of const reference
+    const_pointer address(const_reference x) const {
+        return &x;
+    }
+
+    /// Allocate memory
+    pointer allocate(size_type n, const void* = 0) {
+        return static_cast<pointer>(arena->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    /// Deallocate memory
+    void deallocate(void* p, size_type n) {
+        arena->Deallocate(p, n * sizeof(T));
+    }
+
+    /// Call constructor with arguments
+    template<typename U, typename... Args>
+    void construct(U* p, Args&&... args) {
+        // Placement new
+        ::new((void*)p) U(std::forward<Args>(args)...);
+    }
+
+    /// Call the destructor of p of type U
+    template<typename U>
+    void destroy(U* p) {
+        p->~U();
+    }
+
+    /// Get the max allocation size
+    size_type max_size() const {
+        return size_type(-1) / sizeof(T);
+    }
+
+    /// A struct to rebind the allocator to another allocator of type U
+    template<typename U>
+    struct rebind {
+        typedef FrameAllocator<U> other;
+    };
+
+private:
+    template<typename U>
+    friend class FrameAllocator;
+
+    FrameArena* arena;
+};
+
+// type of a vector living in a frame
+template<class U>
+using frame_vector = std::vector<U, FrameAllocator<U>>;
+}
+
+#endif // FRAMEARENA_HPP_INCLUDED
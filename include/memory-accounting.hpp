@@ -0,0 +1,123 @@
+#ifndef MEMORYACCOUNTING_HPP_INCLUDED
+#define MEMORYACCOUNTING_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace trillek {
+
+// the index of a category of allocations, given by MemoryAccounting::Tag()
+typedef unsigned int MemoryTag;
+
+/** \brief The allocations of a tag
+ */
+struct MemoryTagStats {
+    MemoryTag tag;
+    std::string name;
+    // bytes allocated and not freed yet
+    int64_t current_bytes;
+    // max of current_bytes
+    int64_t high_water_bytes;
+    uint64_t allocations;
+    uint64_t deallocations;
+};
+
+/** \brief Thread-safe accounting of the memory taken by TrillekAllocator
+ *
+ * Each allocation is charged to a tag: a component type, a resource type, a
+ * system... Each thread counts in its own counters and publishes them to the
+ * global counters when the pending bytes of a tag exceed FLUSH_BYTES, or when
+ * the thread terminates. The high-water mark is updated when the counters are
+ * published or queried, so it can miss a peak shorter than FLUSH_BYTES per
+ * thread.
+ *
+ * Queries sum the global counters and the pending counters of all threads.
+ * While other threads allocate, a query can be off by one publication.
+ */
+class MemoryAccounting final {
+public:
+    // the tag of the allocations made outside any MemoryTagScope
+    static const MemoryTag GENERAL = 0;
+    static const unsigned int MAX_TAGS = 256;
+    static const int64_t FLUSH_BYTES = 64 * 1024;
+
+    /** \brief Get the tag of a name, registering it if needed
+     *
+     * Names beyond MAX_TAGS share the GENERAL tag.
+     *
+     * \param name const std::string& the name of the tag
+     * \return MemoryTag the tag
+     */
+    static MemoryTag Tag(const std::string& name);
+
+    /** \brief Count an allocation
+     *
+     */
+    static void Allocated(MemoryTag tag, size_t bytes);
+
+    /** \brief Count a deallocation
+     *
+     */
+    static void Freed(MemoryTag tag, size_t bytes);
+
+    /** \brief Get the tag of the calling thread, set by MemoryTagScope
+     *
+     */
+    static MemoryTag CurrentTag();
+
+    /** \brief Get the allocations of a tag
+     *
+     */
+    static MemoryTagStats Query(MemoryTag tag);
+
+    /** \brief Get the allocations of all tags having allocated something
+     *
+     */
+    static std::vector<MemoryTagStats> Snapshot();
+
+    /** \brief Describe the tags in a table, the largest first
+     *
+     */
+    static std::string Report();
+
+    /** \brief Publish the pending counters of the calling thread
+     *
+     */
+    static void Flush();
+
+private:
+    friend class MemoryTagScope;
+
+    static MemoryTag SetCurrentTag(MemoryTag tag);
+};
+
+/** \brief Charge the allocations of a scope to a tag
+ *
+ * Containers keep the tag of the scope in which their allocator was built:
+ * a container built in a scope is charged to its tag for its whole life.
+ *
+ *     {
+ *         MemoryTagScope scope(MemoryAccounting::Tag("resource md5anim"));
+ *         ...
+ *     }
+ */
+class MemoryTagScope final {
+public:
+    explicit MemoryTagScope(MemoryTag tag) : previous(MemoryAccounting::SetCurrentTag(tag)) {};
+
+    ~MemoryTagScope() {
+        MemoryAccounting::SetCurrentTag(previous);
+    };
+
+    // disable copy functions
+    MemoryTagScope(MemoryTagScope&) = delete;
+    MemoryTagScope& operator=(MemoryTagScope&) = delete;
+
+private:
+    const MemoryTag previous;
+};
+}
+
+#endif // MEMORYACCOUNTING_HPP_INCLUDED
@@ -0,0 +1,77 @@
+#ifndef NODEPOOL_HPP_INCLUDED
+#define NODEPOOL_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+
+namespace trillek {
+
+/** \brief Counters of the memory taken from the heap by the node pool
+ */
+struct NodePoolCounters {
+    // calls to the heap allocator, one per chunk of blocks
+    uint64_t heap_allocations;
+    // bytes taken from the heap
+    uint64_t heap_bytes;
+};
+
+/** \brief A block allocator for the small objects of the containers
+ *
+ * It serves TrillekAllocator: map and list nodes, component containers made
+ * by allocate_shared, small vectors. Blocks have 16 size classes from 16 to
+ * 256 bytes, in steps of 16 bytes, so a node wastes less than 16 bytes.
+ *
+ * As in TaskPool, the blocks are kept in the free lists of a SizeClassPool.
+ */
+class NodePool final {
+public:
+    static const size_t SIZE_CLASSES = 16;
+    static const size_t ALIGNMENT = 16;
+    static const size_t MAX_BLOCK = ALIGNMENT * SIZE_CLASSES;
+    // blocks allocated at once, and moved at once between threads
+    static const size_t CHUNK_BLOCKS = 128;
+    // blocks of a size class a thread can keep
+    static const size_t CACHE_BLOCKS = 4 * CHUNK_BLOCKS;
+
+    static size_t BlockSize(size_t size_class) {
+        return (size_class + 1) * ALIGNMENT;
+    }
+
+    /** \brief Tell if a size is served by the pool
+     *
+     */
+    static bool Pooled(size_t size, size_t alignment) {
+        return size <= MAX_BLOCK && alignment <= ALIGNMENT;
+    }
+
+    /** \brief Get a block
+     *
+     * \param size size_t the size of the block, at most MAX_BLOCK
+     * \return void* the block, aligned on ALIGNMENT
+     */
+    static void* Allocate(size_t size);
+
+    /** \brief Give back a block
+     *
+     * The block can be released by any thread.
+     *
+     * \param block void* the block
+     * \param size size_t the size passed to Allocate()
+     */
+    static void Deallocate(void* block, size_t size);
+
+    /** \brief Give all blocks kept by the calling thread to the shared lists
+     *
+     * Call it when a thread stops allocating for a while, e.g. after a
+     * system released a whole container: other threads can reuse the blocks.
+     */
+    static void ReleaseThreadCache();
+
+    /** \brief Get the counters of the heap allocations
+     *
+     */
+    static NodePoolCounters Counters();
+};
+}
+
+#endif // NODEPOOL_HPP_INCLUDED
@@ -0,0 +1,157 @@
+#ifndef SCHEDULERCLOCK_HPP_INCLUDED
+#define SCHEDULERCLOCK_HPP_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+namespace trillek {
+
+typedef std::chrono::nanoseconds frame_unit;
+#if defined(_MSC_VER)
+// Visual Studio implements steady_clock as system_clock
+// TODO : wait for the fix from Microsoft
+typedef std::chrono::time_point<std::chrono::system_clock, frame_unit> scheduler_tp;
+#else
+typedef std::chrono::time_point<std::chrono::steady_clock, frame_unit> scheduler_tp;
+#endif
+
+/** \brief The time source of the scheduler
+ *
+ * The clock gives the time to the tasks and puts the idle threads to sleep
+ * until the next timepoint.
+ */
+class SchedulerClock {
+public:
+    virtual ~SchedulerClock() {};
+
+    /** \brief Get the current time
+     *
+     */
+    virtual scheduler_tp Now() const = 0;
+
+    /** \brief Block an idle thread until a timepoint or until it is notified
+     *
+     * Called with the lock of the scheduler held, the same lock for all threads.
+     * It may return earlier: the thread looks for tasks and sleeps again.
+     *
+     * \param cv std::condition_variable& the condition notified when a task is queued
+     * \param lock std::unique_lock<std::mutex>& the lock of the scheduler
+     * \param tp const scheduler_tp& the time when the thread has something to do
+     */
+    virtual void WaitUntil(std::condition_variable& cv, std::unique_lock<std::mutex>& lock,
+                            const scheduler_tp& tp) = 0;
+
+    /** \brief Called by the scheduler when it launches its threads
+     *
+     * \param threads unsigned int the number of threads
+     * \param wake std::function<void()>&& a function waking all idle threads,
+     * it locks the lock of the scheduler
+     */
+    virtual void Attach(unsigned int /*threads*/, std::function<void()>&& /*wake*/) {};
+
+    /** \brief Called by the scheduler when its threads have terminated
+     *
+     */
+    virtual void Detach() {};
+};
+
+/** \brief The wall time, the default clock
+ */
+class RealClock final : public SchedulerClock {
+public:
+    scheduler_tp Now() const override;
+
+    void WaitUntil(std::condition_variable& cv, std::unique_lock<std::mutex>& lock,
+                    const scheduler_tp& tp) override {
+        cv.wait_until(lock, tp);
+    }
+};
+
+/** \brief A time moved forward by a driver
+ *
+ * The time does not change while the tasks run: a run only depends on the
+ * steps of the driver, e.g. to replay a session or to repeat a benchmark.
+ *
+ *     VirtualClock clock;
+ *     TrillekScheduler::SetClock(&clock);
+ *     // in the thread driving the game
+ *     clock.Advance(frame_unit(16666666));
+ */
+class VirtualClock : public SchedulerClock {
+public:
+    /** \brief Constructor
+     *
+     * \param start const scheduler_tp& the initial time
+     */
+    explicit VirtualClock(const scheduler_tp& start = scheduler_tp()) : now(start.time_since_epoch().count()) {};
+
+    scheduler_tp Now() const override {
+        return scheduler_tp(frame_unit(now.load(std::memory_order_acquire)));
+    }
+
+    void WaitUntil(std::condition_variable& cv, std::unique_lock<std::mutex>& lock,
+                    const scheduler_tp& tp) override;
+
+    void Attach(unsigned int threads, std::function<void()>&& wake) override;
+
+    void Detach() override;
+
+    /** \brief Move the time forward and wake up the threads
+     *
+     * \param delta const frame_unit& the duration to add
+     */
+    void Advance(const frame_unit& delta);
+
+protected:
+    /** \brief Move the time forward without waking up the threads
+     *
+     * \return bool true if the time changed
+     */
+    bool SetNow(const scheduler_tp& tp);
+
+    void Wake();
+
+private:
+    std::atomic<int64_t> now;
+    std::mutex m_wake;
+    std::function<void()> wake;
+};
+
+/** \brief A virtual time jumping to the next timepoint when all threads are idle
+ *
+ * Frames and delayed tasks run as fast as the threads can run them, in the
+ * same order as with the real time. Use it to simulate hours of frames in
+ * seconds.
+ *
+ * Only the runs driven by the threads of the scheduler are supported: the
+ * time jumps as soon as all these threads are idle, even if a thread outside
+ * the scheduler is about to queue a task, which then runs late. Queue the
+ * initial tasks before Initialize() or from the systems, or use VirtualClock
+ * when other threads feed the scheduler.
+ */
+class FastClock final : public VirtualClock {
+public:
+    explicit FastClock(const scheduler_tp& start = scheduler_tp()) : VirtualClock(start),
+        threads(0), idle(0), earliest((scheduler_tp::max)()), generation(0) {};
+
+    void WaitUntil(std::condition_variable& cv, std::unique_lock<std::mutex>& lock,
+                    const scheduler_tp& tp) override;
+
+    void Attach(unsigned int threads, std::function<void()>&& wake) override;
+
+private:
+    // the members are protected by the lock of the scheduler
+    unsigned int threads;
+    unsigned int idle;
+    // the earliest timepoint waited by the idle threads
+    scheduler_tp earliest;
+    // incremented when the time jumps
+    uint64_t generation;
+};
+}
+
+#endif // SCHEDULERCLOCK_HPP_INCLUDED
@@ -0,0 +1,352 @@
+#ifndef SCHEDULERTELEMETRY_HPP_INCLUDED
+#define SCHEDULERTELEMETRY_HPP_INCLUDED
+
+// Define TRILLEK_TELEMETRY to record the telemetry of the scheduler.
+// Without it, the hooks are removed by the preprocessor and cost nothing.
+#ifdef TRILLEK_TELEMETRY
+#define SCHEDULER_TELEMETRY(...) __VA_ARGS__
+#else
+#define SCHEDULER_TELEMETRY(...)
+#endif
+
+#include <string>
+
+namespace trillek {
+
+/** \brief Get a readable name from a mangled type name
+ *
+ */
+std::string DemangleTypeName(const char* name);
+}
+
+#ifdef TRILLEK_TELEMETRY
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+#include "util/utiltype.hpp"
+
+namespace trillek {
+
+/** \brief A histogram of durations in nanoseconds
+ *
+ * Bucket 0 counts the null durations, bucket i counts the durations in
+ * [2^(i-1), 2^i) ns. The last bucket counts all longer durations.
+ */
+class DurationHistogram final {
+public:
+    static const unsigned int BUCKETS = 40;
+
+    DurationHistogram() : buckets(), count(0), total(0), max(0) {};
+
+    static unsigned int Bucket(uint64_t ns) {
+        if (! ns) {
+            return 0;
+        }
+        const auto b = 64 - util::Clz<uint64_t>(ns);
+        return b < BUCKETS ? b : BUCKETS - 1;
+    }
+
+    void Add(uint64_t ns) {
+        ++buckets[Bucket(ns)];
+        ++count;
+        total += ns;
+        max = ns > max ? ns : max;
+    }
+
+    void Merge(const DurationHistogram& h);
+
+    /** \brief Get an upper bound of a percentile
+     *
+     * \param p double the percentile, from 0 to 1
+     * \return uint64_t the upper bound of the bucket holding the percentile
+     */
+    uint64_t Percentile(double p) const;
+
+    uint64_t Count() const {
+        return count;
+    }
+
+    uint64_t Total() const {
+        return total;
+    }
+
+    uint64_t Max() const {
+        return max;
+    }
+
+    uint64_t Mean() const {
+        return count ? total / count : 0;
+    }
+
+    uint64_t BucketCount(unsigned int b) const {
+        return buckets[b];
+    }
+
+private:
+    friend class AtomicHistogram;
+
+    uint64_t buckets[BUCKETS];
+    uint64_t count;
+    uint64_t total;
+    uint64_t max;
+};
+
+/** \brief Add to a counter that has only one writer
+ *
+ * A relaxed load and store are plain moves: the owner does not pay for an
+ * atomic increment, and other threads can read the counter at any time.
+ */
+inline void TelemetryAdd(std::atomic<uint64_t>& c, uint64_t n) {
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+/** \brief A DurationHistogram filled by one thread and read by the others
+ */
+class AtomicHistogram final {
+public:
+    AtomicHistogram() : count(0), total(0), max(0) {
+        for (auto& b : buckets) {
+            b.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void Add(uint64_t ns) {
+        TelemetryAdd(buckets[DurationHistogram::Bucket(ns)], 1);
+        TelemetryAdd(count, 1);
+        TelemetryAdd(total, ns);
+        if (ns > max.load(std::memory_order_relaxed)) {
+            max.store(ns, std::memory_order_relaxed);
+        }
+    }
+
+    DurationHistogram Snapshot() const;
+
+private:
+    std::atomic<uint64_t> buckets[DurationHistogram::BUCKETS];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> max;
+};
+
+/** \brief A span of the Chrome trace
+ */
+struct TraceEvent {
+    // a mangled type name, or any string with static storage
+    const char* name;
+    const char* category;
+    // nanoseconds on the clock of the scheduler
+    int64_t start;
+    uint64_t duration;
+};
+
+/** \brief The latencies of a type of task
+ */
+struct TaskTypeTelemetry {
+    // from the timepoint of the task to its start
+    AtomicHistogram wait;
+    AtomicHistogram run;
+};
+
+/** \brief The telemetry of a thread of the scheduler
+ *
+ * Only the thread owning it records anything, without lock. The other
+ * threads read it while it is recorded.
+ *
+ * The latencies of the task types are kept in a table of TYPE_SLOTS slots
+ * allocated with the telemetry, so that recording a new type does not
+ * allocate. The types beyond the capacity share an overflow slot, reported
+ * as OTHER_TYPES.
+ */
+class WorkerTelemetry final {
+public:
+    static const size_t TYPE_SLOTS = 64;
+    static const char* const OTHER_TYPES;
+
+    WorkerTelemetry() : started(0), busy(0), sleep(0), tasks(0), steals(0), failed_steals(0),
+        sleeps(0), admission_rejections(0), last_type(nullptr), last_stats(nullptr),
+        tracing(false), trace_next(0) {
+        for (auto& slot : types) {
+            slot.type.store(nullptr, std::memory_order_relaxed);
+        }
+    };
+
+    void Start(int64_t now) {
+        started.store(now, std::memory_order_relaxed);
+    }
+
+    /** \brief Record a task
+     *
+     * \param type const std::type_info& the dynamic type of the task
+     * \param ready int64_t the timepoint of the task
+     * \param start int64_t the time when the task started
+     * \param end int64_t the time when the task ended
+     */
+    void RecordTask(const std::type_info& type, int64_t ready, int64_t start, int64_t end) {
+        if (&type != last_type) {
+            last_stats = &TypeStats(type);
+            last_type = &type;
+        }
+        const uint64_t run = end > start ? end - start : 0;
+        last_stats->wait.Add(start > ready ? start - ready : 0);
+        last_stats->run.Add(run);
+        TelemetryAdd(busy, run);
+        TelemetryAdd(tasks, 1);
+        Trace(type.name(), "task", start, run);
+    }
+
+    void RecordSleep(uint64_t ns) {
+        TelemetryAdd(sleep, ns);
+        TelemetryAdd(sleeps, 1);
+    }
+
+    void RecordSteal(bool success) {
+        TelemetryAdd(success ? steals : failed_steals, 1);
+    }
+
+    /** \brief Record a task taken from a lane filled by another thread meanwhile
+     *
+     */
+    void RecordAdmissionRejected() {
+        TelemetryAdd(admission_rejections, 1);
+    }
+
+    /** \brief Add a span to the trace if it is recorded
+     *
+     */
+    void Trace(const char* name, const char* category, int64_t start, uint64_t duration) {
+        if (tracing.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> locker(m_trace);
+            if (! trace.empty()) {
+                TraceEvent e = {name, category, start, duration};
+                trace[trace_next++ % trace.size()] = e;
+            }
+        }
+    }
+
+    /** \brief Record the spans of the trace
+     *
+     * \param capacity size_t the number of spans kept, the oldest ones are
+     * overwritten. 0 stops the trace.
+     */
+    void SetTrace(size_t capacity);
+
+    /** \brief Get the spans of the trace, oldest first
+     *
+     */
+    std::vector<TraceEvent> TraceEvents() const;
+
+    /** \brief Add the latencies of each type of task
+     *
+     * \param types the histograms of wait and run time by mangled type name
+     */
+    void MergeTypes(std::unordered_map<std::string,std::pair<DurationHistogram,DurationHistogram>>& types) const;
+
+    // time when the thread started, in nanoseconds
+    std::atomic<int64_t> started;
+    // time spent running tasks
+    std::atomic<uint64_t> busy;
+    // time spent sleeping
+    std::atomic<uint64_t> sleep;
+    std::atomic<uint64_t> tasks;
+    std::atomic<uint64_t> steals;
+    std::atomic<uint64_t> failed_steals;
+    std::atomic<uint64_t> sleeps;
+    // tasks put back because their lane was full
+    std::atomic<uint64_t> admission_rejections;
+
+private:
+    TaskTypeTelemetry& TypeStats(const std::type_info& type);
+
+    struct TypeSlot {
+        // set once by the owner, nullptr while the slot is free
+        std::atomic<const std::type_info*> type;
+        TaskTypeTelemetry stats;
+    };
+
+    // open addressing on the address of the type
+    TypeSlot types[TYPE_SLOTS];
+    TaskTypeTelemetry other_types;
+    // consecutive tasks are often of the same type
+    const std::type_info* last_type;
+    TaskTypeTelemetry* last_stats;
+
+    std::atomic<bool> tracing;
+    mutable std::mutex m_trace;
+    std::vector<TraceEvent> trace;
+    size_t trace_next;
+};
+
+/** \brief The frame times of a system
+ *
+ * Only the thread running the frame records it.
+ */
+struct SystemTelemetry {
+    SystemTelemetry() : overruns(0), skipped(0) {};
+
+    AtomicHistogram frame;
+    std::atomic<uint64_t> overruns;
+    std::atomic<uint64_t> skipped;
+};
+
+/** \brief A snapshot of the telemetry of the scheduler
+ */
+struct TelemetryReport {
+    struct Worker {
+        // time since the thread started
+        uint64_t elapsed;
+        uint64_t busy;
+        uint64_t sleep;
+        uint64_t tasks;
+        uint64_t steals;
+        uint64_t failed_steals;
+        uint64_t sleeps;
+        uint64_t admission_rejections;
+
+        /** \brief Get the part of the time spent running tasks
+         *
+         */
+        double Utilisation() const {
+            return elapsed ? static_cast<double>(busy) / elapsed : 0.0;
+        }
+    };
+
+    struct TaskType {
+        // demangled when the compiler allows it
+        std::string name;
+        DurationHistogram wait;
+        DurationHistogram run;
+    };
+
+    struct System {
+        std::string name;
+        DurationHistogram frame;
+        uint64_t overruns;
+        uint64_t skipped;
+    };
+
+    std::vector<Worker> workers;
+    std::vector<TaskType> task_types;
+    std::vector<System> systems;
+};
+
+/** \brief Write spans as Chrome trace-event JSON
+ *
+ * The output can be loaded in chrome://tracing or Perfetto.
+ *
+ * \param out std::ostream& the stream
+ * \param threads const std::vector<std::vector<TraceEvent>>& the spans of each thread
+ * \param origin int64_t the time written as 0
+ */
+void WriteTraceEvents(std::ostream& out, const std::vector<std::vector<TraceEvent>>& threads, int64_t origin);
+}
+
+#endif // TRILLEK_TELEMETRY
+
+#endif // SCHEDULERTELEMETRY_HPP_INCLUDED
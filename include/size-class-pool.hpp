@@ -0,0 +1,214 @@
+#ifndef SIZECLASSPOOL_HPP_INCLUDED
+#define SIZECLASSPOOL_HPP_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+
+namespace trillek {
+
+/** \brief The free lists shared by TaskPool and NodePool
+ *
+ * Each thread keeps a free list per size class, and gives blocks back to a
+ * shared list when it holds more than CACHE_BLOCKS of them. Blocks are moved
+ * by batches of CHUNK_BLOCKS, taken from the heap by chunks, and chunks are
+ * never returned.
+ *
+ * P gives the layout of the pool: SIZE_CLASSES, CHUNK_BLOCKS, CACHE_BLOCKS
+ * and BlockSize(size_class). Each P has its own lists and thread caches.
+ *
+ * Blocks can be allocated and released by the destructors of static and
+ * thread_local objects: once the cache of a thread is destroyed, the thread
+ * uses the shared lists.
+ */
+template<class P>
+class SizeClassPool final {
+public:
+    /** \brief Get a block
+     *
+     * \param size_class size_t the size class of the block
+     * \return void* the block
+     */
+    static void* Allocate(size_t size_class) {
+        if (! cache.alive) {
+            std::lock_guard<std::mutex> locker(m_shared);
+            auto& shared = shared_lists[size_class];
+            if (! shared.head) {
+                AllocateChunk(shared, size_class);
+            }
+            return shared.Pop();
+        }
+        auto& list = cache.lists[size_class];
+        if (! list.head) {
+            {
+                std::lock_guard<std::mutex> locker(m_shared);
+                MoveBlocks(shared_lists[size_class], list, P::CHUNK_BLOCKS);
+            }
+            if (! list.head) {
+                AllocateChunk(list, size_class);
+            }
+        }
+        return list.Pop();
+    }
+
+    /** \brief Give back a block
+     *
+     * The block can be released by any thread.
+     *
+     * \param block void* the block
+     * \param size_class size_t the size class passed to Allocate()
+     */
+    static void Deallocate(void* block, size_t size_class) {
+        if (! cache.alive) {
+            std::lock_guard<std::mutex> locker(m_shared);
+            shared_lists[size_class].Push(static_cast<FreeBlock*>(block));
+            return;
+        }
+        auto& list = cache.lists[size_class];
+        list.Push(static_cast<FreeBlock*>(block));
+        if (list.count > P::CACHE_BLOCKS) {
+            // the thread frees more than it allocates
+            std::lock_guard<std::mutex> locker(m_shared);
+            MoveBlocks(list, shared_lists[size_class], P::CHUNK_BLOCKS);
+        }
+    }
+
+    /** \brief Put blocks in the shared lists before they are needed
+     *
+     * \param size_class size_t the size class of the blocks
+     * \param blocks size_t the minimal number of blocks to add
+     */
+    static void Reserve(size_t size_class, size_t blocks) {
+        FreeList reserved;
+        while (reserved.count < blocks) {
+            AllocateChunk(reserved, size_class);
+        }
+        std::lock_guard<std::mutex> locker(m_shared);
+        MoveBlocks(reserved, shared_lists[size_class], reserved.count);
+    }
+
+    /** \brief Give all blocks kept by the calling thread to the shared lists
+     *
+     */
+    static void ReleaseThreadCache() {
+        if (cache.alive) {
+            cache.Release();
+        }
+    }
+
+    /** \brief Count an allocation made from the heap outside the size classes
+     *
+     */
+    static void CountHeap(size_t bytes) {
+        heap_allocations.fetch_add(1, std::memory_order_relaxed);
+        heap_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    // calls to the heap allocator
+    static uint64_t HeapAllocations() {
+        return heap_allocations.load(std::memory_order_relaxed);
+    }
+
+    // bytes taken from the heap
+    static uint64_t HeapBytes() {
+        return heap_bytes.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    struct FreeList {
+        // constant initialization, the lists may be used by static destructors
+        constexpr FreeList() : head(nullptr), count(0) {};
+
+        void Push(FreeBlock* block) {
+            block->next = head;
+            head = block;
+            ++count;
+        }
+
+        FreeBlock* Pop() {
+            auto block = head;
+            head = block->next;
+            --count;
+            return block;
+        }
+
+        FreeBlock* head;
+        size_t count;
+    };
+
+    /** \brief The free lists of a thread
+     *
+     * The blocks go back to the shared lists when the thread terminates.
+     */
+    struct ThreadCache {
+        ThreadCache() : alive(true) {};
+
+        ~ThreadCache() {
+            alive = false;
+            Release();
+        }
+
+        void Release() {
+            std::lock_guard<std::mutex> locker(m_shared);
+            for (size_t c = 0; c < P::SIZE_CLASSES; ++c) {
+                MoveBlocks(lists[c], shared_lists[c], lists[c].count);
+            }
+        }
+
+        FreeList lists[P::SIZE_CLASSES];
+        // false once destroyed, for the blocks used at exit
+        bool alive;
+    };
+
+    /** \brief Move up to n blocks from a list to another
+     *
+     */
+    static void MoveBlocks(FreeList& from, FreeList& to, size_t n) {
+        while (n-- && from.head) {
+            to.Push(from.Pop());
+        }
+    }
+
+    /** \brief Split a new chunk in blocks
+     *
+     */
+    static void AllocateChunk(FreeList& list, size_t size_class) {
+        const auto block_size = P::BlockSize(size_class);
+        auto chunk = static_cast<char*>(::operator new(block_size * P::CHUNK_BLOCKS));
+        CountHeap(block_size * P::CHUNK_BLOCKS);
+        for (size_t i = 0; i < P::CHUNK_BLOCKS; ++i) {
+            list.Push(reinterpret_cast<FreeBlock*>(chunk + i * block_size));
+        }
+    }
+
+    // blocks given back by the threads
+    static std::mutex m_shared;
+    static FreeList shared_lists[P::SIZE_CLASSES];
+    static thread_local ThreadCache cache;
+    static std::atomic<uint64_t> heap_allocations;
+    static std::atomic<uint64_t> heap_bytes;
+};
+
+template<class P>
+std::mutex SizeClassPool<P>::m_shared;
+
+template<class P>
+typename SizeClassPool<P>::FreeList SizeClassPool<P>::shared_lists[P::SIZE_CLASSES];
+
+template<class P>
+thread_local typename SizeClassPool<P>::ThreadCache SizeClassPool<P>::cache;
+
+template<class P>
+std::atomic<uint64_t> SizeClassPool<P>::heap_allocations(0);
+
+template<class P>
+std::atomic<uint64_t> SizeClassPool<P>::heap_bytes(0);
+}
+
+#endif // SIZECLASSPOOL_HPP_INCLUDED
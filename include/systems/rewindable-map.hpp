@@ -2,8 +2,10 @@
 #define REWINDABLE_MAP_HPP_INCLUDED
 #include <iostream>
 #include "bitmap.hpp"
+#include "compressed-bitmap.hpp"
 #include "trillek-allocator.hpp"
 #include "systems/async-data.hpp"
+#include "task-wait.hpp"
 #include "transform.hpp"
 
 namespace trillek {
@@ -115,14 +117,15 @@ public:
         }
         backward_data.Publish(std::move(removed), tp);
         forward_data.Publish(std::move(updated), tp);
-        backward_bitmap.Publish(std::move(removed_bitmap), tp);
-        forward_bitmap.Publish(std::move(update_bitmap), tp);
+        backward_bitmap.Publish(CompressedBitMap(removed_bitmap), tp);
+        forward_bitmap.Publish(CompressedBitMap(update_bitmap), tp);
         updated.clear();
         removed.clear();
-        update_bitmap = BitMap<uint32_t>();
-        removed_bitmap = BitMap<uint32_t>();
+        update_bitmap.clear();
+        removed_bitmap.clear();
         highest_timepoint = std::move(tp);
         head_timepoint = highest_timepoint;
+        commit_trigger.Reach(highest_timepoint);
         return head_timepoint;
     }
 
@@ -194,11 +197,11 @@ public:
         return backward_data.GetHead();
     }
 
-    const BitMap<uint32_t>& GetLastPositiveBitMap() {
+    const CompressedBitMap& GetLastPositiveBitMap() {
         return forward_bitmap.GetHead();
     }
 
-    const BitMap<uint32_t>& GetLastNegativeBitMap() {
+    const CompressedBitMap& GetLastNegativeBitMap() {
         return backward_bitmap.GetHead();
     }
 
@@ -282,6 +285,20 @@ public:
         return History<K, V>(std::move(el1), forward_data.PopSync(frame_requested, last_received));
     }
 
+    /** \brief Queue a task when a timepoint is committed. Thread-safe.
+     *
+     * Unlike Pull(), the caller does not block nor poll: the task is parked
+     * until Commit() or Push() makes tp available, then Pull() returns at once.
+     *
+     * \param tp const Timepoint& the timepoint to wait for
+     * \param scheduler TrillekScheduler& the scheduler running the task
+     * \param task TaskPtr<TaskRequestBase> the task
+     *
+     */
+    void WaitCommit(const Timepoint& tp, TrillekScheduler& scheduler, TaskPtr<TaskRequestBase> task) const {
+        commit_trigger.Wait(tp, scheduler, std::move(task));
+    }
+
 private:
     /** \brief Make the workspace map go backward in history
      *
@@ -374,6 +391,7 @@ private:
         }
         rewinded = true;
         Checkout(highest_timepoint);
+        commit_trigger.Reach(highest_timepoint);
     }
 
     // the data
@@ -383,6 +401,7 @@ private:
     // modifications in index
     SharedContainerConst<K,V> updated;
     SharedContainerConst<K,V> removed;
+    // the allocation is kept between commits, it only covers the keys written
     BitMap<uint32_t> update_bitmap;
     BitMap<uint32_t> removed_bitmap;
     // the highest timepoint we can checkout (max HEAD)
@@ -395,9 +414,11 @@ private:
     AsyncFrameData<SharedContainerConst<K,V>,HistorySize> forward_data;
     // old data go here
     AsyncFrameData<SharedContainerConst<K,V>,HistorySize> backward_data;
-    // Bitmaps
-    AsyncFrameData<BitMap<uint32_t>> forward_bitmap;
-    AsyncFrameData<BitMap<uint32_t>> backward_bitmap;
+    // Bitmaps, compressed since a frame updates few entities
+    AsyncFrameData<CompressedBitMap> forward_bitmap;
+    AsyncFrameData<CompressedBitMap> backward_bitmap;
+    // tasks waiting for a commit
+    mutable FrameTrigger<Timepoint> commit_trigger;
 };
 } // namespace trillek
 
@@ -0,0 +1,193 @@
+#ifndef TASKGRAPH_HPP_INCLUDED
+#define TASKGRAPH_HPP_INCLUDED
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "trillek-scheduler.hpp"
+
+namespace trillek {
+
+/** \brief The timings of one execution of a TaskGraph
+ */
+struct TaskGraphReport final {
+    TaskGraphReport() : frame(0), span(0), critical_length(0) {};
+
+    // the frame given to Launch()
+    frame_tp frame;
+    // time between the launch and the end of the last node
+    frame_unit span;
+    // sum of the durations of the nodes on the critical path
+    frame_unit critical_length;
+    // the nodes on the critical path, in execution order
+    std::vector<size_t> critical_path;
+    // duration of each node
+    std::vector<frame_unit> durations;
+};
+
+/** \brief A graph of tasks with dependencies
+ *
+ * A node is queued on the scheduler as soon as all its predecessors are
+ * finished, so independent nodes run in parallel on all threads. A node
+ * with several successors is a fork, a node with several predecessors is a
+ * join.
+ *
+ * The graph can be launched again once finished, typically once per frame.
+ * Nodes and dependencies must not be modified while the graph runs.
+ *
+ * After each run, the critical path, i.e the chain of dependent nodes with
+ * the longest total duration, is computed. It is the part of the graph
+ * bounding its execution time.
+ */
+class TaskGraph final {
+public:
+    typedef size_t node_t;
+
+    TaskGraph() : scheduler(nullptr), remaining(0), running(false), sorted(true), completing(0) {};
+    ~TaskGraph() {};
+
+    // disable copy functions
+    TaskGraph(TaskGraph&) = delete;
+    TaskGraph& operator=(TaskGraph&) = delete;
+
+    /** \brief Add a node
+     *
+     * \param name const std::string& the name used in the reports
+     * \param funct std::function<void(void)>&& the work of the node
+     * \return node_t the identifier of the node
+     *
+     */
+    node_t AddNode(const std::string& name, std::function<void(void)>&& funct);
+
+    /** \brief Add a dependency between 2 nodes
+     *
+     * \param before node_t the node that must finish first
+     * \param after node_t the node that waits for before
+     *
+     */
+    void Precede(node_t before, node_t after);
+
+    /** \brief Set a function called once all nodes are finished
+     *
+     * It runs on the thread that finished the last node, after the graph is
+     * marked as not running, so that it can launch the graph again. It gets
+     * a copy of the report, which the next run does not modify.
+     *
+     * \param funct std::function<void(const TaskGraphReport&)>&& the continuation
+     *
+     */
+    void OnComplete(std::function<void(const TaskGraphReport&)>&& funct) {
+        on_complete = std::move(funct);
+    }
+
+    /** \brief Queue the nodes without predecessors on a scheduler
+     *
+     * \param scheduler TrillekScheduler& the scheduler
+     * \param frame frame_tp the frame number copied in the report
+     * \return bool false if the graph is running, empty or has a cycle
+     *
+     */
+    bool Launch(TrillekScheduler& scheduler, frame_tp frame = 0);
+
+    /** \brief Block until the graph is finished
+     *
+     * Must not be called from a task of the scheduler running the graph.
+     */
+    void Wait() const;
+
+    /** \brief Tell if the graph is finished
+     *
+     * The graph is finished once the continuation has returned.
+     */
+    bool Done() const;
+
+    /** \brief Get the report of the last run
+     *
+     * Only valid when the graph is finished.
+     */
+    const TaskGraphReport& LastReport() const {
+        return report;
+    }
+
+    /** \brief Format the critical path of the last run
+     *
+     * \return std::string a line like "frame 12: span 3.1 ms, critical path 2.8 ms: a (1.0 ms) -> b (1.8 ms)"
+     *
+     */
+    std::string CriticalPathReport() const;
+
+    /** \brief Get the name of a node
+     *
+     */
+    const std::string& Name(node_t node) const {
+        return nodes[node]->name;
+    }
+
+    /** \brief Get the number of nodes
+     *
+     */
+    size_t Size() const {
+        return nodes.size();
+    }
+
+private:
+    struct Node {
+        Node(const std::string& name, std::function<void(void)>&& funct) :
+            name(name), funct(std::move(funct)), predecessors_count(0), pending(0) {};
+
+        const std::string name;
+        const std::function<void(void)> funct;
+        std::vector<node_t> successors;
+        std::vector<node_t> predecessors;
+        unsigned int predecessors_count;
+        // predecessors not finished yet in the current run
+        std::atomic<unsigned int> pending;
+        scheduler_tp start;
+        scheduler_tp end;
+    };
+
+    /** \brief Queue a node on the scheduler
+     *
+     */
+    void QueueNode(node_t node);
+
+    /** \brief Execute a node and release its successors
+     *
+     */
+    void RunNode(node_t node);
+
+    /** \brief Build the report and signal the end of the run
+     *
+     */
+    void Finish();
+
+    /** \brief Sort the nodes in topological order
+     *
+     * \return bool false if the graph has a cycle
+     */
+    bool Sort();
+
+    std::vector<std::unique_ptr<Node>> nodes;
+    // nodes in topological order
+    std::vector<node_t> order;
+    TrillekScheduler* scheduler;
+    std::function<void(const TaskGraphReport&)> on_complete;
+    TaskGraphReport report;
+    scheduler_tp launch_tp;
+    // nodes not finished yet in the current run
+    std::atomic<size_t> remaining;
+    std::atomic<bool> running;
+    bool sorted;
+    // the number of continuations running, guarded by m_done. The
+    // continuation of a run can still run after the end of the next one.
+    unsigned int completing;
+    mutable std::mutex m_done;
+    mutable std::condition_variable done_check;
+};
+}
+
+#endif // TASKGRAPH_HPP_INCLUDED
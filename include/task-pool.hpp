@@ -0,0 +1,158 @@
+#ifndef TASKPOOL_HPP_INCLUDED
+#define TASKPOOL_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace trillek {
+
+/** \brief Counters of the memory taken from the heap by the task pool
+ */
+struct TaskPoolCounters {
+    // calls to the heap allocator: chunks of blocks and oversized tasks
+    uint64_t heap_allocations;
+    // bytes taken from the heap
+    uint64_t heap_bytes;
+    // tasks too large for the size classes
+    uint64_t oversized;
+};
+
+/** \brief A block allocator for tasks
+ *
+ * Blocks have 4 size classes from 64 to 512 bytes, kept in the free lists of
+ * a SizeClassPool: once the pool has grown, allocating a task costs no call
+ * to the heap allocator.
+ *
+ * Larger tasks are allocated from the heap and counted as oversized.
+ */
+class TaskPool final {
+public:
+    static const size_t SIZE_CLASSES = 4;
+    static const size_t MIN_BLOCK = 64;
+    static const size_t MAX_BLOCK = MIN_BLOCK << (SIZE_CLASSES - 1);
+    // blocks allocated at once, and moved at once between threads
+    static const size_t CHUNK_BLOCKS = 64;
+    // blocks of a size class a thread can keep
+    static const size_t CACHE_BLOCKS = 4 * CHUNK_BLOCKS;
+
+    static size_t BlockSize(size_t size_class) {
+        return MIN_BLOCK << size_class;
+    }
+
+    /** \brief Get a block
+     *
+     * \param size size_t the size of the block
+     * \return void* the block
+     */
+    static void* Allocate(size_t size);
+
+    /** \brief Give back a block
+     *
+     * The block can be released by any thread.
+     *
+     * \param block void* the block
+     * \param size size_t the size passed to Allocate()
+     */
+    static void Deallocate(void* block, size_t size);
+
+    /** \brief Put blocks in the shared lists before they are needed
+     *
+     * \param size size_t the size of the blocks
+     * \param blocks size_t the minimal number of blocks to add
+     */
+    static void Reserve(size_t size, size_t blocks);
+
+    /** \brief Get the counters of the heap allocations
+     *
+     */
+    static TaskPoolCounters Counters();
+};
+
+/** \brief A smart pointer using the reference counter of a task
+ *
+ * T must provide AddReference() and RemoveReference(), the latter
+ * returning true when the last reference is removed. Copying a pointer
+ * does not allocate anything, and a task can hold a pointer to itself.
+ */
+template<class T>
+class TaskPtr final {
+    template<class U>
+    friend class TaskPtr;
+
+public:
+    TaskPtr() : ptr(nullptr) {};
+
+    TaskPtr(std::nullptr_t) : ptr(nullptr) {};
+
+    explicit TaskPtr(T* task) : ptr(task) {
+        if (ptr) {
+            ptr->AddReference();
+        }
+    }
+
+    TaskPtr(const TaskPtr& other) : TaskPtr(other.ptr) {};
+
+    template<class U>
+    TaskPtr(const TaskPtr<U>& other) : TaskPtr(other.ptr) {};
+
+    TaskPtr(TaskPtr&& other) : ptr(other.ptr) {
+        other.ptr = nullptr;
+    }
+
+    template<class U>
+    TaskPtr(TaskPtr<U>&& other) : ptr(other.ptr) {
+        other.ptr = nullptr;
+    }
+
+    ~TaskPtr() {
+        reset();
+    }
+
+    TaskPtr& operator=(TaskPtr other) {
+        std::swap(ptr, other.ptr);
+        return *this;
+    }
+
+    /** \brief Drop the reference, and delete the task if it was the last one
+     *
+     */
+    void reset() {
+        if (ptr && ptr->RemoveReference()) {
+            delete ptr;
+        }
+        ptr = nullptr;
+    }
+
+    T* get() const {
+        return ptr;
+    }
+
+    T* operator->() const {
+        return ptr;
+    }
+
+    T& operator*() const {
+        return *ptr;
+    }
+
+    explicit operator bool() const {
+        return ptr != nullptr;
+    }
+
+private:
+    T* ptr;
+};
+
+template<class T, class U>
+bool operator==(const TaskPtr<T>& lhs, const TaskPtr<U>& rhs) {
+    return lhs.get() == rhs.get();
+}
+
+template<class T, class U>
+bool operator!=(const TaskPtr<T>& lhs, const TaskPtr<U>& rhs) {
+    return lhs.get() != rhs.get();
+}
+}
+
+#endif // TASKPOOL_HPP_INCLUDED
@@ -0,0 +1,268 @@
+#ifndef TASKWAIT_HPP_INCLUDED
+#define TASKWAIT_HPP_INCLUDED
+
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <map>
+#include <memory>
+#include <limits>
+#include "trillek-scheduler.hpp"
+
+namespace trillek {
+
+/** \brief Tasks parked until an event
+ *
+ * Not thread-safe: the owner protects it.
+ */
+class ParkedTasks final {
+public:
+    void Park(TrillekScheduler& scheduler, TaskPtr<TaskRequestBase>&& task) {
+        tasks.push_back(std::make_pair(&scheduler, std::move(task)));
+    }
+
+    /** \brief Queue all parked tasks
+     *
+     * Call it without holding the lock of the owner.
+     *
+     */
+    void Release() {
+        for (auto& t : tasks) {
+            t.first->Queue(std::move(t.second));
+        }
+        tasks.clear();
+    }
+
+    void Swap(ParkedTasks& other) {
+        tasks.swap(other.tasks);
+    }
+
+    bool Empty() const {
+        return tasks.empty();
+    }
+
+private:
+    std::vector<std::pair<TrillekScheduler*,TaskPtr<TaskRequestBase>>> tasks;
+};
+
+/** \brief A counter releasing the tasks waiting for it when it reaches 0
+ *
+ * Use it to join a group of tasks: each one calls Decrement() when it is
+ * done, and the continuation waits for the counter.
+ */
+class TaskCounter final {
+public:
+    explicit TaskCounter(unsigned int count = 0) : count(count) {};
+
+    // disable copy functions
+    TaskCounter(TaskCounter&) = delete;
+    TaskCounter& operator=(TaskCounter&) = delete;
+
+    /** \brief Increment the counter
+     *
+     * \param n unsigned int the value to add
+     */
+    void Add(unsigned int n = 1) {
+        count.fetch_add(n);
+    }
+
+    /** \brief Decrement the counter, and queue the waiting tasks if it reaches 0
+     *
+     */
+    void Decrement() {
+        if (count.fetch_sub(1) != 1) {
+            return;
+        }
+        ParkedTasks released;
+        {
+            std::lock_guard<std::mutex> locker(m_parked);
+            parked.Swap(released);
+        }
+        released.Release();
+    }
+
+    /** \brief Queue a task when the counter is 0
+     *
+     * \param scheduler TrillekScheduler& the scheduler running the task
+     * \param task the task, queued at once if the counter is already 0
+     */
+    void Wait(TrillekScheduler& scheduler, TaskPtr<TaskRequestBase> task) {
+        {
+            std::lock_guard<std::mutex> locker(m_parked);
+            if (count.load()) {
+                parked.Park(scheduler, std::move(task));
+                return;
+            }
+        }
+        scheduler.Queue(std::move(task));
+    }
+
+    unsigned int Value() const {
+        return count.load();
+    }
+
+private:
+    std::atomic<unsigned int> count;
+    std::mutex m_parked;
+    ParkedTasks parked;
+};
+
+template<class T>
+class TaskPromise;
+
+/** \brief The value of a TaskPromise, available to the tasks waiting for it
+ *
+ * Copies of a future share the same value.
+ */
+template<class T>
+class TaskFuture final {
+    friend class TaskPromise<T>;
+
+    struct State {
+        State() : ready(false) {};
+
+        std::mutex m;
+        std::atomic<bool> ready;
+        T value;
+        ParkedTasks parked;
+    };
+
+public:
+    /** \brief Queue a task when the value is set
+     *
+     * \param scheduler TrillekScheduler& the scheduler running the task
+     * \param task the task, queued at once if the value is already set
+     */
+    void Wait(TrillekScheduler& scheduler, TaskPtr<TaskRequestBase> task) const {
+        {
+            std::lock_guard<std::mutex> locker(state->m);
+            if (! state->ready) {
+                state->parked.Park(scheduler, std::move(task));
+                return;
+            }
+        }
+        scheduler.Queue(std::move(task));
+    }
+
+    bool Ready() const {
+        return state->ready;
+    }
+
+    /** \brief Get the value
+     *
+     * Only valid when Ready() is true, i.e in the tasks that waited for it.
+     *
+     */
+    const T& Get() const {
+        return state->value;
+    }
+
+private:
+    TaskFuture(const std::shared_ptr<State>& state) : state(state) {};
+
+    std::shared_ptr<State> state;
+};
+
+/** \brief A value set once by a task, waited by other tasks
+ */
+template<class T>
+class TaskPromise final {
+public:
+    TaskPromise() : state(std::make_shared<typename TaskFuture<T>::State>()) {};
+
+    TaskFuture<T> GetFuture() const {
+        return TaskFuture<T>(state);
+    }
+
+    /** \brief Set the value and queue the waiting tasks
+     *
+     * \param value U&& the value
+     * \return bool false if the value was already set
+     */
+    template<class U>
+    bool SetValue(U&& value) {
+        ParkedTasks released;
+        {
+            std::lock_guard<std::mutex> locker(state->m);
+            if (state->ready) {
+                return false;
+            }
+            state->value = std::forward<U>(value);
+            state->ready = true;
+            state->parked.Swap(released);
+        }
+        released.Release();
+        return true;
+    }
+
+private:
+    std::shared_ptr<typename TaskFuture<T>::State> state;
+};
+
+/** \brief Tasks waiting for a timepoint to be reached
+ *
+ * The publisher calls Reach() when it has done the work of a frame, e.g.
+ * RewindableMap::Commit().
+ */
+template<class Timepoint = frame_tp>
+class FrameTrigger final {
+public:
+    FrameTrigger() : reached((std::numeric_limits<Timepoint>::min)()) {};
+
+    // disable copy functions
+    FrameTrigger(FrameTrigger&) = delete;
+    FrameTrigger& operator=(FrameTrigger&) = delete;
+
+    /** \brief Queue the tasks waiting for a timepoint up to tp
+     *
+     * \param tp Timepoint the timepoint reached
+     */
+    void Reach(Timepoint tp) {
+        ParkedTasks released;
+        {
+            std::lock_guard<std::mutex> locker(m_parked);
+            if (tp > reached) {
+                reached = tp;
+            }
+            auto last = parked.upper_bound(tp);
+            for (auto it = parked.begin(); it != last; ++it) {
+                released.Park(*it->second.first, std::move(it->second.second));
+            }
+            parked.erase(parked.begin(), last);
+        }
+        released.Release();
+    }
+
+    /** \brief Queue a task when a timepoint is reached
+     *
+     * \param tp Timepoint the timepoint
+     * \param scheduler TrillekScheduler& the scheduler running the task
+     * \param task the task, queued at once if tp is already reached
+     */
+    void Wait(Timepoint tp, TrillekScheduler& scheduler, TaskPtr<TaskRequestBase> task) {
+        {
+            std::lock_guard<std::mutex> locker(m_parked);
+            if (tp > reached) {
+                parked.insert(std::make_pair(tp, std::make_pair(&scheduler, std::move(task))));
+                return;
+            }
+        }
+        scheduler.Queue(std::move(task));
+    }
+
+    /** \brief Get the highest timepoint reached
+     *
+     */
+    Timepoint Reached() const {
+        std::lock_guard<std::mutex> locker(m_parked);
+        return reached;
+    }
+
+private:
+    mutable std::mutex m_parked;
+    Timepoint reached;
+    std::multimap<Timepoint,std::pair<TrillekScheduler*,TaskPtr<TaskRequestBase>>> parked;
+};
+}
+
+#endif // TASKWAIT_HPP_INCLUDED
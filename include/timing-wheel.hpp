@@ -0,0 +1,373 @@
+#ifndef TIMINGWHEEL_HPP_INCLUDED
+#define TIMINGWHEEL_HPP_INCLUDED
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <limits>
+#include "util/utiltype.hpp"
+
+namespace trillek {
+
+template<class T>
+class TimingWheel;
+
+/** \brief The intrusive part of an element stored in a TimingWheel
+ *
+ * An element can be in only one wheel at a time. Copying an element does
+ * not copy its position in the wheel.
+ */
+class TimerNode {
+public:
+    TimerNode() : timer_prev(nullptr), timer_next(nullptr), timer_slot(nullptr),
+                    timer_deadline(0), timer_owner(nullptr) {};
+
+    TimerNode(const TimerNode&) : TimerNode() {};
+
+    TimerNode& operator=(const TimerNode&) {
+        return *this;
+    }
+
+    /** \brief Get the wheel holding the element, nullptr if none
+     *
+     */
+    const void* TimerOwner() const {
+        return timer_owner.load();
+    }
+
+    /** \brief Get the tick at which the element expires
+     *
+     */
+    uint64_t TimerDeadline() const {
+        return timer_deadline;
+    }
+
+private:
+    template<class T>
+    friend class TimingWheel;
+
+    TimerNode* timer_prev;
+    TimerNode* timer_next;
+    // head of the list holding the element
+    TimerNode** timer_slot;
+    uint64_t timer_deadline;
+    std::atomic<const void*> timer_owner;
+};
+
+/** \brief A hierarchical timing wheel
+ *
+ * Elements are stored in the slot of their deadline tick. There are 4 levels
+ * of 64 slots, each level counting 64 times slower than the previous one.
+ * When the first level wraps, the next slot of the upper level is spread
+ * over the lower levels (cascade).
+ *
+ * Insertion and cancellation are O(1). Advance() expires all elements due
+ * in one pass. Deadlines beyond 2^24 ticks are parked on the last level and
+ * placed again when they are cascaded.
+ *
+ * T must derive from TimerNode. The wheel does not own the elements and is
+ * not thread-safe.
+ */
+template<class T>
+class TimingWheel final {
+    static const unsigned int LEVEL_BITS = 6;
+    static const unsigned int SLOTS = 1 << LEVEL_BITS;
+    static const unsigned int LEVELS = 4;
+    static const uint64_t SLOT_MASK = SLOTS - 1;
+    static const uint64_t MAX_DELTA = (uint64_t(1) << (LEVEL_BITS * LEVELS)) - 1;
+
+public:
+    /** \brief Constructor
+     *
+     * \param tick uint64_t the current tick
+     */
+    TimingWheel(uint64_t tick = 0) : current(tick), count(0) {
+        for (unsigned int l = 0; l < LEVELS; ++l) {
+            occupied[l] = 0;
+            for (unsigned int s = 0; s < SLOTS; ++s) {
+                slots[l][s] = nullptr;
+            }
+        }
+    };
+
+    ~TimingWheel() {};
+
+    // disable copy functions
+    TimingWheel(TimingWheel&) = delete;
+    TimingWheel& operator=(TimingWheel&) = delete;
+
+    /** \brief Insert an element
+     *
+     * \param element T* the element, not already in a wheel
+     * \param deadline uint64_t the tick when the element expires
+     * \return bool false if the deadline is already reached (element not inserted)
+     */
+    bool Insert(T* element, uint64_t deadline) {
+        if (deadline <= current) {
+            return false;
+        }
+        TimerNode* node = element;
+        node->timer_deadline = deadline;
+        node->timer_owner = this;
+        Link(node);
+        ++count;
+        return true;
+    }
+
+    /** \brief Remove an element before its deadline
+     *
+     * \param element T* the element
+     * \return bool true if the element was in this wheel
+     */
+    bool Cancel(T* element) {
+        TimerNode* node = element;
+        if (node->timer_owner.load() != this) {
+            return false;
+        }
+        Unlink(node);
+        node->timer_owner = nullptr;
+        --count;
+        return true;
+    }
+
+    /** \brief Move the wheel to a tick and expire all elements due
+     *
+     * expire is called with a T* for each element, which is removed from
+     * the wheel before the call.
+     *
+     * \param tick uint64_t the new current tick
+     * \param expire F&& the function called for each expired element
+     * \return size_t the number of elements expired
+     */
+    template<class F>
+    size_t Advance(uint64_t tick, F&& expire) {
+        size_t expired = 0;
+        while (current < tick) {
+            if (! count) {
+                current = tick;
+                break;
+            }
+            ++current;
+            // number of levels wrapping at this tick
+            unsigned int wraps = 0;
+            while (wraps + 1 < LEVELS && ! (current & ((uint64_t(1) << (LEVEL_BITS * (wraps + 1))) - 1))) {
+                ++wraps;
+            }
+            for (unsigned int l = wraps; l > 0; --l) {
+                Cascade(l);
+            }
+            const auto index = current & SLOT_MASK;
+            auto node = slots[0][index];
+            slots[0][index] = nullptr;
+            occupied[0] &= ~(uint64_t(1) << index);
+            while (node) {
+                auto next = node->timer_next;
+                node->timer_prev = nullptr;
+                node->timer_next = nullptr;
+                node->timer_slot = nullptr;
+                node->timer_owner = nullptr;
+                --count;
+                ++expired;
+                expire(static_cast<T*>(node));
+                node = next;
+            }
+        }
+        return expired;
+    }
+
+    /** \brief Expire the elements of the next tick that are already due
+     *
+     * The wheel does not move. Use it when deadlines are rounded up to a
+     * tick: an element of the next tick may be due before the tick starts.
+     *
+     * \param due P&& the function telling if a T* is due
+     * \param expire F&& the function called for each expired element
+     * \return size_t the number of elements expired
+     */
+    template<class P, class F>
+    size_t ExpireNext(P&& due, F&& expire) {
+        const auto next = current + 1;
+        size_t expired = 0;
+        // on a wrap, the elements of the next tick are not cascaded yet
+        for (unsigned int l = 0; l < LEVELS; ++l) {
+            if (l && (next & ((uint64_t(1) << (LEVEL_BITS * l)) - 1))) {
+                break;
+            }
+            auto node = slots[l][(next >> (LEVEL_BITS * l)) & SLOT_MASK];
+            while (node) {
+                auto following = node->timer_next;
+                if (node->timer_deadline == next && due(static_cast<T*>(node))) {
+                    Unlink(node);
+                    node->timer_owner = nullptr;
+                    --count;
+                    ++expired;
+                    expire(static_cast<T*>(node));
+                }
+                node = following;
+            }
+        }
+        return expired;
+    }
+
+    /** \brief Remove all elements without waiting for their deadline
+     *
+     * \param remove F&& the function called with a T* for each element removed
+     * \return size_t the number of elements removed
+     */
+    template<class F>
+    size_t Clear(F&& remove) {
+        size_t removed = 0;
+        for (unsigned int l = 0; l < LEVELS; ++l) {
+            for (unsigned int s = 0; s < SLOTS; ++s) {
+                auto node = slots[l][s];
+                slots[l][s] = nullptr;
+                while (node) {
+                    auto next = node->timer_next;
+                    node->timer_prev = nullptr;
+                    node->timer_next = nullptr;
+                    node->timer_slot = nullptr;
+                    node->timer_owner = nullptr;
+                    ++removed;
+                    remove(static_cast<T*>(node));
+                    node = next;
+                }
+            }
+            occupied[l] = 0;
+        }
+        count = 0;
+        return removed;
+    }
+
+    /** \brief Move the current tick of an empty wheel
+     *
+     * \param tick uint64_t the new current tick
+     * \return bool false if the wheel is not empty
+     */
+    bool Reset(uint64_t tick) {
+        if (count) {
+            return false;
+        }
+        current = tick;
+        return true;
+    }
+
+    /** \brief Get the tick when Advance() must be called next
+     *
+     * This is the exact deadline of the next element if it is on the first
+     * level, otherwise the tick of the next cascade.
+     *
+     * \return uint64_t the tick, or the max value if the wheel is empty
+     */
+    uint64_t NextExpiry() const {
+        if (! count) {
+            return (std::numeric_limits<uint64_t>::max)();
+        }
+        const auto next_cascade = (current | SLOT_MASK) + 1;
+        if (occupied[0]) {
+            // rotate to put the slot of the next tick at bit 0
+            const auto shift = (current + 1) & SLOT_MASK;
+            const auto rotated = shift ? (occupied[0] >> shift) | (occupied[0] << (SLOTS - shift)) : occupied[0];
+            const auto next = current + 1 + util::Ctz<uint64_t>(rotated);
+            return next < next_cascade ? next : next_cascade;
+        }
+        return next_cascade;
+    }
+
+    /** \brief Get the current tick
+     *
+     */
+    uint64_t Now() const {
+        return current;
+    }
+
+    /** \brief Get the number of elements in the wheel
+     *
+     */
+    size_t Size() const {
+        return count;
+    }
+
+    /** \brief Tell if the wheel is empty
+     *
+     */
+    bool Empty() const {
+        return ! count;
+    }
+
+private:
+    /** \brief Put a node in the slot matching its deadline
+     *
+     * A deadline already reached goes to the slot of the current tick,
+     * which is only correct during a cascade.
+     *
+     */
+    void Link(TimerNode* node) {
+        auto deadline = node->timer_deadline;
+        auto delta = deadline > current ? deadline - current : 0;
+        if (delta > MAX_DELTA) {
+            // too far: park it on the last level, it will be placed again later
+            delta = MAX_DELTA;
+            deadline = current + MAX_DELTA;
+        }
+        unsigned int level = 0;
+        while (level + 1 < LEVELS && delta >= (uint64_t(1) << (LEVEL_BITS * (level + 1)))) {
+            ++level;
+        }
+        const auto index = ((delta ? deadline : current) >> (LEVEL_BITS * level)) & SLOT_MASK;
+        auto& head = slots[level][index];
+        node->timer_prev = nullptr;
+        node->timer_next = head;
+        if (head) {
+            head->timer_prev = node;
+        }
+        head = node;
+        node->timer_slot = &head;
+        occupied[level] |= uint64_t(1) << index;
+    }
+
+    /** \brief Remove a node from its slot
+     *
+     */
+    void Unlink(TimerNode* node) {
+        if (node->timer_prev) {
+            node->timer_prev->timer_next = node->timer_next;
+        }
+        else {
+            *node->timer_slot = node->timer_next;
+        }
+        if (node->timer_next) {
+            node->timer_next->timer_prev = node->timer_prev;
+        }
+        if (! *node->timer_slot) {
+            const auto position = node->timer_slot - &slots[0][0];
+            occupied[position / SLOTS] &= ~(uint64_t(1) << (position % SLOTS));
+        }
+        node->timer_prev = nullptr;
+        node->timer_next = nullptr;
+        node->timer_slot = nullptr;
+    }
+
+    /** \brief Spread the current slot of a level over the lower levels
+     *
+     */
+    void Cascade(unsigned int level) {
+        const auto index = (current >> (LEVEL_BITS * level)) & SLOT_MASK;
+        auto node = slots[level][index];
+        slots[level][index] = nullptr;
+        occupied[level] &= ~(uint64_t(1) << index);
+        while (node) {
+            auto next = node->timer_next;
+            Link(node);
+            node = next;
+        }
+    }
+
+    TimerNode* slots[LEVELS][SLOTS];
+    // one bit per non-empty slot
+    uint64_t occupied[LEVELS];
+    uint64_t current;
+    size_t count;
+};
+}
+
+#endif // TIMINGWHEEL_HPP_INCLUDED
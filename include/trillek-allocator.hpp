@@ -2,11 +2,19 @@
 #define TRILLEKALLOCATOR_HPP_INCLUDED
 
 #include <cstddef>
-
-extern size_t gAllocatedSize;
+#include "memory-accounting.hpp"
+#include "node-pool.hpp"
 
 namespace trillek {
 
+/** \brief The allocator of the containers
+ *
+ * The allocations are charged to a MemoryTag, by default the tag of the
+ * MemoryTagScope in which the allocator is built. Each block starts with a
+ * header holding its tag, and is freed under this tag whatever the allocator
+ * releasing it, so allocators compare equal whatever their tags: nodes can be
+ * spliced between containers of different tags.
+ */
 template<typename T>
 class TrillekAllocator {
 public:
@@ -18,33 +26,46 @@ public:
     typedef const T& const_reference;
     typedef T value_type;
 
-    /// Define a global that holds the allocated size
-
-    /// Default constructor
-    TrillekAllocator() throw() { }
+    /// Default constructor, uses the tag of the thread
+    TrillekAllocator() throw() : tag(MemoryAccounting::CurrentTag()) { }
+    /// Constructor with a tag
+    explicit TrillekAllocator(MemoryTag tag) throw() : tag(tag) { }
     /// Copy constructor
-    TrillekAllocator(const TrillekAllocator&) throw() { }
+    TrillekAllocator(const TrillekAllocator& other) throw() : tag(other.tag) { }
     /// Copy constructor with another type
     template<typename U>
-    TrillekAllocator(const TrillekAllocator<U>&) throw() { }
+    TrillekAllocator(const TrillekAllocator<U>& other) throw() : tag(other.tag) { }
 
     /// Destructor
     ~TrillekAllocator() { }
 
     /// Copy
-    TrillekAllocator<T>& operator=(const TrillekAllocator&) {
+    TrillekAllocator<T>& operator=(const TrillekAllocator& other) {
+        tag = other.tag;
         return *this;
     }
     /// Copy with another type
     template<typename U>
-    TrillekAllocator& operator=(const TrillekAllocator<U>&) {
+    TrillekAllocator& operator=(const TrillekAllocator<U>& other) {
+        tag = other.tag;
         return *this;
     }
 
-    bool operator==(const TrillekAllocator& lhs) {
+    template<typename U>
+    bool operator==(const TrillekAllocator<U>&) const {
         return true;
     }
 
+    template<typename U>
+    bool operator!=(const TrillekAllocator<U>&) const {
+        return false;
+    }
+
+    /// Get the tag charged with the allocations
+    MemoryTag Tag() const {
+        return tag;
+    }
+
     /// Get address of reference
     pointer address(reference x) const {
         return &x;
@@ -54,18 +75,27 @@ public:
         return &x;
     }
 
-    /// Allocate memory
+    /// Allocate memory, small blocks come from the node pool
     pointer allocate(size_type n, const void* = 0) {
         size_type size = n * sizeof(value_type);
-        gAllocatedSize += size;
-        return (pointer)::operator new(size);
+        MemoryAccounting::Allocated(tag, size);
+        char* block = NodePool::Pooled(size + HEADER, alignof(T)) ?
+                        static_cast<char*>(NodePool::Allocate(size + HEADER)) :
+                        static_cast<char*>(::operator new(size + HEADER));
+        *reinterpret_cast<MemoryTag*>(block) = tag;
+        return reinterpret_cast<pointer>(block + HEADER);
     }
 
-    /// Deallocate memory
+    /// Deallocate memory, under the tag of the allocator that allocated it
     void deallocate(void* p, size_type n) {
         size_type size = n * sizeof(T);
-        gAllocatedSize -= size;
-        ::operator delete(p);
+        char* block = static_cast<char*>(p) - HEADER;
+        MemoryAccounting::Freed(*reinterpret_cast<MemoryTag*>(block), size);
+        if (NodePool::Pooled(size + HEADER, alignof(T))) {
+            NodePool::Deallocate(block, size + HEADER);
+            return;
+        }
+        ::operator delete(block);
     }
 
     /// Call constructor
@@ -100,6 +130,15 @@ public:
     struct rebind {
         typedef TrillekAllocator<U> other;
     };
+
+private:
+    template<typename U>
+    friend class TrillekAllocator;
+
+    // the tag of a block is stored before it, keeping the alignment
+    static const size_type HEADER = alignof(std::max_align_t);
+
+    MemoryTag tag;
 };
 
 }
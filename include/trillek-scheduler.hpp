@@ -1,8 +1,6 @@
 #ifndef TRILLEKSCHEDULER_H_INCLUDED
 #define TRILLEKSCHEDULER_H_INCLUDED
 
-#define MAX_CONCURRENT_THREAD   4
-
 #include <chrono>
 #include <functional>
 #include <atomic>
@@ -11,7 +9,15 @@
 #include <queue>
 #include <list>
 #include <iterator>
+#include <vector>
+#include <limits>
 #include "atomic-queue.hpp"
+#include "work-stealing-queue.hpp"
+#include "timing-wheel.hpp"
+#include "task-pool.hpp"
+#include "memory-accounting.hpp"
+#include "scheduler-clock.hpp"
+#include "scheduler-telemetry.hpp"
 
 #define		STOP		0
 #define 	SPLIT		1
@@ -24,31 +30,61 @@ namespace trillek {
 using namespace std::chrono;
 
 class SystemBase;
+class TrillekScheduler;
+class TaskGraph;
 
 typedef std::function<int(void)> block_t;
 typedef std::list<block_t> chain_t;
 
-typedef std::chrono::nanoseconds frame_unit;
-#if defined(_MSC_VER)
-// Visual Studio implements steady_clock as system_clock
-// TODO : wait for the fix from Microsoft
-typedef time_point<system_clock, frame_unit> scheduler_tp;
-typedef int64_t frame_tp;
-typedef time_point<system_clock, frame_unit> glfw_tp;
-#else
-typedef time_point<steady_clock, frame_unit> scheduler_tp;
+// frame_unit and scheduler_tp are defined in scheduler-clock.hpp
 typedef int64_t frame_tp;
-typedef time_point<steady_clock, frame_unit> glfw_tp;
-#endif
+typedef scheduler_tp glfw_tp;
+
+/** \brief The priority lanes of the tasks
+ *
+ * Threads take the tasks of the first lanes first, and each lane has its own
+ * limit of running tasks: bulk work can not take the threads needed by the
+ * frame.
+ */
+enum class TaskLane : unsigned int {
+    // the work of the current frame, e.g. the systems
+    FRAME,
+    // short tasks starting or completing I/O
+    IO,
+    // bulk work without deadline
+    BACKGROUND
+};
 
-class TaskRequestBase {
+const unsigned int TASK_LANES = 3;
+
+/** \brief The base class of tasks
+ *
+ * Tasks are allocated from the TaskPool and counted by TaskPtr.
+ */
+class TaskRequestBase : public TimerNode {
+    friend class TrillekScheduler;
+    template<class T>
+    friend class TaskPtr;
 public:
     TaskRequestBase(scheduler_tp&& timestamp) :
-        timestamp(std::move(timestamp))
+        timestamp(std::move(timestamp)), affinity(-1), lane(TaskLane::FRAME), references(0)
+        {};
+
+    // a copy is a new task, not referenced yet
+    TaskRequestBase(const TaskRequestBase& task) : TimerNode(task),
+        timestamp(task.timestamp), affinity(task.affinity), lane(task.lane), references(0)
         {};
 
     virtual ~TaskRequestBase() {};
 
+    static void* operator new(std::size_t size) {
+        return TaskPool::Allocate(size);
+    }
+
+    static void operator delete(void* block, std::size_t size) {
+        TaskPool::Deallocate(block, size);
+    }
+
     bool operator<(const TaskRequestBase& tqe) const {
         return this->timestamp < tqe.timestamp;
     }
@@ -58,7 +94,7 @@ public:
     glfw_tp Now() const;
 
     bool IsNow() const {
-        return timestamp < Now();
+        return timestamp <= Now();
     }
 
     void Reschedule(frame_unit&& delay) {
@@ -69,8 +105,49 @@ public:
         return timestamp;
     }
 
+    /** \brief Pin the task to a thread of the scheduler
+     *
+     * \param thread int the index of the thread, -1 to let any thread run the task
+     *
+     */
+    void SetAffinity(int thread) {
+        affinity = thread;
+    }
+
+    int Affinity() const {
+        return affinity;
+    }
+
+    /** \brief Set the priority lane of the task
+     *
+     * \param lane TaskLane the lane, FRAME by default
+     *
+     */
+    void SetLane(TaskLane lane) {
+        this->lane = lane;
+    }
+
+    TaskLane Lane() const {
+        return lane;
+    }
+
 protected:
     scheduler_tp timestamp;
+    int affinity;
+    TaskLane lane;
+
+private:
+    void AddReference() {
+        references.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool RemoveReference() {
+        return references.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+
+    std::atomic<unsigned int> references;
+    // keeps the task alive while it waits in a timing wheel
+    TaskPtr<TaskRequestBase> timer_pin;
 };
 
 template<class T>
@@ -142,15 +219,15 @@ public:
             auto s = (*b)();
             switch(s) {
             case REQUEUE:
-                // "*this" is now undefined
+                // "*this" may run on another thread as soon as it is queued
                 // we delay the execution of 1/10 frame
-                queue_task(std::make_shared<TaskRequest<chain_t>>(std::move(*this)), frame_unit(1666666));
+                queue_task(TaskPtr<TaskRequest<chain_t>>(this), frame_unit(1666666));
             case STOP:
                 return;
             case SPLIT:
                 // Queue a thread to execute this block again, and continue the chain
                 // we delay the execution of 1/10 frame
-                queue_task(std::make_shared<TaskRequest<chain_t>>(*this), frame_unit(1666666));
+                queue_task(TaskPtr<TaskRequest<chain_t>>(new TaskRequest<chain_t>(*this)), frame_unit(1666666));
                 break;
             case REPEAT:
                 --b;
@@ -161,30 +238,177 @@ public:
         }
     }
 
-    static void Initialize(std::function<void(std::shared_ptr<TaskRequest<chain_t>>&&, frame_unit&&)>&& f) {
+    static void Initialize(std::function<void(TaskPtr<TaskRequest<chain_t>>&&, frame_unit&&)>&& f) {
         queue_task = std::move(f);
     };
 
 private:
-    static std::function<void(std::shared_ptr<TaskRequest<chain_t>>&&, frame_unit&&)> queue_task;
+    static std::function<void(TaskPtr<TaskRequest<chain_t>>&&, frame_unit&&)> queue_task;
     const std::shared_ptr<chain_t> chain;
     chain_t::const_iterator block;
     const chain_t::const_iterator block_end;
 };
 
 
+/** \brief Create a task
+ *
+ * The task is allocated from the TaskPool.
+ *
+ * \param args the arguments of the constructor of T
+ * \return TaskPtr<T> the task
+ *
+ */
+template<class T, class... Args>
+TaskPtr<T> MakeTask(Args&&... args) {
+    return TaskPtr<T>(new T(std::forward<Args>(args)...));
+}
+
+/** \brief Create a task executing a callable
+ *
+ * The callable is stored in the task itself: unlike std::function, its
+ * captures do not need another allocation.
+ *
+ * \param funct F&& the callable
+ * \return the task
+ *
+ */
+template<class F>
+TaskPtr<TaskRequest<typename std::decay<F>::type>> MakeTaskRequest(F&& funct) {
+    typedef typename std::decay<F>::type funct_t;
+    return MakeTask<TaskRequest<funct_t>>(funct_t(std::forward<F>(funct)));
+}
+
+/** \brief Create a delayed task executing a callable
+ *
+ * \param funct F&& the callable
+ * \param delay const frame_unit& the delay before the execution
+ * \return the task
+ *
+ */
+template<class F>
+TaskPtr<TaskRequest<typename std::decay<F>::type>> MakeTaskRequest(F&& funct, const frame_unit& delay) {
+    typedef typename std::decay<F>::type funct_t;
+    return MakeTask<TaskRequest<funct_t>>(funct_t(std::forward<F>(funct)), delay);
+}
+
+/** \brief What a system does when a frame ends after the start of the next one
+ */
+enum class FramePacing {
+    // frames keep their timepoint and late frames run back to back, up to
+    // a number of frames to catch up, the older ones are dropped
+    FIXED_STEP,
+    // late frames are dropped, the next frame keeps the cadence
+    SKIP_FRAMES,
+    // frames get the time they actually start, the next frame starts one
+    // period after this one, or at once if it is late
+    VARIABLE_STEP
+};
+
+/** \brief The frame rate of a system and its overrun policy
+ */
+struct SystemPacing {
+    /** \brief Constructor
+     *
+     * \param period frame_unit the duration of a frame of the system
+     * \param mode FramePacing the overrun policy
+     * \param max_catch_up unsigned int the number of late frames run back to back (FIXED_STEP)
+     */
+    SystemPacing(frame_unit period = frame_unit(16666666), FramePacing mode = FramePacing::FIXED_STEP,
+                unsigned int max_catch_up = 4) :
+        period(period), mode(mode), max_catch_up(max_catch_up) {};
+
+    frame_unit period;
+    FramePacing mode;
+    unsigned int max_catch_up;
+};
+
+/** \brief The event notified when a frame of a system ends after the start of the next one
+ *
+ * It is notified when the frame lasted more than a period, or when frames
+ * were dropped.
+ *
+ * Subscribe with event::Dispatcher<FrameOverrun>.
+ */
+struct FrameOverrun {
+    SystemBase* system;
+    // the timepoint of the frame
+    frame_tp frame;
+    // the time spent in HandleEvents() and RunBatch()
+    frame_unit duration;
+    // the delay between the start of the next frame and the end of this one
+    frame_unit lateness;
+    // the number of frames dropped
+    unsigned int skipped;
+};
+
 /** \brief Scheduler for trillek engine
+ *
+ * Each thread owns a work-stealing deque of ready tasks and a timing wheel of
+ * delayed tasks. A thread pops its own tasks first, then the tasks queued from
+ * outside the scheduler, and finally steals from the other threads.
+ *
+ * Each system is a job queued once per frame. The systems registered with
+ * RegisterSystem() without affinity can run on any thread, the other ones
+ * always run on the same thread.
  */
 class TrillekScheduler final {
 public:
     // one frame has a duration of 16666666 nanoseconds
-    TrillekScheduler() : counter(0), one_frame(16666666) {};
+    // delayed tasks are counted in ticks of 1/16 frame
+    TrillekScheduler() : worker_count(0), injection(0), sleepers(0), stop_flag(false), pin_workers(false),
+                        memory_report_period(0), one_frame(16666666), timer_tick(1041666)
+                        SCHEDULER_TELEMETRY(, trace_capacity(0)) {};
     ~TrillekScheduler() {};
 
-    /** \brief Launch the threads and attach them to system
+    /** \brief Register a system to run once per frame
+     *
+     * Must be called before Initialize().
+     *
+     * \param system SystemBase* the system
+     * \param affinity int the index of the thread that must run the system,
+     * -1 to let any thread run it, in which case ThreadInit() is called once
+     * for each thread running the system
+     * \param pacing const SystemPacing& the frame rate and the overrun policy
+     *
+     */
+    void RegisterSystem(SystemBase* system, int affinity = -1, const SystemPacing& pacing = SystemPacing());
+
+    /** \brief Pin each thread to a logical CPU
+     *
+     * Must be called before Initialize(). The threads fill the NUMA nodes one
+     * after the other, one thread per physical core before SMT siblings are
+     * used (see CpuTopology::PlacementOrder()). Pinned threads steal from
+     * the threads of their node first.
      *
-     * \param nr_thread unsigned int number of threads to launch
-     * \param systems std::queue<System*>&& list of systems to attach
+     * \param pin bool true to pin the threads
+     *
+     */
+    void SetWorkerPinning(bool pin) {
+        pin_workers = pin;
+    }
+
+    /** \brief Log the memory taken by each tag periodically
+     *
+     * Must be called before Initialize(). A BACKGROUND task logs
+     * MemoryAccounting::Report() at each period.
+     *
+     * \param period const frame_unit& the period, 0 to disable the report
+     *
+     */
+    void SetMemoryReportPeriod(const frame_unit& period) {
+        memory_report_period = period;
+    }
+
+    /** \brief Launch the threads and run the systems
+     *
+     * The number of threads does not depend on the number of systems. The
+     * function blocks until the threads terminate, then calls Terminate() on
+     * each system.
+     *
+     * \param nr_thread unsigned int number of threads to launch, 0 to launch
+     * one thread per core
+     * \param systems std::queue<System*>& systems to register, each one with
+     * the affinity of a thread, the threads being assigned in turn
      *
      */
     void Initialize(unsigned int nr_thread, std::queue<SystemBase*>& systems);
@@ -195,41 +419,429 @@ public:
      *
      */
     template<class T>
-    void Execute(const std::shared_ptr<TaskRequest<T>>& task) {
+    void Execute(const TaskPtr<TaskRequest<T>>& task) {
         task->RunTask();
     }
 
     /** \brief Queue a task for asynchronous execution
+     *
+     * When called from a thread of the scheduler, the task goes to the queue
+     * of this thread. Otherwise it goes to the shared injection queue.
      *
      * \param task task to execute
      *
      */
     template<class T>
     void Queue(T&& task) {
-        m_queue.lock();
-        taskqueue.push(std::forward<T>(task));
-        m_queue.unlock();
-        queuecheck.notify_one();
+        Dispatch(TaskPtr<TaskRequestBase>(std::forward<T>(task)));
+    }
+
+    /** \brief Execute a function on chunks of a range using all threads
+     *
+     * The range [begin, end) is split in chunks of at least grain elements,
+     * and fn(first, last) is called once per chunk. The calling thread
+     * executes chunks too, and returns when all chunks are done.
+     *
+     * fn must be thread-safe. When the scheduler is not running, all chunks
+     * are executed by the calling thread.
+     *
+     * \param begin size_t the first element of the range
+     * \param end size_t the element after the last one
+     * \param grain size_t the minimal number of elements in a chunk
+     * \param fn F&& the function to call for each chunk
+     *
+     */
+    template<class F>
+    void ParallelFor(size_t begin, size_t end, size_t grain, F&& fn) {
+        const auto chunk = ChunkSize(begin, end, grain);
+        auto run_chunk = [&](size_t i) {
+            fn(begin + i * chunk, (std::min)(end, begin + (i + 1) * chunk));
+        };
+        ParallelRun(chunk ? (end - begin + chunk - 1) / chunk : 0, &RunChunk<decltype(run_chunk)>, &run_chunk);
+    }
+
+    /** \brief Reduce a range using all threads
+     *
+     * The range is split as in ParallelFor(), fn(first, last) returns the
+     * partial result of a chunk, and the partial results are combined in
+     * the order of the chunks with reduce(T&& accumulator, T&& partial).
+     *
+     * \param begin size_t the first element of the range
+     * \param end size_t the element after the last one
+     * \param grain size_t the minimal number of elements in a chunk
+     * \param identity T the initial value of the accumulator
+     * \param fn F&& the function computing a partial result
+     * \param reduce R&& the function combining 2 results
+     * \return T the result
+     *
+     */
+    template<class T, class F, class R>
+    T ParallelReduce(size_t begin, size_t end, size_t grain, T identity, F&& fn, R&& reduce) {
+        const auto chunk = ChunkSize(begin, end, grain);
+        const auto chunks = chunk ? (end - begin + chunk - 1) / chunk : 0;
+        std::vector<T> partials(chunks);
+        auto run_chunk = [&](size_t i) {
+            partials[i] = fn(begin + i * chunk, (std::min)(end, begin + (i + 1) * chunk));
+        };
+        ParallelRun(chunks, &RunChunk<decltype(run_chunk)>, &run_chunk);
+        for (auto& p : partials) {
+            identity = reduce(std::move(identity), std::move(p));
+        }
+        return identity;
     }
 
+    /** \brief Set the number of tasks of a lane that can run at the same time
+     *
+     * It can be changed while the threads run. A task of a full lane stays
+     * queued, the threads run the tasks of the other lanes meanwhile. By
+     * default, BACKGROUND tasks leave one thread to the other lanes, and the
+     * other lanes are not limited.
+     *
+     * \param lane TaskLane the lane
+     * \param limit unsigned int the maximal number of running tasks, 0 for the default
+     *
+     */
+    void SetConcurrencyLimit(TaskLane lane, unsigned int limit);
+
+    /** \brief Get the number of tasks of a lane that can run at the same time
+     *
+     */
+    unsigned int ConcurrencyLimit(TaskLane lane) const;
+
+    /** \brief Launch a graph of tasks
+     *
+     * The nodes without predecessors are queued, the other ones are queued
+     * when their predecessors are finished.
+     *
+     * \param graph TaskGraph& the graph
+     * \param frame frame_tp the frame number copied in the report of the graph
+     * \return bool false if the graph is running, empty or has a cycle
+     *
+     */
+    bool Launch(TaskGraph& graph, frame_tp frame = 0);
+
+    /** \brief Get the current time of the scheduler
+     *
+     */
+    static scheduler_tp Now();
+
+    /** \brief Set the clock giving the time to the schedulers and to the tasks
+     *
+     * The clock is shared by all schedulers since the tasks read the time
+     * without knowing their scheduler. It must be set while no scheduler is
+     * running, and outlive the runs using it.
+     *
+     * \param clock SchedulerClock* the clock, nullptr for the wall time
+     *
+     */
+    static void SetClock(SchedulerClock* clock);
+
+    /** \brief Get the duration of a frame
+     *
+     */
+    frame_unit FrameDuration() const {
+        return one_frame;
+    }
+
+    /** \brief Start a coroutine on the threads of the scheduler
+     *
+     * The coroutine is detached: it is destroyed when it returns.
+     *
+     * \param coroutine C&& a CoTask (see coroutine-task.hpp)
+     * \param affinity int the thread resuming the coroutine, -1 for any thread
+     *
+     */
+    template<class C>
+    void Spawn(C&& coroutine, int affinity = -1) {
+        std::forward<C>(coroutine).Start(*this, affinity);
+    }
+
+    /** \brief Cancel a delayed task that has not been run yet
+     *
+     * \param task the task to cancel
+     * \return bool true if the task was removed, false if it is already
+     * running, done or not delayed
+     *
+     */
+    bool Cancel(const TaskPtr<TaskRequestBase>& task);
+
+    /** \brief Ask all threads to terminate
+     *
+     * The threads stop as if the terminate flag of the game was set.
+     */
+    void Stop();
+
+    /** \brief Block until the threads of Initialize() are created
+     *
+     * Returns also when Stop() is called. Tasks can be queued before, but
+     * parallel loops run inline until the threads are created.
+     */
+    void WaitStarted();
+
+#ifdef TRILLEK_TELEMETRY
+    /** \brief Get the telemetry recorded since the threads started
+     *
+     * Can be called while the threads are running.
+     *
+     * \return TelemetryReport the utilisation and the contention counters of
+     * each thread, the latencies of each type of task and the frame times of
+     * each system
+     *
+     */
+    TelemetryReport Telemetry() const;
+
+    /** \brief Record the spans of the tasks and of the frames of the systems
+     *
+     * Each thread keeps its last spans in a ring.
+     *
+     * \param capacity size_t the number of spans kept per thread, 0 to stop
+     *
+     */
+    void SetTrace(size_t capacity);
+
+    /** \brief Write the spans recorded as Chrome trace-event JSON
+     *
+     * \param out std::ostream& the stream
+     *
+     */
+    void WriteChromeTrace(std::ostream& out) const;
+#endif
+
 private:
 
+    /** \brief The queues owned by a thread
+     */
+    struct Worker {
+        Worker(uint64_t tick) : wheel(tick),
+            next_expiry((std::numeric_limits<uint64_t>::max)()) {};
+
+        // tasks ready to run, shared with thieves, by lane
+        WorkStealingQueue<TaskPtr<TaskRequestBase>> ready[TASK_LANES];
+        // tasks ready to run that only this thread can run, by lane
+        WorkStealingQueue<TaskPtr<TaskRequestBase>> pinned[TASK_LANES];
+        // tasks waiting for their timepoint
+        TimingWheel<TaskRequestBase> wheel;
+        // protects the wheel
+        std::mutex m_wheel;
+        // tick when the wheel must be advanced, readable without lock
+        std::atomic<uint64_t> next_expiry;
+        // the workers to steal from, the closest first
+        std::vector<unsigned int> victims;
+        SCHEDULER_TELEMETRY(WorkerTelemetry telemetry;)
+    };
+
+    /** \brief The admission of the tasks of a lane
+     */
+    struct LaneAdmission {
+        LaneAdmission() : running(0), limit((std::numeric_limits<unsigned int>::max)()), requested(0) {};
+
+        std::atomic<unsigned int> running;
+        std::atomic<unsigned int> limit;
+        // the limit set by the user, 0 for the default
+        std::atomic<unsigned int> requested;
+    };
+
+    /** \brief A system and its frame
+     */
+    struct SystemJob {
+        SystemJob(SystemBase* system, int affinity, const SystemPacing& pacing, MemoryTag memory_tag) :
+            system(system), affinity(affinity), pacing(pacing), memory_tag(memory_tag) {};
+
+        SystemBase* const system;
+        const int affinity;
+        const SystemPacing pacing;
+        // the tag charged with the allocations of the frames
+        const MemoryTag memory_tag;
+        // the frame to run next
+        scheduler_tp next_frame;
+        // threads on which ThreadInit() was called
+        std::vector<bool> initialized;
+        SCHEDULER_TELEMETRY(SystemTelemetry telemetry;)
+    };
+
     /** \brief Main loop of each thread
      *
-     * \param now start time
-     * \param system SystemBase* system to attach
+     * \param id unsigned int the index of the worker
      *
      */
-    void DayWork(const scheduler_tp& now, SystemBase* system);
+    void DayWork(unsigned int id);
 
-    std::priority_queue<std::shared_ptr<TaskRequestBase>> taskqueue;
-    std::condition_variable countercheck;
-    std::atomic<int> counter;
-    std::mutex m_count;
-    std::mutex m_queue;
-    std::mutex m_timer;
+    /** \brief Run one frame of a system and queue the next one
+     *
+     * \param job SystemJob& the system
+     *
+     */
+    void RunSystem(SystemJob& job);
+
+    /** \brief Compute the next frame of a system and report an overrun
+     *
+     * \param job SystemJob& the system
+     * \param start const scheduler_tp& the time when the frame started
+     * \param end const scheduler_tp& the time when the frame ended
+     *
+     */
+    void PaceSystem(SystemJob& job, const scheduler_tp& start, const scheduler_tp& end);
+
+    /** \brief Queue the next frame of a system
+     *
+     * \param job SystemJob& the system
+     *
+     */
+    void QueueSystem(SystemJob& job);
+
+    /** \brief Queue the next memory report
+     *
+     */
+    void QueueMemoryReport();
+
+    /** \brief Drop all tasks still queued when the threads are stopped
+     *
+     */
+    void ClearQueues();
+
+    /** \brief Put a task in the right queue and wake up a thread
+     *
+     * \param task the task to queue
+     *
+     */
+    void Dispatch(TaskPtr<TaskRequestBase>&& task);
+
+    /** \brief Move the delayed tasks whose timepoint is reached to the ready queue
+     *
+     * The wheel of the worker and the wheel of the injection queue are
+     * advanced, then the due wheels of the other workers that are not locked,
+     * so that a worker running a long task does not delay its timers.
+     *
+     * \param id unsigned int the index of the worker
+     * \param now const scheduler_tp& the current time
+     *
+     */
+    void PromoteDelayed(unsigned int id, const scheduler_tp& now);
+
+    /** \brief Expire the due tasks of a wheel into a ready queue
+     *
+     * The lock of the wheel must be held.
+     *
+     * \param wheel Worker& the owner of the wheel
+     * \param ready Worker& the owner of the ready queue
+     * \param now const scheduler_tp& the current time
+     * \return size_t the number of tasks expired
+     *
+     */
+    size_t ExpireWheel(Worker& wheel, Worker& ready, const scheduler_tp& now);
+
+    /** \brief Convert a timepoint to a tick of the timing wheels
+     *
+     * \param tp const scheduler_tp& the timepoint
+     * \return uint64_t the tick containing tp
+     *
+     */
+    uint64_t Tick(const scheduler_tp& tp) const {
+        return static_cast<uint64_t>(tp.time_since_epoch().count() / timer_tick.count());
+    }
+
+    /** \brief Get a task: pinned tasks, own queue, then injection queue, then steal
+     *
+     * \param id unsigned int the index of the worker
+     * \param task TaskPtr<TaskRequestBase>& placeholder for the task
+     * \return bool true if a task was found
+     *
+     */
+    bool FindTask(unsigned int id, TaskPtr<TaskRequestBase>& task);
+
+    /** \brief Get a task of a lane
+     *
+     * \param id unsigned int the index of the worker
+     * \param lane unsigned int the lane
+     * \param task TaskPtr<TaskRequestBase>& placeholder for the task
+     * \return bool true if a task was found
+     *
+     */
+    bool FindLaneTask(unsigned int id, unsigned int lane, TaskPtr<TaskRequestBase>& task);
+
+    /** \brief Tell if a task can be picked up by a thread
+     *
+     * The tasks of the full lanes are ignored.
+     *
+     * \param id unsigned int the index of the worker
+     */
+    bool HasReadyTask(unsigned int id) const;
+
+    /** \brief Count a running task in a lane if the lane is not full
+     *
+     * \param lane unsigned int the lane
+     * \return bool false if the lane is full
+     */
+    bool Admit(unsigned int lane);
+
+    /** \brief Count a task of a lane as done, and wake up the threads if the lane was full
+     *
+     * \param lane unsigned int the lane
+     */
+    void Release(unsigned int lane);
+
+    /** \brief Compute the limit of a lane from the limit requested
+     *
+     * \param lane unsigned int the lane
+     */
+    void UpdateLimit(unsigned int lane);
+
+    /** \brief Wake up one sleeping thread, if any
+     *
+     */
+    void WakeOne();
+
+    /** \brief Compute the size of the chunks of a parallel range
+     *
+     * There are at most 4 chunks per thread.
+     *
+     * \return size_t the number of elements per chunk, 0 if the range is empty
+     */
+    size_t ChunkSize(size_t begin, size_t end, size_t grain) const;
+
+    typedef void (*chunk_fn)(void*, size_t);
+
+    /** \brief Execute a chunk with the callable of a parallel range
+     *
+     */
+    template<class F>
+    static void RunChunk(void* context, size_t i) {
+        (*static_cast<F*>(context))(i);
+    }
+
+    /** \brief Execute chunks on all threads and wait for them
+     *
+     * \param chunks size_t the number of chunks
+     * \param run_chunk chunk_fn the function executing a chunk
+     * \param context void* the first argument of run_chunk
+     *
+     */
+    void ParallelRun(size_t chunks, chunk_fn run_chunk, void* context);
+
+    /** \brief Tell if the threads must terminate
+     *
+     */
+    bool StopRequested() const;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    // the size of workers, published once the workers are built, 0 when the
+    // scheduler does not run. Threads not belonging to the scheduler read it
+    // instead of workers.size().
+    std::atomic<size_t> worker_count;
+    std::vector<std::unique_ptr<SystemJob>> system_jobs;
+    // tasks queued by threads not belonging to the scheduler
+    Worker injection;
+    LaneAdmission lanes[TASK_LANES];
+    // blocking point of idle threads
+    std::mutex m_sleep;
     std::condition_variable queuecheck;
+    std::atomic<unsigned int> sleepers;
+    std::atomic<bool> stop_flag;
+    bool pin_workers;
+    frame_unit memory_report_period;
     const frame_unit one_frame;
+    const frame_unit timer_tick;
+    SCHEDULER_TELEMETRY(std::atomic<size_t> trace_capacity;)
 };
 }
 
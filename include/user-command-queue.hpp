@@ -1,7 +1,9 @@
 #ifndef COMMANDQUEUE_HPP_INCLUDED
 #define COMMANDQUEUE_HPP_INCLUDED
 
-#include "atomic-map.hpp"
+#include <algorithm>
+#include <map>
+#include "concurrent-map.hpp"
 
 namespace trillek {
 
@@ -36,7 +38,12 @@ public:
      *
      */
     std::pair<command_iterator,command_iterator> GetAndTagCommandsFrom(frame_tp from) {
-        for (auto& usercommand : temp_command_list.Poll()) {
+        auto commands = temp_command_list.Poll();
+        // keep the order of the ids, Poll() does not sort them
+        std::sort(commands.begin(), commands.end(), [](const command_pair& a, const command_pair& b) {
+            return a.first < b.first;
+        });
+        for (auto& usercommand : commands) {
             command_queue.insert(std::make_pair(std::move(from), std::move(usercommand)));
         }
         return command_queue.equal_range(from);
@@ -67,7 +74,7 @@ private:
     // The underlying storage
     usercommand_map_type command_queue;
     // the temporary storage
-    AtomicMap<id_t,std::shared_ptr<component::Container>> temp_command_list;
+    ConcurrentMap<id_t,std::shared_ptr<component::Container>> temp_command_list;
 };
 
 } //namespace trillek
@@ -0,0 +1,179 @@
+#ifndef BITKERNELS_HPP_INCLUDED
+#define BITKERNELS_HPP_INCLUDED
+
+#include <cstddef>
+#include <stdint.h>
+#include "util/utiltype.hpp"
+
+// The kernels use the instruction sets enabled at compile time: SSE2 on all
+// x86-64 targets, AVX2 with -mavx2 or /arch:AVX2. Define TRILLEK_NO_SIMD to
+// use the scalar versions.
+#if ! defined(TRILLEK_NO_SIMD)
+#if defined(__AVX2__)
+#define TRILLEK_BITS_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRILLEK_BITS_SSE2
+#endif
+#endif
+
+#if defined(TRILLEK_BITS_AVX2)
+#include <immintrin.h>
+#elif defined(TRILLEK_BITS_SSE2)
+#include <emmintrin.h>
+#endif
+
+namespace trillek {
+namespace util {
+
+/** \brief The AND operation of the bit kernels
+ */
+struct BitAnd {
+    template<class T>
+    T operator()(T a, T b) const { return a & b; }
+#if defined(TRILLEK_BITS_SSE2)
+    __m128i operator()(__m128i a, __m128i b) const { return _mm_and_si128(a, b); }
+#endif
+#if defined(TRILLEK_BITS_AVX2)
+    __m256i operator()(__m256i a, __m256i b) const { return _mm256_and_si256(a, b); }
+#endif
+};
+
+/** \brief The OR operation of the bit kernels
+ */
+struct BitOr {
+    template<class T>
+    T operator()(T a, T b) const { return a | b; }
+#if defined(TRILLEK_BITS_SSE2)
+    __m128i operator()(__m128i a, __m128i b) const { return _mm_or_si128(a, b); }
+#endif
+#if defined(TRILLEK_BITS_AVX2)
+    __m256i operator()(__m256i a, __m256i b) const { return _mm256_or_si256(a, b); }
+#endif
+};
+
+/** \brief The XOR operation of the bit kernels
+ */
+struct BitXor {
+    template<class T>
+    T operator()(T a, T b) const { return a ^ b; }
+#if defined(TRILLEK_BITS_SSE2)
+    __m128i operator()(__m128i a, __m128i b) const { return _mm_xor_si128(a, b); }
+#endif
+#if defined(TRILLEK_BITS_AVX2)
+    __m256i operator()(__m256i a, __m256i b) const { return _mm256_xor_si256(a, b); }
+#endif
+};
+
+/** \brief Combine 2 arrays of blocks: dst[i] = op(dst[i], src[i])
+ *
+ * The arrays can be the same, they must not overlap otherwise.
+ *
+ * \param dst T* the first operand and the result
+ * \param src const T* the second operand
+ * \param n size_t the number of blocks
+ * \param op Op the operation, BitAnd, BitOr or BitXor
+ */
+template<class Op, class T>
+void MixBlocks(T* dst, const T* src, size_t n, Op op) {
+    size_t i = 0;
+#if defined(TRILLEK_BITS_AVX2)
+    for (; i + 32 / sizeof(T) <= n; i += 32 / sizeof(T)) {
+        const auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        const auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), op(a, b));
+    }
+#endif
+#if defined(TRILLEK_BITS_SSE2)
+    for (; i + 16 / sizeof(T) <= n; i += 16 / sizeof(T)) {
+        const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        const auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), op(a, b));
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = op(dst[i], src[i]);
+    }
+}
+
+/** \brief Invert an array of blocks: dst[i] = ~src[i]
+ *
+ * \param dst T* the result, can be src
+ * \param src const T* the blocks
+ * \param n size_t the number of blocks
+ */
+template<class T>
+void NotBlocks(T* dst, const T* src, size_t n) {
+    size_t i = 0;
+#if defined(TRILLEK_BITS_AVX2)
+    const auto ones256 = _mm256_set1_epi32(-1);
+    for (; i + 32 / sizeof(T) <= n; i += 32 / sizeof(T)) {
+        const auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_xor_si256(a, ones256));
+    }
+#endif
+#if defined(TRILLEK_BITS_SSE2)
+    const auto ones128 = _mm_set1_epi32(-1);
+    for (; i + 16 / sizeof(T) <= n; i += 16 / sizeof(T)) {
+        const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(a, ones128));
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = ~src[i];
+    }
+}
+
+/** \brief Count the bits set in an array of blocks
+ *
+ * AVX2 counts the nibbles with a lookup table. Without AVX2, the popcnt
+ * instruction is used when it is enabled, else SSE2 adds the bits in
+ * parallel.
+ *
+ * \param data const T* the blocks
+ * \param n size_t the number of blocks
+ * \return size_t the number of bits set
+ */
+template<class T>
+size_t PopCountBlocks(const T* data, size_t n) {
+    size_t i = 0;
+    size_t sum = 0;
+#if defined(TRILLEK_BITS_AVX2)
+    const auto lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                         0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const auto low_mask = _mm256_set1_epi8(0x0f);
+    auto acc = _mm256_setzero_si256();
+    for (; i + 32 / sizeof(T) <= n; i += 32 / sizeof(T)) {
+        const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        const auto lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low_mask));
+        const auto hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask));
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256()));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc);
+    sum += static_cast<size_t>(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+#elif defined(TRILLEK_BITS_SSE2) && ! defined(__POPCNT__)
+    const auto m1 = _mm_set1_epi8(0x55);
+    const auto m2 = _mm_set1_epi8(0x33);
+    const auto m4 = _mm_set1_epi8(0x0f);
+    auto acc = _mm_setzero_si128();
+    for (; i + 16 / sizeof(T) <= n; i += 16 / sizeof(T)) {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        v = _mm_sub_epi8(v, _mm_and_si128(_mm_srli_epi64(v, 1), m1));
+        v = _mm_add_epi8(_mm_and_si128(v, m2), _mm_and_si128(_mm_srli_epi64(v, 2), m2));
+        v = _mm_and_si128(_mm_add_epi8(v, _mm_srli_epi64(v, 4)), m4);
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(v, _mm_setzero_si128()));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+    sum += static_cast<size_t>(lanes[0] + lanes[1]);
+#endif
+    for (; i < n; ++i) {
+        sum += PopCount<T>(data[i]);
+    }
+    return sum;
+}
+} // util
+} // trillek
+
+#endif // BITKERNELS_HPP_INCLUDED
@@ -8,6 +8,10 @@
 #include <stdint.h>
 #include <memory>
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 namespace trillek {
 namespace util {
 
@@ -315,15 +319,66 @@ inline uint32_t Ctz<uint32_t>(uint32_t value) {
         unsigned long ret;
         _BitScanForward(&ret, value);
         return ret;
+#else
+        uint32_t ret = 0;
+        while (ret < 32 && ! (value & 1)) {
+            value >>= 1;
+            ++ret;
+        }
+        return ret;
 #endif
 }
 
-#if defined(__GNUG__)
 template<>
 inline uint32_t Ctz<uint64_t>(uint64_t value) {
+#if defined(__GNUG__)
         return static_cast<uint32_t>(__builtin_ctzll(value));
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+        unsigned long ret;
+        _BitScanForward64(&ret, value);
+        return ret;
+#else
+        // no 64-bit scan, e.g. on 32-bit MSVC
+        const uint32_t low = static_cast<uint32_t>(value);
+        return low ? Ctz<uint32_t>(low) : 32 + Ctz<uint32_t>(static_cast<uint32_t>(value >> 32));
+#endif
 }
+
+template<class T>
+inline uint32_t Clz(T);
+
+template<>
+inline uint32_t Clz<uint32_t>(uint32_t value) {
+#if defined(__GNUG__)
+        return static_cast<uint32_t>(__builtin_clz(value));
+#elif defined(_MSC_VER)
+        unsigned long ret;
+        _BitScanReverse(&ret, value);
+        return 31 - ret;
+#else
+        uint32_t ret = 0;
+        while (ret < 32 && ! (value & 0x80000000u)) {
+            value <<= 1;
+            ++ret;
+        }
+        return ret;
+#endif
+}
+
+template<>
+inline uint32_t Clz<uint64_t>(uint64_t value) {
+#if defined(__GNUG__)
+        return static_cast<uint32_t>(__builtin_clzll(value));
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+        unsigned long ret;
+        _BitScanReverse64(&ret, value);
+        return 63 - ret;
+#else
+        // no 64-bit scan, e.g. on 32-bit MSVC
+        const uint32_t high = static_cast<uint32_t>(value >> 32);
+        return high ? Clz<uint32_t>(high) : 32 + Clz<uint32_t>(static_cast<uint32_t>(value));
 #endif
+}
 
 template<class T>
 inline unsigned int Log2Bin();
@@ -0,0 +1,140 @@
+#ifndef WORKSTEALINGQUEUE_HPP_INCLUDED
+#define WORKSTEALINGQUEUE_HPP_INCLUDED
+
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+namespace trillek {
+
+/** \brief A double-ended queue owned by one worker and shared with thieves
+ *
+ * The owner pushes and pops at the back (LIFO, hot in cache), other workers
+ * steal at the front (FIFO, oldest task first). Each queue has its own lock,
+ * so workers only contend when they actually steal from each other.
+ *
+ * The number of elements is mirrored in an atomic to let idle workers scan
+ * the queues without taking any lock.
+ *
+ * Elements are stored in a ring buffer that doubles when it is full and
+ * never shrinks, so a queue in steady state does not allocate memory.
+ */
+template<class T>
+class WorkStealingQueue final {
+
+    public:
+
+        /** \brief Default constructor
+         *
+         */
+        WorkStealingQueue() : head(0), count(0) {};
+
+        /** \brief Destructor
+         *
+         */
+        ~WorkStealingQueue() {};
+
+        // disable copy functions
+        WorkStealingQueue(WorkStealingQueue&) = delete;
+        WorkStealingQueue& operator=(WorkStealingQueue&) = delete;
+
+        /** \brief Put an element at the back of the queue
+         *
+         * \param element U&& element to put in the queue
+         */
+        template<class U>
+        void Push(U&& element) const {
+            std::unique_lock<std::mutex> locker(mtx);
+            const auto size = count.load();
+            if (size == q.size()) {
+                Grow();
+            }
+            q[(head + size) & (q.size() - 1)] = std::forward<U>(element);
+            count.fetch_add(1);
+        }
+
+        /** \brief Pop an element from the back of the queue (owner side)
+         *
+         * \param element T& reference that will contain the element popped
+         * \return bool true if an element was popped, false otherwise
+         */
+        bool Pop(T& element) const {
+            if (! count.load()) {
+                return false;
+            }
+            std::unique_lock<std::mutex> locker(mtx);
+            const auto size = count.load();
+            if (! size) {
+                return false;
+            }
+            element = std::move(q[(head + size - 1) & (q.size() - 1)]);
+            count.fetch_sub(1);
+            return true;
+        }
+
+        /** \brief Steal an element from the front of the queue (thief side)
+         *
+         * \param element T& reference that will contain the element stolen
+         * \return bool true if an element was stolen, false otherwise
+         */
+        bool Steal(T& element) const {
+            if (! count.load()) {
+                return false;
+            }
+            std::unique_lock<std::mutex> locker(mtx);
+            if (! count.load()) {
+                return false;
+            }
+            element = std::move(q[head]);
+            head = (head + 1) & (q.size() - 1);
+            count.fetch_sub(1);
+            return true;
+        }
+
+        /** \brief Test if the queue is empty without locking
+         *
+         * \return bool true if the queue is empty, false otherwise
+         *
+         */
+        bool Empty() const {
+            return count.load() == 0;
+        }
+
+        /** \brief Get the number of elements without locking
+         *
+         * \return size_t the number of elements
+         *
+         */
+        size_t Size() const {
+            return count.load();
+        }
+
+    private:
+
+        /** \brief Double the capacity of the ring buffer
+         *
+         * The lock must be held.
+         */
+        void Grow() const {
+            const auto size = count.load();
+            std::vector<T> bigger((std::max)(size * 2, size_t(64)));
+            for (size_t i = 0; i < size; ++i) {
+                bigger[i] = std::move(q[(head + i) & (q.size() - 1)]);
+            }
+            q.swap(bigger);
+            head = 0;
+        }
+
+        // the ring buffer, its size is a power of 2
+        mutable std::vector<T> q;
+        // index of the front element
+        mutable size_t head;
+        // the mutex protecting the queue
+        mutable std::mutex mtx;
+        // number of elements in the queue
+        mutable std::atomic<size_t> count;
+};
+}
+
+#endif // WORKSTEALINGQUEUE_HPP_INCLUDED
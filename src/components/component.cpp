@@ -30,6 +30,13 @@ struct ContainerRef<Shared> {
 
 Shared& ContainerRef<Shared>::container = TrillekGame::GetSharedComponent();
 
+template<>
+struct ContainerRef<TrillekScheduler> {
+    static TrillekScheduler& container;
+};
+
+TrillekScheduler& ContainerRef<TrillekScheduler>::container = TrillekGame::GetScheduler();
+
 template<>
 std::shared_ptr<Container> Initialize<Component::VelocityMax>(const std::vector<Property> &properties) {
     glm::vec3 lmax(0.0f,0.0f,0.0f), amax(0.0f,0.0f,0.0f);
@@ -0,0 +1,418 @@
+#include "compressed-bitmap.hpp"
+#include <iterator>
+#include "util/bit-kernels.hpp"
+
+namespace trillek {
+
+const size_t CompressedBitMap::CHUNK_BITS;
+const size_t CompressedBitMap::ARRAY_MAX;
+const size_t CompressedBitMap::BITSET_WORDS;
+
+namespace {
+// a chunk stored as a bitset
+typedef uint64_t ChunkWords[CompressedBitMap::BITSET_WORDS];
+
+/** \brief Count the runs of consecutive bits of a bitset
+ *
+ */
+size_t CountRuns(const uint64_t* words) {
+    size_t runs = 0;
+    uint64_t carry = 0;
+    for (size_t w = 0; w < CompressedBitMap::BITSET_WORDS; ++w) {
+        // the first bit of each run
+        runs += util::PopCount<uint64_t>(words[w] & ~((words[w] << 1) | carry));
+        carry = words[w] >> 63;
+    }
+    return runs;
+}
+}
+
+bool CompressedBitMap::Container::Contains(uint16_t low) const {
+    switch (kind) {
+    case ARRAY:
+        return std::binary_search(values.begin(), values.end(), low);
+    case BITSET:
+        return (words[low >> 6] >> (low & 63)) & 1;
+    case RUN: {
+        // the last run starting before low
+        size_t lo = 0, hi = values.size() / 2;
+        while (lo < hi) {
+            const auto mid = (lo + hi) / 2;
+            if (values[2 * mid] <= low) {
+                lo = mid + 1;
+            }
+            else {
+                hi = mid;
+            }
+        }
+        return lo && low <= values[2 * lo - 1];
+    }
+    }
+    return false;
+}
+
+bool CompressedBitMap::Container::Insert(uint16_t low) {
+    if (kind == RUN) {
+        if (Contains(low)) {
+            return false;
+        }
+        ChunkWords chunk;
+        ToWords(chunk);
+        FromWords(chunk, false);
+    }
+    if (kind == ARRAY) {
+        auto it = std::lower_bound(values.begin(), values.end(), low);
+        if (it != values.end() && *it == low) {
+            return false;
+        }
+        values.insert(it, low);
+        ++cardinality;
+        if (cardinality > ARRAY_MAX) {
+            ChunkWords chunk;
+            ToWords(chunk);
+            FromWords(chunk, false);
+        }
+        return true;
+    }
+    auto& word = words[low >> 6];
+    const auto mask = uint64_t(1) << (low & 63);
+    if (word & mask) {
+        return false;
+    }
+    word |= mask;
+    ++cardinality;
+    return true;
+}
+
+bool CompressedBitMap::Container::Remove(uint16_t low) {
+    if (kind == RUN) {
+        if (! Contains(low)) {
+            return false;
+        }
+        ChunkWords chunk;
+        ToWords(chunk);
+        FromWords(chunk, false);
+    }
+    if (kind == ARRAY) {
+        auto it = std::lower_bound(values.begin(), values.end(), low);
+        if (it == values.end() || *it != low) {
+            return false;
+        }
+        values.erase(it);
+        --cardinality;
+        return true;
+    }
+    auto& word = words[low >> 6];
+    const auto mask = uint64_t(1) << (low & 63);
+    if (! (word & mask)) {
+        return false;
+    }
+    word &= ~mask;
+    --cardinality;
+    // half of ARRAY_MAX, so that a chunk does not switch back and forth
+    if (cardinality <= ARRAY_MAX / 2) {
+        ChunkWords chunk;
+        ToWords(chunk);
+        FromWords(chunk, false);
+    }
+    return true;
+}
+
+size_t CompressedBitMap::Container::CountBelow(uint32_t low) const {
+    switch (kind) {
+    case ARRAY:
+        return std::lower_bound(values.begin(), values.end(), low) - values.begin();
+    case BITSET: {
+        auto count = util::PopCountBlocks(words.data(), low >> 6);
+        if (low & 63) {
+            count += util::PopCount<uint64_t>(words[low >> 6] & ((uint64_t(1) << (low & 63)) - 1));
+        }
+        return count;
+    }
+    case RUN: {
+        size_t count = 0;
+        for (size_t r = 0; r < values.size() && values[r] < low; r += 2) {
+            count += (std::min)(uint32_t(values[r + 1]) + 1, low) - values[r];
+        }
+        return count;
+    }
+    }
+    return 0;
+}
+
+void CompressedBitMap::Container::ToWords(uint64_t* out) const {
+    if (kind == BITSET) {
+        std::copy(words.begin(), words.end(), out);
+        return;
+    }
+    std::fill(out, out + BITSET_WORDS, 0);
+    if (kind == ARRAY) {
+        for (auto low : values) {
+            out[low >> 6] |= uint64_t(1) << (low & 63);
+        }
+        return;
+    }
+    for (size_t r = 0; r < values.size(); r += 2) {
+        for (uint32_t low = values[r]; low <= values[r + 1]; ++low) {
+            out[low >> 6] |= uint64_t(1) << (low & 63);
+        }
+    }
+}
+
+void CompressedBitMap::Container::FromWords(const uint64_t* in, bool runs) {
+    cardinality = static_cast<uint32_t>(util::PopCountBlocks(in, BITSET_WORDS));
+    const auto array_bytes = cardinality * sizeof(uint16_t);
+    const auto bitset_bytes = BITSET_WORDS * sizeof(uint64_t);
+    const auto run_bytes = runs ? CountRuns(in) * 2 * sizeof(uint16_t) : bitset_bytes;
+    values.clear();
+    if (run_bytes < (std::min)(array_bytes, bitset_bytes)) {
+        kind = RUN;
+        std::vector<uint64_t>().swap(words);
+        bool in_run = false;
+        for (uint32_t low = 0; low < CHUNK_BITS; ++low) {
+            const bool bit = (in[low >> 6] >> (low & 63)) & 1;
+            if (bit && ! in_run) {
+                values.push_back(static_cast<uint16_t>(low));
+            }
+            else if (! bit && in_run) {
+                values.push_back(static_cast<uint16_t>(low - 1));
+            }
+            in_run = bit;
+        }
+        if (in_run) {
+            values.push_back(static_cast<uint16_t>(CHUNK_BITS - 1));
+        }
+    }
+    else if (cardinality <= ARRAY_MAX) {
+        kind = ARRAY;
+        std::vector<uint64_t>().swap(words);
+        values.reserve(cardinality);
+        for (uint32_t w = 0; w < BITSET_WORDS; ++w) {
+            auto word = in[w];
+            while (word) {
+                values.push_back(static_cast<uint16_t>(w * 64 + util::Ctz<uint64_t>(word)));
+                word &= word - 1;
+            }
+        }
+    }
+    else {
+        kind = BITSET;
+        words.assign(in, in + BITSET_WORDS);
+    }
+    values.shrink_to_fit();
+}
+
+size_t CompressedBitMap::Container::Bytes() const {
+    return values.capacity() * sizeof(uint16_t) + words.capacity() * sizeof(uint64_t);
+}
+
+void CompressedBitMap::Builder::Add(size_t first_bit, uint64_t word) {
+    const auto chunk_key = first_bit / CHUNK_BITS;
+    if (! empty && chunk_key != key) {
+        Flush();
+    }
+    key = chunk_key;
+    empty = false;
+    const auto low = first_bit % CHUNK_BITS;
+    words[low >> 6] |= word << (low & 63);
+}
+
+void CompressedBitMap::Builder::Flush() {
+    if (empty) {
+        return;
+    }
+    Chunk chunk;
+    chunk.key = key;
+    chunk.container.FromWords(words.data(), true);
+    target.chunks.push_back(std::move(chunk));
+    std::fill(words.begin(), words.end(), 0);
+    empty = true;
+}
+
+bool CompressedBitMap::at(size_t idx) const {
+    auto it = LowerBound(idx / CHUNK_BITS);
+    if (it == chunks.end() || it->key != idx / CHUNK_BITS) {
+        return def_value;
+    }
+    return it->container.Contains(static_cast<uint16_t>(idx % CHUNK_BITS)) != def_value;
+}
+
+void CompressedBitMap::Set(size_t idx, bool b) {
+    if (idx >= bsize) {
+        bsize = idx + 1;
+    }
+    const auto key = idx / CHUNK_BITS;
+    const auto low = static_cast<uint16_t>(idx % CHUNK_BITS);
+    auto it = chunks.begin() + (LowerBound(key) - chunks.cbegin());
+    const bool found = it != chunks.end() && it->key == key;
+    if (b != def_value) {
+        if (! found) {
+            Chunk chunk;
+            chunk.key = key;
+            it = chunks.insert(it, std::move(chunk));
+        }
+        it->container.Insert(low);
+    }
+    else if (found && it->container.Remove(low) && ! it->container.cardinality) {
+        chunks.erase(it);
+    }
+}
+
+size_t CompressedBitMap::countTrue() const {
+    size_t exceptions = 0;
+    const auto last_key = bsize / CHUNK_BITS;
+    for (auto& chunk : chunks) {
+        if (chunk.key < last_key) {
+            exceptions += chunk.container.cardinality;
+        }
+        else if (chunk.key == last_key) {
+            exceptions += chunk.container.CountBelow(static_cast<uint32_t>(bsize % CHUNK_BITS));
+        }
+    }
+    return def_value ? bsize - exceptions : exceptions;
+}
+
+void CompressedBitMap::Optimize() {
+    ChunkWords words;
+    for (auto& chunk : chunks) {
+        chunk.container.ToWords(words);
+        chunk.container.FromWords(words, true);
+    }
+}
+
+size_t CompressedBitMap::MemoryUsage() const {
+    size_t bytes = chunks.capacity() * sizeof(Chunk);
+    for (auto& chunk : chunks) {
+        bytes += chunk.container.Bytes();
+    }
+    return bytes;
+}
+
+bool CompressedBitMap::CombineContainers(const Container& a, const Container& b, Operation op, Container& result) {
+    if (a.kind == Container::ARRAY && b.kind == Container::ARRAY) {
+        std::vector<uint16_t> values;
+        switch (op) {
+        case Operation::AND:
+            std::set_intersection(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(), std::back_inserter(values));
+            break;
+        case Operation::OR:
+            std::set_union(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(), std::back_inserter(values));
+            break;
+        case Operation::XOR:
+            std::set_symmetric_difference(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(), std::back_inserter(values));
+            break;
+        case Operation::AND_NOT:
+            std::set_difference(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(), std::back_inserter(values));
+            break;
+        }
+        if (values.size() <= ARRAY_MAX) {
+            result.kind = Container::ARRAY;
+            result.cardinality = static_cast<uint32_t>(values.size());
+            result.values = std::move(values);
+            return result.cardinality != 0;
+        }
+    }
+    ChunkWords left, right;
+    a.ToWords(left);
+    b.ToWords(right);
+    switch (op) {
+    case Operation::AND:
+        util::MixBlocks(left, right, BITSET_WORDS, util::BitAnd());
+        break;
+    case Operation::OR:
+        util::MixBlocks(left, right, BITSET_WORDS, util::BitOr());
+        break;
+    case Operation::XOR:
+        util::MixBlocks(left, right, BITSET_WORDS, util::BitXor());
+        break;
+    case Operation::AND_NOT:
+        util::NotBlocks(right, right, BITSET_WORDS);
+        util::MixBlocks(left, right, BITSET_WORDS, util::BitAnd());
+        break;
+    }
+    result.FromWords(left, true);
+    return result.cardinality != 0;
+}
+
+std::vector<CompressedBitMap::Chunk> CompressedBitMap::Combine(const std::vector<Chunk>& a,
+                                                               const std::vector<Chunk>& b, Operation op) {
+    std::vector<Chunk> result;
+    // chunks of a single side are kept by OR and XOR, and by AND_NOT for a
+    const bool keep_a = op != Operation::AND;
+    const bool keep_b = op == Operation::OR || op == Operation::XOR;
+    auto i = a.begin();
+    auto j = b.begin();
+    while (i != a.end() || j != b.end()) {
+        if (j == b.end() || (i != a.end() && i->key < j->key)) {
+            if (keep_a) {
+                result.push_back(*i);
+            }
+            ++i;
+        }
+        else if (i == a.end() || j->key < i->key) {
+            if (keep_b) {
+                result.push_back(*j);
+            }
+            ++j;
+        }
+        else {
+            Chunk chunk;
+            chunk.key = i->key;
+            if (CombineContainers(i->container, j->container, op, chunk.container)) {
+                result.push_back(std::move(chunk));
+            }
+            ++i;
+            ++j;
+        }
+    }
+    return result;
+}
+
+// A bitmap is the default value XOR its exceptions E. With the default
+// values da and db, a AND b is:
+// - Ea AND Eb if da and db are false,
+// - Eb AND NOT Ea if only da is true, Ea AND NOT Eb if only db is true,
+// - NOT (Ea OR Eb) if both are true.
+CompressedBitMap& CompressedBitMap::operator&=(const CompressedBitMap& b) {
+    if (! def_value && ! b.def_value) {
+        chunks = Combine(chunks, b.chunks, Operation::AND);
+    }
+    else if (def_value && ! b.def_value) {
+        chunks = Combine(b.chunks, chunks, Operation::AND_NOT);
+    }
+    else if (! def_value) {
+        chunks = Combine(chunks, b.chunks, Operation::AND_NOT);
+    }
+    else {
+        chunks = Combine(chunks, b.chunks, Operation::OR);
+    }
+    def_value = def_value && b.def_value;
+    bsize = (std::max)(bsize, b.bsize);
+    return *this;
+}
+
+CompressedBitMap& CompressedBitMap::operator|=(const CompressedBitMap& b) {
+    if (! def_value && ! b.def_value) {
+        chunks = Combine(chunks, b.chunks, Operation::OR);
+    }
+    else if (def_value && ! b.def_value) {
+        chunks = Combine(chunks, b.chunks, Operation::AND_NOT);
+    }
+    else if (! def_value) {
+        chunks = Combine(b.chunks, chunks, Operation::AND_NOT);
+    }
+    else {
+        chunks = Combine(chunks, b.chunks, Operation::AND);
+    }
+    def_value = def_value || b.def_value;
+    bsize = (std::max)(bsize, b.bsize);
+    return *this;
+}
+
+CompressedBitMap& CompressedBitMap::operator^=(const CompressedBitMap& b) {
+    chunks = Combine(chunks, b.chunks, Operation::XOR);
+    def_value = def_value != b.def_value;
+    bsize = (std::max)(bsize, b.bsize);
+    return *this;
+}
+}
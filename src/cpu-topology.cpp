@@ -0,0 +1,203 @@
+#include "cpu-topology.hpp"
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+namespace trillek {
+
+namespace {
+#if defined(__linux__)
+/** \brief Read the first line of a sysfs file
+ *
+ * \return bool false if the file can not be read
+ */
+bool ReadLine(const std::string& path, std::string& line) {
+    std::ifstream file(path);
+    return file && std::getline(file, line);
+}
+
+unsigned int ReadNumber(const std::string& path, unsigned int fallback) {
+    std::string line;
+    if (! ReadLine(path, line)) {
+        return fallback;
+    }
+    std::istringstream in(line);
+    unsigned int value;
+    return (in >> value) ? value : fallback;
+}
+#endif
+}
+
+CpuTopology::CpuTopology(std::vector<CpuInfo>&& cpus) : cpus(std::move(cpus)) {}
+
+CpuTopology CpuTopology::Detect() {
+    std::vector<CpuInfo> cpus;
+#if defined(__linux__)
+    std::string line;
+    if (ReadLine("/sys/devices/system/cpu/online", line)) {
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        const bool masked = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+        for (auto cpu : ParseCpuList(line)) {
+            if (masked && cpu < CPU_SETSIZE && ! CPU_ISSET(cpu, &allowed)) {
+                continue;
+            }
+            const auto base = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+            CpuInfo info = {cpu, ReadNumber(base + "physical_package_id", 0), ReadNumber(base + "core_id", cpu), 0};
+            cpus.push_back(info);
+        }
+        std::string nodes;
+        if (ReadLine("/sys/devices/system/node/online", nodes)) {
+            for (auto node : ParseCpuList(nodes)) {
+                std::string list;
+                if (! ReadLine("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist", list)) {
+                    continue;
+                }
+                for (auto cpu : ParseCpuList(list)) {
+                    for (auto& c : cpus) {
+                        if (c.cpu == cpu) {
+                            c.node = node;
+                        }
+                    }
+                }
+            }
+        }
+    }
+#endif
+    if (cpus.empty()) {
+        const auto count = (std::max)(std::thread::hardware_concurrency(), 1u);
+        for (unsigned int cpu = 0; cpu < count; ++cpu) {
+            CpuInfo info = {cpu, 0, cpu, 0};
+            cpus.push_back(info);
+        }
+    }
+    return CpuTopology(std::move(cpus));
+}
+
+unsigned int CpuTopology::Packages() const {
+    std::set<unsigned int> packages;
+    for (const auto& c : cpus) {
+        packages.insert(c.package);
+    }
+    return packages.size();
+}
+
+unsigned int CpuTopology::Nodes() const {
+    std::set<unsigned int> nodes;
+    for (const auto& c : cpus) {
+        nodes.insert(c.node);
+    }
+    return nodes.size();
+}
+
+unsigned int CpuTopology::PhysicalCores() const {
+    std::set<std::pair<unsigned int,unsigned int>> cores;
+    for (const auto& c : cpus) {
+        cores.insert(std::make_pair(c.package, c.core));
+    }
+    return cores.size();
+}
+
+std::vector<CpuInfo> CpuTopology::PlacementOrder() const {
+    // rank of each CPU among the SMT siblings of its core
+    std::vector<std::pair<unsigned int,CpuInfo>> ranked;
+    std::map<std::pair<unsigned int,unsigned int>,unsigned int> siblings;
+    auto sorted = cpus;
+    std::sort(sorted.begin(), sorted.end(), [](const CpuInfo& a, const CpuInfo& b) { return a.cpu < b.cpu; });
+    for (const auto& c : sorted) {
+        ranked.push_back(std::make_pair(siblings[std::make_pair(c.package, c.core)]++, c));
+    }
+    std::stable_sort(ranked.begin(), ranked.end(),
+        [](const std::pair<unsigned int,CpuInfo>& a, const std::pair<unsigned int,CpuInfo>& b) {
+            return std::make_pair(a.second.node, a.first) < std::make_pair(b.second.node, b.first);
+        });
+    std::vector<CpuInfo> order;
+    for (const auto& r : ranked) {
+        order.push_back(r.second);
+    }
+    return order;
+}
+
+std::string CpuTopology::Report() const {
+    std::ostringstream out;
+    out << cpus.size() << " logical CPUs, " << PhysicalCores() << " physical cores, "
+        << Packages() << " packages, " << Nodes() << " NUMA nodes";
+    std::set<unsigned int> nodes;
+    for (const auto& c : cpus) {
+        nodes.insert(c.node);
+    }
+    for (auto node : nodes) {
+        out << "\n  node " << node << ": CPUs";
+        for (const auto& c : cpus) {
+            if (c.node == node) {
+                out << " " << c.cpu;
+            }
+        }
+    }
+    return out.str();
+}
+
+bool CpuTopology::Pin(std::thread& thread, unsigned int cpu) {
+#if defined(__linux__)
+    if (cpu >= CPU_SETSIZE) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+    if (cpu >= sizeof(DWORD_PTR) * 8) {
+        return false;
+    }
+    return SetThreadAffinityMask(thread.native_handle(), DWORD_PTR(1) << cpu) != 0;
+#else
+    return false;
+#endif
+}
+
+std::vector<unsigned int> CpuTopology::ParseCpuList(const std::string& list) {
+    std::vector<unsigned int> result;
+    std::istringstream in(list);
+    std::string range;
+    while (std::getline(in, range, ',')) {
+        unsigned int first, last;
+        char dash;
+        std::istringstream r(range);
+        if (! (r >> first)) {
+            continue;
+        }
+        last = (r >> dash >> last) && dash == '-' ? last : first;
+        for (auto cpu = first; cpu <= last; ++cpu) {
+            result.push_back(cpu);
+        }
+    }
+    return result;
+}
+
+std::vector<unsigned int> StealOrder(unsigned int id, const std::vector<unsigned int>& nodes) {
+    const auto count = static_cast<unsigned int>(nodes.size());
+    std::vector<unsigned int> order;
+    for (unsigned int i = 1; i < count; ++i) {
+        const auto victim = (id + i) % count;
+        if (nodes[victim] == nodes[id]) {
+            order.push_back(victim);
+        }
+    }
+    for (unsigned int i = 1; i < count; ++i) {
+        const auto victim = (id + i) % count;
+        if (nodes[victim] != nodes[id]) {
+            order.push_back(victim);
+        }
+    }
+    return order;
+}
+}
@@ -0,0 +1,75 @@
+#include "frame-arena.hpp"
+#include <algorithm>
+#include <cstdint>
+
+namespace trillek {
+
+FrameArena& FrameArena::Local() {
+    static thread_local FrameArena arena;
+    return arena;
+}
+
+void* FrameArena::Allocate(size_t size, size_t alignment) {
+    while (current < blocks.size()) {
+        auto& block = blocks[current];
+        const auto base = reinterpret_cast<uintptr_t>(block.data.get());
+        const auto start = ((base + offset + alignment - 1) & ~uintptr_t(alignment - 1)) - base;
+        if (start + size <= block.size) {
+            offset = start + size;
+            high_water = (std::max)(high_water, consumed + offset);
+            return block.data.get() + start;
+        }
+        // the next block kept from a previous frame, if it is large enough
+        if (current + 1 < blocks.size() && blocks[current + 1].size >= size + alignment) {
+            consumed += block.size;
+            ++current;
+            offset = 0;
+            continue;
+        }
+        break;
+    }
+    Block block;
+    block.size = (std::max)(block_size, size + alignment);
+    block.data.reset(new char[block.size]);
+    if (current < blocks.size()) {
+        consumed += blocks[current].size;
+        ++current;
+    }
+    blocks.insert(blocks.begin() + current, std::move(block));
+    offset = 0;
+    return Allocate(size, alignment);
+}
+
+void FrameArena::Deallocate(void* p, size_t size) {
+    if (current >= blocks.size()) {
+        return;
+    }
+    const auto data = blocks[current].data.get();
+    if (static_cast<char*>(p) + size == data + offset) {
+        offset = static_cast<char*>(p) - data;
+    }
+}
+
+void FrameArena::Rewind(const Marker& marker) {
+    current = marker.block;
+    offset = marker.offset;
+    consumed = 0;
+    for (size_t b = 0; b < current && b < blocks.size(); ++b) {
+        consumed += blocks[b].size;
+    }
+}
+
+void FrameArena::Reset() {
+    current = 0;
+    offset = 0;
+    consumed = 0;
+}
+
+size_t FrameArena::Capacity() const {
+    size_t capacity = 0;
+    for (const auto& block : blocks) {
+        capacity += block.size;
+    }
+    return capacity;
+}
+}
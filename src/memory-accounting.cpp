@@ -0,0 +1,236 @@
+#include "memory-accounting.hpp"
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+
+namespace trillek {
+
+const MemoryTag MemoryAccounting::GENERAL;
+const unsigned int MemoryAccounting::MAX_TAGS;
+const int64_t MemoryAccounting::FLUSH_BYTES;
+
+namespace {
+/** \brief The counters of the tags
+ *
+ * Counters are relaxed atomics: a thread is the only writer of its pending
+ * counters, other threads only read them in queries.
+ */
+struct Counters {
+    Counters() {
+        for (unsigned int t = 0; t < MemoryAccounting::MAX_TAGS; ++t) {
+            bytes[t].store(0, std::memory_order_relaxed);
+            allocations[t].store(0, std::memory_order_relaxed);
+            deallocations[t].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    std::atomic<int64_t> bytes[MemoryAccounting::MAX_TAGS];
+    std::atomic<uint64_t> allocations[MemoryAccounting::MAX_TAGS];
+    std::atomic<uint64_t> deallocations[MemoryAccounting::MAX_TAGS];
+};
+
+struct ThreadCounters;
+
+/** \brief The tags and the published counters
+ *
+ * It is never destroyed: containers can be released by static destructors
+ * after the end of main().
+ */
+struct Registry {
+    Registry() : names(1, "general") {
+        for (unsigned int t = 0; t < MemoryAccounting::MAX_TAGS; ++t) {
+            high_water[t].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    std::mutex m_names;
+    std::vector<std::string> names;
+    // the counters of the terminated threads and the flushed counters
+    Counters published;
+    std::atomic<int64_t> high_water[MemoryAccounting::MAX_TAGS];
+    std::mutex m_threads;
+    std::vector<ThreadCounters*> threads;
+};
+
+Registry& GetRegistry() {
+    static Registry* registry = new Registry;
+    return *registry;
+}
+
+void UpdateHighWater(MemoryTag tag, int64_t bytes) {
+    auto& high_water = GetRegistry().high_water[tag];
+    auto current = high_water.load(std::memory_order_relaxed);
+    while (bytes > current && ! high_water.compare_exchange_weak(current, bytes, std::memory_order_relaxed)) {
+    }
+}
+
+/** \brief The pending counters of a thread
+ *
+ */
+struct ThreadCounters {
+    ThreadCounters() : alive(true) {
+        auto& registry = GetRegistry();
+        std::lock_guard<std::mutex> locker(registry.m_threads);
+        registry.threads.push_back(this);
+    };
+
+    ~ThreadCounters() {
+        auto& registry = GetRegistry();
+        std::lock_guard<std::mutex> locker(registry.m_threads);
+        for (unsigned int t = 0; t < MemoryAccounting::MAX_TAGS; ++t) {
+            Publish(t);
+        }
+        registry.threads.erase(std::find(registry.threads.begin(), registry.threads.end(), this));
+        alive = false;
+    }
+
+    /** \brief Move the pending counters of a tag to the published counters
+     *
+     */
+    void Publish(MemoryTag tag) {
+        auto& published = GetRegistry().published;
+        const auto bytes = pending.bytes[tag].load(std::memory_order_relaxed);
+        const auto allocations = pending.allocations[tag].load(std::memory_order_relaxed);
+        const auto deallocations = pending.deallocations[tag].load(std::memory_order_relaxed);
+        pending.bytes[tag].store(0, std::memory_order_relaxed);
+        pending.allocations[tag].store(0, std::memory_order_relaxed);
+        pending.deallocations[tag].store(0, std::memory_order_relaxed);
+        const auto current = published.bytes[tag].fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        published.allocations[tag].fetch_add(allocations, std::memory_order_relaxed);
+        published.deallocations[tag].fetch_add(deallocations, std::memory_order_relaxed);
+        UpdateHighWater(tag, current);
+    }
+
+    void Add(MemoryTag tag, int64_t bytes, std::atomic<uint64_t>* count) {
+        const auto pending_bytes = pending.bytes[tag].load(std::memory_order_relaxed) + bytes;
+        pending.bytes[tag].store(pending_bytes, std::memory_order_relaxed);
+        count[tag].store(count[tag].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (pending_bytes >= MemoryAccounting::FLUSH_BYTES || pending_bytes <= -MemoryAccounting::FLUSH_BYTES) {
+            Publish(tag);
+        }
+    }
+
+    Counters pending;
+    // false once destroyed, for the containers released at exit
+    bool alive;
+};
+
+thread_local ThreadCounters counters;
+thread_local MemoryTag current_tag = MemoryAccounting::GENERAL;
+
+void AddPublished(MemoryTag tag, int64_t bytes, std::atomic<uint64_t>* count) {
+    GetRegistry().published.bytes[tag].fetch_add(bytes, std::memory_order_relaxed);
+    count[tag].fetch_add(1, std::memory_order_relaxed);
+}
+}
+
+MemoryTag MemoryAccounting::Tag(const std::string& name) {
+    auto& registry = GetRegistry();
+    std::lock_guard<std::mutex> locker(registry.m_names);
+    auto it = std::find(registry.names.begin(), registry.names.end(), name);
+    if (it != registry.names.end()) {
+        return static_cast<MemoryTag>(it - registry.names.begin());
+    }
+    if (registry.names.size() >= MAX_TAGS) {
+        return GENERAL;
+    }
+    registry.names.push_back(name);
+    return static_cast<MemoryTag>(registry.names.size() - 1);
+}
+
+void MemoryAccounting::Allocated(MemoryTag tag, size_t bytes) {
+    if (! counters.alive) {
+        AddPublished(tag, bytes, GetRegistry().published.allocations);
+        return;
+    }
+    counters.Add(tag, bytes, counters.pending.allocations);
+}
+
+void MemoryAccounting::Freed(MemoryTag tag, size_t bytes) {
+    if (! counters.alive) {
+        AddPublished(tag, -static_cast<int64_t>(bytes), GetRegistry().published.deallocations);
+        return;
+    }
+    counters.Add(tag, -static_cast<int64_t>(bytes), counters.pending.deallocations);
+}
+
+MemoryTag MemoryAccounting::CurrentTag() {
+    return current_tag;
+}
+
+MemoryTag MemoryAccounting::SetCurrentTag(MemoryTag tag) {
+    const auto previous = current_tag;
+    current_tag = tag;
+    return previous;
+}
+
+MemoryTagStats MemoryAccounting::Query(MemoryTag tag) {
+    auto& registry = GetRegistry();
+    MemoryTagStats stats;
+    stats.tag = tag;
+    {
+        std::lock_guard<std::mutex> locker(registry.m_names);
+        stats.name = tag < registry.names.size() ? registry.names[tag] : std::string();
+    }
+    {
+        std::lock_guard<std::mutex> locker(registry.m_threads);
+        stats.current_bytes = registry.published.bytes[tag].load(std::memory_order_relaxed);
+        stats.allocations = registry.published.allocations[tag].load(std::memory_order_relaxed);
+        stats.deallocations = registry.published.deallocations[tag].load(std::memory_order_relaxed);
+        for (auto thread : registry.threads) {
+            stats.current_bytes += thread->pending.bytes[tag].load(std::memory_order_relaxed);
+            stats.allocations += thread->pending.allocations[tag].load(std::memory_order_relaxed);
+            stats.deallocations += thread->pending.deallocations[tag].load(std::memory_order_relaxed);
+        }
+    }
+    UpdateHighWater(tag, stats.current_bytes);
+    stats.high_water_bytes = registry.high_water[tag].load(std::memory_order_relaxed);
+    return stats;
+}
+
+std::vector<MemoryTagStats> MemoryAccounting::Snapshot() {
+    size_t tags;
+    {
+        auto& registry = GetRegistry();
+        std::lock_guard<std::mutex> locker(registry.m_names);
+        tags = registry.names.size();
+    }
+    std::vector<MemoryTagStats> snapshot;
+    for (MemoryTag tag = 0; tag < tags; ++tag) {
+        auto stats = Query(tag);
+        if (stats.allocations) {
+            snapshot.push_back(std::move(stats));
+        }
+    }
+    return snapshot;
+}
+
+std::string MemoryAccounting::Report() {
+    auto snapshot = Snapshot();
+    std::sort(snapshot.begin(), snapshot.end(), [](const MemoryTagStats& a, const MemoryTagStats& b) {
+        return a.current_bytes > b.current_bytes;
+    });
+    std::ostringstream report;
+    report << "Memory by tag (bytes):" << std::endl;
+    report << std::left << std::setw(40) << "tag" << std::right
+        << std::setw(14) << "current" << std::setw(14) << "high water"
+        << std::setw(14) << "allocations" << std::setw(14) << "frees" << std::endl;
+    for (const auto& stats : snapshot) {
+        report << std::left << std::setw(40) << stats.name.substr(0, 39) << std::right
+            << std::setw(14) << stats.current_bytes << std::setw(14) << stats.high_water_bytes
+            << std::setw(14) << stats.allocations << std::setw(14) << stats.deallocations << std::endl;
+    }
+    return report.str();
+}
+
+void MemoryAccounting::Flush() {
+    if (! counters.alive) {
+        return;
+    }
+    for (MemoryTag tag = 0; tag < MAX_TAGS; ++tag) {
+        counters.Publish(tag);
+    }
+}
+}
@@ -0,0 +1,32 @@
+#include "node-pool.hpp"
+#include "size-class-pool.hpp"
+
+namespace trillek {
+
+namespace {
+typedef SizeClassPool<NodePool> pool;
+
+size_t SizeClass(size_t size) {
+    return size ? (size - 1) / NodePool::ALIGNMENT : 0;
+}
+}
+
+void* NodePool::Allocate(size_t size) {
+    return pool::Allocate(SizeClass(size));
+}
+
+void NodePool::Deallocate(void* block, size_t size) {
+    pool::Deallocate(block, SizeClass(size));
+}
+
+void NodePool::ReleaseThreadCache() {
+    pool::ReleaseThreadCache();
+}
+
+NodePoolCounters NodePool::Counters() {
+    NodePoolCounters counters;
+    counters.heap_allocations = pool::HeapAllocations();
+    counters.heap_bytes = pool::HeapBytes();
+    return counters;
+}
+}
@@ -0,0 +1,97 @@
+#include "scheduler-clock.hpp"
+#if defined(_MSC_VER)
+#include "trillek-game.hpp"
+#include "os.hpp"
+#endif
+
+namespace trillek {
+
+namespace {
+// idle threads wake up at least once per frame of wall time, to check the
+// terminate flag of the game
+const std::chrono::milliseconds max_virtual_sleep(16);
+}
+
+scheduler_tp RealClock::Now() const {
+#if defined(_MSC_VER)
+    return scheduler_tp(TrillekGame::GetOS().GetTime());
+#else
+    return scheduler_tp{std::chrono::steady_clock::now()};
+#endif
+}
+
+void VirtualClock::WaitUntil(std::condition_variable& cv, std::unique_lock<std::mutex>& lock,
+                            const scheduler_tp& tp) {
+    // Advance() changes the time before taking the lock: no wakeup is lost
+    if (Now() < tp) {
+        cv.wait_for(lock, max_virtual_sleep);
+    }
+}
+
+void VirtualClock::Attach(unsigned int /*threads*/, std::function<void()>&& wake) {
+    std::lock_guard<std::mutex> locker(m_wake);
+    this->wake = std::move(wake);
+}
+
+void VirtualClock::Detach() {
+    std::lock_guard<std::mutex> locker(m_wake);
+    wake = nullptr;
+}
+
+void VirtualClock::Advance(const frame_unit& delta) {
+    if (SetNow(Now() + delta)) {
+        Wake();
+    }
+}
+
+bool VirtualClock::SetNow(const scheduler_tp& tp) {
+    auto expected = now.load(std::memory_order_relaxed);
+    const auto desired = tp.time_since_epoch().count();
+    // the time never goes back
+    while (expected < desired) {
+        if (now.compare_exchange_weak(expected, desired, std::memory_order_release)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void VirtualClock::Wake() {
+    std::lock_guard<std::mutex> locker(m_wake);
+    if (wake) {
+        wake();
+    }
+}
+
+void FastClock::WaitUntil(std::condition_variable& cv, std::unique_lock<std::mutex>& lock,
+                        const scheduler_tp& tp) {
+    if (tp <= Now()) {
+        return;
+    }
+    if (tp < earliest) {
+        earliest = tp;
+    }
+    if (++idle == threads) {
+        // no thread can queue a task before the next timepoint: jump to it
+        SetNow(earliest);
+        earliest = (scheduler_tp::max)();
+        idle = 0;
+        ++generation;
+        cv.notify_all();
+        return;
+    }
+    const auto waiting = generation;
+    cv.wait_for(lock, max_virtual_sleep);
+    if (waiting == generation) {
+        // woken up by a task, the time did not jump
+        --idle;
+    }
+}
+
+void FastClock::Attach(unsigned int threads, std::function<void()>&& wake) {
+    VirtualClock::Attach(threads, std::move(wake));
+    this->threads = threads;
+    idle = 0;
+    earliest = (scheduler_tp::max)();
+}
+}
@@ -0,0 +1,168 @@
+#include "scheduler-telemetry.hpp"
+#include <cstdlib>
+#if defined(__GNUG__)
+#include <cxxabi.h>
+#endif
+
+namespace trillek {
+
+std::string DemangleTypeName(const char* name) {
+#if defined(__GNUG__)
+    int status = 0;
+    auto demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if (demangled) {
+        std::string result(demangled);
+        std::free(demangled);
+        return result;
+    }
+#endif
+    return name;
+}
+}
+
+#ifdef TRILLEK_TELEMETRY
+
+#include <iomanip>
+#include <ostream>
+
+namespace trillek {
+
+void DurationHistogram::Merge(const DurationHistogram& h) {
+    for (unsigned int b = 0; b < BUCKETS; ++b) {
+        buckets[b] += h.buckets[b];
+    }
+    count += h.count;
+    total += h.total;
+    max = h.max > max ? h.max : max;
+}
+
+uint64_t DurationHistogram::Percentile(double p) const {
+    const auto rank = static_cast<uint64_t>(p * count);
+    uint64_t seen = 0;
+    for (unsigned int b = 0; b < BUCKETS - 1; ++b) {
+        seen += buckets[b];
+        if (seen > rank) {
+            // the upper bound of the bucket, not above the maximum
+            const uint64_t bound = b ? (uint64_t(1) << b) - 1 : 0;
+            return bound < max ? bound : max;
+        }
+    }
+    return max;
+}
+
+DurationHistogram AtomicHistogram::Snapshot() const {
+    DurationHistogram h;
+    for (unsigned int b = 0; b < DurationHistogram::BUCKETS; ++b) {
+        h.buckets[b] = buckets[b].load(std::memory_order_relaxed);
+    }
+    h.count = count.load(std::memory_order_relaxed);
+    h.total = total.load(std::memory_order_relaxed);
+    h.max = max.load(std::memory_order_relaxed);
+    return h;
+}
+
+const size_t WorkerTelemetry::TYPE_SLOTS;
+const char* const WorkerTelemetry::OTHER_TYPES = "other task types";
+
+TaskTypeTelemetry& WorkerTelemetry::TypeStats(const std::type_info& type) {
+    const auto hash = (reinterpret_cast<uintptr_t>(&type) >> 4) * 0x9e3779b97f4a7c15ULL;
+    for (size_t i = 0; i < TYPE_SLOTS; ++i) {
+        auto& slot = types[(hash + i) % TYPE_SLOTS];
+        const auto t = slot.type.load(std::memory_order_relaxed);
+        if (t == &type) {
+            return slot.stats;
+        }
+        if (! t) {
+            // only the owner inserts, the readers skip the slot until it is set
+            slot.type.store(&type, std::memory_order_release);
+            return slot.stats;
+        }
+    }
+    return other_types;
+}
+
+void WorkerTelemetry::MergeTypes(std::unordered_map<std::string,std::pair<DurationHistogram,DurationHistogram>>& merged) const {
+    for (const auto& slot : types) {
+        const auto type = slot.type.load(std::memory_order_acquire);
+        if (type) {
+            auto& h = merged[type->name()];
+            h.first.Merge(slot.stats.wait.Snapshot());
+            h.second.Merge(slot.stats.run.Snapshot());
+        }
+    }
+    const auto run = other_types.run.Snapshot();
+    if (run.Count()) {
+        auto& h = merged[OTHER_TYPES];
+        h.first.Merge(other_types.wait.Snapshot());
+        h.second.Merge(run);
+    }
+}
+
+void WorkerTelemetry::SetTrace(size_t capacity) {
+    std::lock_guard<std::mutex> locker(m_trace);
+    trace.assign(capacity, TraceEvent());
+    trace_next = 0;
+    tracing = capacity > 0;
+}
+
+std::vector<TraceEvent> WorkerTelemetry::TraceEvents() const {
+    std::lock_guard<std::mutex> locker(m_trace);
+    if (trace_next <= trace.size()) {
+        return std::vector<TraceEvent>(trace.begin(), trace.begin() + trace_next);
+    }
+    // the ring has wrapped
+    const auto first = trace.begin() + trace_next % trace.size();
+    std::vector<TraceEvent> events(first, trace.end());
+    events.insert(events.end(), trace.begin(), first);
+    return events;
+}
+
+namespace {
+void WriteJsonString(std::ostream& out, const std::string& s) {
+    out << '"';
+    for (auto c : s) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            out << ' ';
+        }
+        else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+}
+
+void WriteTraceEvents(std::ostream& out, const std::vector<std::vector<TraceEvent>>& threads, int64_t origin) {
+    // names are demangled once per type
+    std::unordered_map<const char*,std::string> names;
+    const auto flags = out.flags();
+    const auto precision = out.precision();
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    for (size_t tid = 0; tid < threads.size(); ++tid) {
+        out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+            << ",\"args\":{\"name\":\"worker " << tid << "\"}}";
+        first = false;
+        for (const auto& e : threads[tid]) {
+            auto it = names.find(e.name);
+            if (it == names.end()) {
+                it = names.insert(std::make_pair(e.name, DemangleTypeName(e.name))).first;
+            }
+            out << ",\n{\"name\":";
+            WriteJsonString(out, it->second);
+            // timestamps are in microseconds
+            out << ",\"cat\":\"" << e.category << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+                << ",\"ts\":" << (e.start - origin) / 1000.0 << ",\"dur\":" << e.duration / 1000.0 << "}";
+        }
+    }
+    out << "\n]}\n";
+    out.flags(flags);
+    out.precision(precision);
+}
+}
+
+#endif // TRILLEK_TELEMETRY
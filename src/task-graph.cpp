@@ -0,0 +1,162 @@
+#include "task-graph.hpp"
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+
+#include "logging.hpp"
+
+namespace trillek {
+
+TaskGraph::node_t TaskGraph::AddNode(const std::string& name, std::function<void(void)>&& funct) {
+    nodes.push_back(std::unique_ptr<Node>(new Node(name, std::move(funct))));
+    sorted = false;
+    return nodes.size() - 1;
+}
+
+void TaskGraph::Precede(node_t before, node_t after) {
+    nodes[before]->successors.push_back(after);
+    nodes[after]->predecessors.push_back(before);
+    ++nodes[after]->predecessors_count;
+    sorted = false;
+}
+
+bool TaskGraph::Sort() {
+    order.clear();
+    order.reserve(nodes.size());
+    std::vector<unsigned int> degree;
+    degree.reserve(nodes.size());
+    for (node_t n = 0; n < nodes.size(); ++n) {
+        degree.push_back(nodes[n]->predecessors_count);
+        if (! degree.back()) {
+            order.push_back(n);
+        }
+    }
+    for (size_t i = 0; i < order.size(); ++i) {
+        for (auto s : nodes[order[i]]->successors) {
+            if (! --degree[s]) {
+                order.push_back(s);
+            }
+        }
+    }
+    sorted = order.size() == nodes.size();
+    return sorted;
+}
+
+bool TaskGraph::Launch(TrillekScheduler& scheduler, frame_tp frame) {
+    if (running || nodes.empty()) {
+        return false;
+    }
+    if (! sorted && ! Sort()) {
+        LOGMSGC(ERROR) << "Task graph has a cycle, it can not be launched";
+        return false;
+    }
+    this->scheduler = &scheduler;
+    report.frame = frame;
+    for (auto& n : nodes) {
+        n->pending = n->predecessors_count;
+    }
+    remaining = nodes.size();
+    running = true;
+    launch_tp = TrillekScheduler::Now();
+    for (node_t n = 0; n < nodes.size(); ++n) {
+        if (! nodes[n]->predecessors_count) {
+            QueueNode(n);
+        }
+    }
+    return true;
+}
+
+void TaskGraph::QueueNode(node_t node) {
+    scheduler->Queue(MakeTaskRequest([this, node]() {
+        RunNode(node);
+    }));
+}
+
+void TaskGraph::RunNode(node_t node) {
+    auto& n = *nodes[node];
+    n.start = TrillekScheduler::Now();
+    n.funct();
+    n.end = TrillekScheduler::Now();
+    for (auto s : n.successors) {
+        if (nodes[s]->pending.fetch_sub(1) == 1) {
+            QueueNode(s);
+        }
+    }
+    if (remaining.fetch_sub(1) == 1) {
+        Finish();
+    }
+}
+
+void TaskGraph::Finish() {
+    // longest path ending at each node, in topological order
+    std::vector<frame_unit> path(nodes.size(), frame_unit(0));
+    std::vector<node_t> previous(nodes.size(), nodes.size());
+    report.durations.assign(nodes.size(), frame_unit(0));
+    report.span = frame_unit(0);
+    node_t last = order.front();
+    for (auto n : order) {
+        const auto& node = *nodes[n];
+        report.durations[n] = node.end - node.start;
+        for (auto p : node.predecessors) {
+            if (path[p] > path[n] || previous[n] == nodes.size()) {
+                path[n] = path[p];
+                previous[n] = p;
+            }
+        }
+        path[n] += report.durations[n];
+        if (path[n] > path[last]) {
+            last = n;
+        }
+        report.span = (std::max)(report.span, frame_unit(node.end - launch_tp));
+    }
+    report.critical_length = path[last];
+    report.critical_path.clear();
+    for (auto n = last; n != nodes.size(); n = previous[n]) {
+        report.critical_path.push_back(n);
+    }
+    std::reverse(report.critical_path.begin(), report.critical_path.end());
+    LOGMSGC(DEBUG_FINE) << CriticalPathReport();
+    // the continuation can launch the graph again, and the next run
+    // overwrites the report while the continuation reads its copy
+    TaskGraphReport finished;
+    if (on_complete) {
+        finished = report;
+    }
+    {
+        // Wait() returns only after the continuations
+        std::lock_guard<std::mutex> locker(m_done);
+        ++completing;
+        running = false;
+    }
+    if (on_complete) {
+        on_complete(finished);
+    }
+    // notify under the lock: a waiter can destroy the graph once it returns
+    std::lock_guard<std::mutex> locker(m_done);
+    --completing;
+    done_check.notify_all();
+}
+
+void TaskGraph::Wait() const {
+    std::unique_lock<std::mutex> locker(m_done);
+    done_check.wait(locker, [&]() { return ! running && ! completing; });
+}
+
+bool TaskGraph::Done() const {
+    std::lock_guard<std::mutex> locker(m_done);
+    return ! running && ! completing;
+}
+
+std::string TaskGraph::CriticalPathReport() const {
+    std::ostringstream out;
+    auto ms = [](frame_unit d) { return std::chrono::duration<double, std::milli>(d).count(); };
+    out << std::fixed << std::setprecision(3);
+    out << "frame " << report.frame << ": span " << ms(report.span) << " ms, critical path "
+        << ms(report.critical_length) << " ms:";
+    for (size_t i = 0; i < report.critical_path.size(); ++i) {
+        auto n = report.critical_path[i];
+        out << (i ? " -> " : " ") << nodes[n]->name << " (" << ms(report.durations[n]) << " ms)";
+    }
+    return out.str();
+}
+}
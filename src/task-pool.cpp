@@ -0,0 +1,53 @@
+#include "task-pool.hpp"
+#include <atomic>
+#include <new>
+#include "size-class-pool.hpp"
+
+namespace trillek {
+
+namespace {
+typedef SizeClassPool<TaskPool> pool;
+
+std::atomic<uint64_t> oversized(0);
+
+size_t SizeClass(size_t size) {
+    size_t c = 0;
+    while ((TaskPool::MIN_BLOCK << c) < size) {
+        ++c;
+    }
+    return c;
+}
+}
+
+void* TaskPool::Allocate(size_t size) {
+    if (size > MAX_BLOCK) {
+        oversized.fetch_add(1, std::memory_order_relaxed);
+        pool::CountHeap(size);
+        return ::operator new(size);
+    }
+    return pool::Allocate(SizeClass(size));
+}
+
+void TaskPool::Deallocate(void* block, size_t size) {
+    if (size > MAX_BLOCK) {
+        ::operator delete(block);
+        return;
+    }
+    pool::Deallocate(block, SizeClass(size));
+}
+
+void TaskPool::Reserve(size_t size, size_t blocks) {
+    if (size > MAX_BLOCK) {
+        return;
+    }
+    pool::Reserve(SizeClass(size), blocks);
+}
+
+TaskPoolCounters TaskPool::Counters() {
+    TaskPoolCounters counters;
+    counters.heap_allocations = pool::HeapAllocations();
+    counters.heap_bytes = pool::HeapBytes();
+    counters.oversized = oversized.load(std::memory_order_relaxed);
+    return counters;
+}
+}
@@ -5,146 +5,696 @@
 #include <iostream>
 #include <functional>
 #include <algorithm>
+#include <typeinfo>
 
 #include "systems/system-base.hpp"
+#include "task-graph.hpp"
+#include "cpu-topology.hpp"
+#include "frame-arena.hpp"
+#include "systems/dispatcher.hpp"
 #include "trillek-game.hpp"
-#include "os.hpp"
 #include "logging.hpp"
 
 namespace trillek {
-std::function<void(std::shared_ptr<TaskRequest<chain_t>>&&,frame_unit&&)> TaskRequest<chain_t>::queue_task;
+std::function<void(TaskPtr<TaskRequest<chain_t>>&&,frame_unit&&)> TaskRequest<chain_t>::queue_task;
+
+namespace {
+// the scheduler and the index of the worker running on this thread
+thread_local const TrillekScheduler* local_scheduler = nullptr;
+thread_local unsigned int local_worker = 0;
+// the lane of the task running on this thread
+thread_local TaskLane local_lane = TaskLane::FRAME;
+
+RealClock real_clock;
+// the clock of all schedulers
+SchedulerClock* scheduler_clock = &real_clock;
+
+scheduler_tp SchedulerNow() {
+    return scheduler_clock->Now();
+}
+
+SCHEDULER_TELEMETRY(
+int64_t Nanoseconds(const scheduler_tp& tp) {
+    return tp.time_since_epoch().count();
+}
+
+uint64_t Nanoseconds(const frame_unit& d) {
+    return d.count() > 0 ? d.count() : 0;
+}
+)
+}
 
 scheduler_tp TaskRequestBase::Now() const {
-#if defined(_MSC_VER)
-    return scheduler_tp(TrillekGame::GetOS().GetTime());
-#else
-//    return scheduler_tp(TrillekGame::GetOS().GetTime());
-    return scheduler_tp{std::chrono::steady_clock::now()};
-#endif
+    return SchedulerNow();
 }
 
+void TrillekScheduler::RegisterSystem(SystemBase* system, int affinity, const SystemPacing& pacing) {
+    const auto tag = MemoryAccounting::Tag("system " + DemangleTypeName(typeid(*system).name()));
+    system_jobs.push_back(std::unique_ptr<SystemJob>(new SystemJob(system, affinity, pacing, tag)));
+}
 
 void TrillekScheduler::Initialize(unsigned int nr_thread, std::queue<SystemBase*>& systems) {
     std::list<std::thread> thread_list;
     // initialize
-#if defined(_MSC_VER)
-    scheduler_tp now = scheduler_tp(TrillekGame::GetOS().GetTime());
-#else
-    scheduler_tp now{std::chrono::steady_clock::now()};
-#endif
-    TaskRequest<chain_t>::Initialize([&](std::shared_ptr<TaskRequest<chain_t>>&& c, frame_unit&& delay)
+    scheduler_tp now = SchedulerNow();
+    TaskRequest<chain_t>::Initialize([&](TaskPtr<TaskRequest<chain_t>>&& c, frame_unit&& delay)
                                     {
                                         c->Reschedule(std::move(delay));
                                         Queue(std::move(c));
                                     });
+    if (! nr_thread) {
+        nr_thread = (std::max)(std::thread::hardware_concurrency(), 1u);
+    }
+    // the systems given here keep a thread each, as when they had one thread
+    // per system, so that ThreadInit() is called once
+    for (unsigned int i = 0; ! systems.empty(); ++i) {
+        RegisterSystem(systems.front(), i % nr_thread);
+        systems.pop();
+    }
+    const auto topology = CpuTopology::Detect();
+    LOGMSGC(INFO) << "Scheduler: " << nr_thread << " threads on " << topology.Report();
+    const auto placement = topology.PlacementOrder();
+    // one set of queues per thread
+    workers.clear();
+    std::vector<unsigned int> nodes;
+    for (unsigned int i = 0; i < nr_thread; ++i) {
+        workers.push_back(std::unique_ptr<Worker>(new Worker(Tick(now))));
+        SCHEDULER_TELEMETRY(workers.back()->telemetry.SetTrace(trace_capacity);)
+        // the threads are not bound to a node unless they are pinned
+        nodes.push_back(pin_workers ? placement[i % placement.size()].node : 0);
+    }
+    for (unsigned int i = 0; i < nr_thread; ++i) {
+        workers[i]->victims = StealOrder(i, nodes);
+    }
+    {
+        std::lock_guard<std::mutex> locker(m_sleep);
+        worker_count = nr_thread;
+        queuecheck.notify_all();
+    }
+    for (unsigned int l = 0; l < TASK_LANES; ++l) {
+        UpdateLimit(l);
+    }
+    // the first frame of each system
+    for (auto& job : system_jobs) {
+        job->next_frame = now + job->pacing.period;
+        job->initialized.assign(nr_thread, false);
+        QueueSystem(*job);
+    }
+    if (memory_report_period.count() > 0) {
+        QueueMemoryReport();
+    }
+    scheduler_clock->Attach(nr_thread, [this]() {
+                    std::lock_guard<std::mutex> locker(m_sleep);
+                    queuecheck.notify_all();
+                });
     // prepare threads
     for (unsigned int i = 0; i < nr_thread; ++i) {
-        SystemBase* sys = nullptr;
-        if (! systems.empty()) {
-            sys = systems.front();
-            systems.pop();
-        }
-        auto f = std::bind(&TrillekScheduler::DayWork, std::ref(*this), now, sys);
+        auto f = std::bind(&TrillekScheduler::DayWork, std::ref(*this), i);
         thread_list.push_back(std::thread(std::move(f)));
+        if (pin_workers) {
+            const auto& cpu = placement[i % placement.size()];
+            if (CpuTopology::Pin(thread_list.back(), cpu.cpu)) {
+                LOGMSGC(DEBUG) << "Scheduler: thread " << i << " pinned to CPU " << cpu.cpu << " (node " << cpu.node
+                                << ", package " << cpu.package << ", core " << cpu.core << ")";
+            }
+            else {
+                LOGMSGC(WARNING) << "Scheduler: can not pin thread " << i << " to CPU " << cpu.cpu;
+            }
+        }
     }
     // run threads and block
     for (auto& t : thread_list) {
         t.join();
     }
+    worker_count = 0;
+    scheduler_clock->Detach();
+    ClearQueues();
+    // save the state of the systems
+    for (auto& job : system_jobs) {
+        job->system->Terminate();
+    }
 }
 
-void TrillekScheduler::DayWork(const scheduler_tp& now, SystemBase* system) {
-    scheduler_tp next_frame_tp = now + one_frame;
+void TrillekScheduler::RunSystem(SystemJob& job) {
+    if (! job.initialized[local_worker]) {
+        job.system->ThreadInit();
+        job.initialized[local_worker] = true;
+    }
+    const auto start = SchedulerNow();
+    if (job.pacing.mode == FramePacing::VARIABLE_STEP) {
+        job.next_frame = start;
+    }
+    {
+        // the temporaries of the frame are given back when it ends
+        FrameScope frame(FrameArena::Local());
+        MemoryTagScope memory(job.memory_tag);
+        job.system->HandleEvents(job.next_frame.time_since_epoch().count());
+        job.system->RunBatch();
+    }
+    const auto end = SchedulerNow();
+    SCHEDULER_TELEMETRY(
+        job.telemetry.frame.Add(Nanoseconds(end - start));
+        workers[local_worker]->telemetry.Trace(typeid(*job.system).name(), "system",
+                                                Nanoseconds(start), Nanoseconds(end - start));
+    )
+    PaceSystem(job, start, end);
+    QueueSystem(job);
+}
 
-    std::function<void(frame_tp)> handleEvents_functor;
-    std::function<void(void)> runBatch_functor;
-    std::function<void(void)> terminate_functor;
-    if (system) {
-        handleEvents_functor = std::bind(&SystemBase::HandleEvents, std::ref(*system), std::placeholders::_1);
-        runBatch_functor = std::bind(&SystemBase::RunBatch, std::cref(*system));
-        terminate_functor = std::bind(&SystemBase::Terminate, std::ref(*system));
-        system->ThreadInit();
-    } else {
-        handleEvents_functor = [](frame_tp timepoint) {};
-        runBatch_functor = [] () {};
-        terminate_functor = [] () {};
+void TrillekScheduler::PaceSystem(SystemJob& job, const scheduler_tp& start, const scheduler_tp& end) {
+    const auto frame = job.next_frame;
+    const auto period = job.pacing.period;
+    job.next_frame += period;
+    if (end <= job.next_frame) {
+        return;
     }
+    const auto lateness = end - job.next_frame;
+    // number of frames whose timepoint is already passed
+    const auto late_frames = static_cast<unsigned int>(lateness / period) + 1;
+    unsigned int skipped = 0;
+    switch (job.pacing.mode) {
+    case FramePacing::FIXED_STEP:
+        if (late_frames > job.pacing.max_catch_up) {
+            skipped = late_frames - job.pacing.max_catch_up;
+        }
+        break;
+    case FramePacing::SKIP_FRAMES:
+        skipped = late_frames;
+        break;
+    case FramePacing::VARIABLE_STEP:
+        // start the next frame now
+        job.next_frame = end;
+        break;
+    }
+    job.next_frame += skipped * period;
+    if (end - start <= period && ! skipped) {
+        // a frame catching up, not an overrun
+        return;
+    }
+    SCHEDULER_TELEMETRY(
+        TelemetryAdd(job.telemetry.overruns, 1);
+        TelemetryAdd(job.telemetry.skipped, skipped);
+    )
+    FrameOverrun overrun = {job.system, frame.time_since_epoch().count(), end - start, lateness, skipped};
+    LOGMSGC(DEBUG) << "Scheduler: frame " << overrun.frame << " of a system overran by "
+                    << lateness.count() << " ns, " << skipped << " frames dropped";
+    event::Dispatcher<FrameOverrun>::GetInstance()->NotifySubscribers(&overrun);
+}
 
-    while (1) {
-        std::shared_ptr<TaskRequestBase> task;
+void TrillekScheduler::QueueSystem(SystemJob& job) {
+    if (StopRequested()) {
+        return;
+    }
+    auto task = MakeTaskRequest([this, &job]() {
+                                RunSystem(job);
+                            }, frame_unit(job.next_frame - SchedulerNow()));
+    task->SetAffinity(job.affinity);
+    Queue(std::move(task));
+}
+
+void TrillekScheduler::QueueMemoryReport() {
+    if (StopRequested()) {
+        return;
+    }
+    auto task = MakeTaskRequest([this]() {
+                                LOGMSGC(INFO) << MemoryAccounting::Report();
+                                QueueMemoryReport();
+                            }, memory_report_period);
+    task->SetLane(TaskLane::BACKGROUND);
+    Queue(std::move(task));
+}
+
+void TrillekScheduler::ClearQueues() {
+    TaskPtr<TaskRequestBase> task;
+    auto clear = [&task](Worker& w) {
+        for (unsigned int l = 0; l < TASK_LANES; ++l) {
+            while (w.ready[l].Pop(task) || w.pinned[l].Pop(task)) {
+                task.reset();
+            }
+        }
+        std::lock_guard<std::mutex> locker(w.m_wheel);
+        w.wheel.Clear([](TaskRequestBase* t) { t->timer_pin.reset(); });
+        w.next_expiry = (std::numeric_limits<uint64_t>::max)();
+    };
+    for (auto& w : workers) {
+        clear(*w);
+    }
+    clear(injection);
+}
+
+scheduler_tp TrillekScheduler::Now() {
+    return SchedulerNow();
+}
+
+void TrillekScheduler::SetClock(SchedulerClock* clock) {
+    scheduler_clock = clock ? clock : &real_clock;
+}
+
+bool TrillekScheduler::Launch(TaskGraph& graph, frame_tp frame) {
+    return graph.Launch(*this, frame);
+}
+
+size_t TrillekScheduler::ChunkSize(size_t begin, size_t end, size_t grain) const {
+    if (end <= begin) {
+        return 0;
+    }
+    const auto max_chunks = 4 * (std::max)(worker_count.load(), size_t(1));
+    return (std::max)((std::max)(grain, size_t(1)), (end - begin + max_chunks - 1) / max_chunks);
+}
+
+namespace {
+/** \brief The chunks of a parallel range
+ *
+ * The state is a task queued once per helper thread: helpers may start
+ * after the end of the call, they share the state.
+ */
+class ParallelTask final : public TaskRequestBase {
+public:
+    ParallelTask(size_t chunks, void (*run_chunk)(void*, size_t), void* context) :
+        TaskRequestBase(SchedulerNow()), chunks(chunks), next(0), done(0),
+        run_chunk(run_chunk), context(context) {};
+
+    void RunTask() override {
+        size_t i;
+        while ((i = next++) < chunks) {
+            run_chunk(context, i);
+            ++done;
+        }
+    }
+
+    bool Done() const {
+        return done == chunks;
+    }
+
+private:
+    const size_t chunks;
+    std::atomic<size_t> next;
+    std::atomic<size_t> done;
+    void (* const run_chunk)(void*, size_t);
+    // only used while the caller waits for the chunks
+    void* const context;
+};
+}
 
+void TrillekScheduler::ParallelRun(size_t chunks, chunk_fn run_chunk, void* context) {
+    const auto threads = worker_count.load();
+    if (chunks < 2 || threads < 2) {
+        for (size_t i = 0; i < chunks; ++i) {
+            run_chunk(context, i);
+        }
+        return;
+    }
+    auto state = MakeTask<ParallelTask>(chunks, run_chunk, context);
+    // the helpers run in the lane of the caller
+    state->SetLane(local_scheduler == this ? local_lane : TaskLane::FRAME);
+    const auto helpers = (std::min)(chunks, threads) - 1;
+    for (size_t h = 0; h < helpers; ++h) {
+        Queue(state);
+    }
+    state->RunTask();
+    // wait for the chunks taken by the helpers
+    while (! state->Done()) {
+        std::this_thread::yield();
+    }
+}
+
+void TrillekScheduler::Stop() {
+    stop_flag = true;
+    std::lock_guard<std::mutex> locker(m_sleep);
+    queuecheck.notify_all();
+}
+
+void TrillekScheduler::WaitStarted() {
+    std::unique_lock<std::mutex> locker(m_sleep);
+    queuecheck.wait(locker, [this]() { return worker_count || StopRequested(); });
+}
+
+bool TrillekScheduler::StopRequested() const {
+    return stop_flag || TrillekGame::GetTerminateFlag();
+}
+
+bool TrillekScheduler::Cancel(const TaskPtr<TaskRequestBase>& task) {
+    auto owner = task->TimerOwner();
+    if (! owner) {
+        return false;
+    }
+    Worker* target = owner == &injection.wheel ? &injection : nullptr;
+    const auto threads = worker_count.load();
+    for (size_t i = 0; ! target && i < threads; ++i) {
+        if (owner == &workers[i]->wheel) {
+            target = workers[i].get();
+        }
+    }
+    if (! target) {
+        return false;
+    }
+    TaskPtr<TaskRequestBase> pin;
+    {
+        std::lock_guard<std::mutex> locker(target->m_wheel);
+        if (! target->wheel.Cancel(task.get())) {
+            return false;
+        }
+        target->next_expiry = target->wheel.NextExpiry();
+        pin = std::move(task->timer_pin);
+    }
+    return true;
+}
+
+void TrillekScheduler::Dispatch(TaskPtr<TaskRequestBase>&& task) {
+    const bool own_thread = local_scheduler == this;
+    const auto threads = worker_count.load();
+    const bool pinned = task->Affinity() >= 0 && threads;
+    auto& target = pinned ? *workers[task->Affinity() % threads] :
+                    own_thread ? *workers[local_worker] : injection;
+    const bool own_queue = own_thread && &target == workers[local_worker].get();
+    if (! task->IsNow()) {
+        // round up: a task never runs before its timepoint
+        const auto deadline = Tick(task->Timepoint() + timer_tick - frame_unit(1));
+        auto raw = task.get();
+        bool earlier = false;
         {
-            // Wait for a task to do
-            // a lock to watch the blocking point
-            std::unique_lock<std::mutex> locker(m_timer);
-            // lock the queue while checking it
-            m_queue.lock();
-#if defined(_MSC_VER)
-            while (taskqueue.empty()
-                   || ! taskqueue.top()->IsNow()
-                   || scheduler_tp(TrillekGame::GetOS().GetTime()) >= next_frame_tp) {
-#else
-            while (taskqueue.empty()
-                   || ! taskqueue.top()->IsNow()
-                   || std::chrono::steady_clock::now() >= next_frame_tp) {
-#endif
-                const auto max_timepoint = taskqueue.empty() ? next_frame_tp :
-                                                            (std::min)(next_frame_tp, taskqueue.top()->Timepoint());
-                // unlock the queue when checking is done
-                m_queue.unlock();
-                // threads wait here (blocking point)
-                if (queuecheck.wait_until(locker, max_timepoint) == std::cv_status::timeout) {
-                    // we are here because we reached a timeout
-                    // release the lock of the blocking point
-                    m_timer.unlock();
-                    if (TrillekGame::GetTerminateFlag()) {
-                        LOGMSGC(INFO) << "Scheduler: Terminate signal detected for this thread...";
-                        // unblock all other threads waiting above
-                        queuecheck.notify_all();
-                        // save the state of the system
-                        terminate_functor();
-                        // lock the mutex before exiting the block
-                        m_timer.lock();
-                        return;
+            std::lock_guard<std::mutex> locker(target.m_wheel);
+            if (target.wheel.Empty()) {
+                target.wheel.Reset(Tick(SchedulerNow()));
+            }
+            raw->timer_pin = std::move(task);
+            if (target.wheel.Insert(raw, deadline)) {
+                const auto next = target.wheel.NextExpiry();
+                earlier = next < target.next_expiry;
+                target.next_expiry = next;
+            }
+            else {
+                // the deadline is in the current tick
+                task = std::move(raw->timer_pin);
+            }
+        }
+        if (! task) {
+            if (earlier && ! own_queue && sleepers) {
+                // sleeping threads must recompute their deadline
+                std::lock_guard<std::mutex> locker(m_sleep);
+                queuecheck.notify_all();
+            }
+            // the owner is running, it will see the new deadline before sleeping
+            return;
+        }
+    }
+    if (pinned) {
+        target.pinned[static_cast<unsigned int>(task->Lane())].Push(std::move(task));
+        if (! own_queue && sleepers) {
+            // only the owner can run it
+            std::lock_guard<std::mutex> locker(m_sleep);
+            queuecheck.notify_all();
+        }
+        return;
+    }
+    target.ready[static_cast<unsigned int>(task->Lane())].Push(std::move(task));
+    WakeOne();
+}
+
+void TrillekScheduler::WakeOne() {
+    if (sleepers) {
+        std::lock_guard<std::mutex> locker(m_sleep);
+        queuecheck.notify_one();
+    }
+}
+
+size_t TrillekScheduler::ExpireWheel(Worker& wheel, Worker& ready, const scheduler_tp& now) {
+    auto expire = [&](TaskRequestBase* task) {
+                    const auto lane = static_cast<unsigned int>(task->Lane());
+                    if (task->Affinity() >= 0 && ! workers.empty()) {
+                        workers[task->Affinity() % workers.size()]->pinned[lane].Push(std::move(task->timer_pin));
                     }
-#if defined(_MSC_VER)
-                    if (scheduler_tp(TrillekGame::GetOS().GetTime()) >= next_frame_tp) {
-#else
-                    if (std::chrono::steady_clock::now() >= next_frame_tp) {
-#endif
-                        // a new frame has begun : let's run the system
-                        handleEvents_functor(next_frame_tp.time_since_epoch().count());
-                        runBatch_functor();
-                        next_frame_tp += one_frame;
+                    else {
+                        ready.ready[lane].Push(std::move(task->timer_pin));
                     }
-                    // reacquire the lock of the blocking point
-                    m_timer.lock();
-                }
-                // we arrive directly here if a new task has been queued
-                // relock the queue before checking it
-                m_queue.lock();
+                };
+    const auto tick = Tick(now);
+    auto expired = wheel.wheel.Advance(tick, expire);
+    if (wheel.wheel.NextExpiry() == tick + 1) {
+        // deadlines are rounded up, the timepoint of a task may be reached
+        // before the start of its tick, e.g. when a virtual clock is stepped
+        expired += wheel.wheel.ExpireNext([&now](TaskRequestBase* task) { return task->Timepoint() <= now; },
+                                        expire);
+    }
+    wheel.next_expiry = wheel.wheel.NextExpiry();
+    return expired;
+}
+
+void TrillekScheduler::PromoteDelayed(unsigned int id, const scheduler_tp& now) {
+    auto& worker = *workers[id];
+    const auto tick = Tick(now);
+    size_t expired = 0;
+    if (worker.next_expiry <= tick + 1) {
+        std::lock_guard<std::mutex> locker(worker.m_wheel);
+        expired += ExpireWheel(worker, worker, now);
+    }
+    if (injection.next_expiry <= tick + 1) {
+        // another thread advancing the injection wheel does the job for us
+        std::unique_lock<std::mutex> locker(injection.m_wheel, std::try_to_lock);
+        if (locker.owns_lock()) {
+            expired += ExpireWheel(injection, worker, now);
+        }
+    }
+    // the owner of a wheel may be busy with a long task: its expired timers
+    // are moved by any thread, the tasks not pinned go to our queue
+    for (auto victim : worker.victims) {
+        auto& other = *workers[victim];
+        if (other.next_expiry <= tick + 1) {
+            std::unique_lock<std::mutex> locker(other.m_wheel, std::try_to_lock);
+            if (locker.owns_lock()) {
+                expired += ExpireWheel(other, worker, now);
             }
         }
-        // Get the task to do
-        task = taskqueue.top();
-        taskqueue.pop();
-        m_queue.unlock();
+    }
+    if (expired && sleepers) {
+        // let the sleeping threads steal the tasks or run their pinned tasks
+        std::lock_guard<std::mutex> locker(m_sleep);
+        queuecheck.notify_all();
+    }
+}
 
-        {
-            std::unique_lock<std::mutex> locker(m_count);
-            while(counter >= MAX_CONCURRENT_THREAD) {
-                // Wait the counter to be under MAX_CONCURRENT_THREAD
-                countercheck.wait(locker, [&](){return counter < MAX_CONCURRENT_THREAD;});
+bool TrillekScheduler::FindTask(unsigned int id, TaskPtr<TaskRequestBase>& task) {
+    for (unsigned int l = 0; l < TASK_LANES; ++l) {
+        if (lanes[l].running.load(std::memory_order_relaxed) >= lanes[l].limit.load(std::memory_order_relaxed)) {
+            // the lane is full, its tasks wait in the queues
+            continue;
+        }
+        if (! FindLaneTask(id, l, task)) {
+            continue;
+        }
+        if (Admit(l)) {
+            return true;
+        }
+        // the lane was filled by another thread meanwhile
+        SCHEDULER_TELEMETRY(workers[id]->telemetry.RecordAdmissionRejected();)
+        if (task->Affinity() >= 0) {
+            workers[id]->pinned[l].Push(std::move(task));
+        }
+        else {
+            workers[id]->ready[l].Push(std::move(task));
+        }
+    }
+    return false;
+}
+
+bool TrillekScheduler::FindLaneTask(unsigned int id, unsigned int lane, TaskPtr<TaskRequestBase>& task) {
+    if (workers[id]->pinned[lane].Steal(task) || workers[id]->ready[lane].Pop(task) || injection.ready[lane].Steal(task)) {
+        return true;
+    }
+    const auto& victims = workers[id]->victims;
+    for (auto victim : victims) {
+        if (workers[victim]->ready[lane].Steal(task)) {
+            SCHEDULER_TELEMETRY(workers[id]->telemetry.RecordSteal(true);)
+            return true;
+        }
+    }
+    SCHEDULER_TELEMETRY(
+        if (! victims.empty()) {
+            workers[id]->telemetry.RecordSteal(false);
+        }
+    )
+    return false;
+}
+
+bool TrillekScheduler::HasReadyTask(unsigned int id) const {
+    for (unsigned int l = 0; l < TASK_LANES; ++l) {
+        if (lanes[l].running >= lanes[l].limit) {
+            continue;
+        }
+        if (! injection.ready[l].Empty() || ! workers[id]->pinned[l].Empty()) {
+            return true;
+        }
+        for (const auto& w : workers) {
+            if (! w->ready[l].Empty()) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool TrillekScheduler::Admit(unsigned int lane) {
+    auto& admission = lanes[lane];
+    auto running = admission.running.load(std::memory_order_relaxed);
+    do {
+        if (running >= admission.limit.load(std::memory_order_relaxed)) {
+            return false;
+        }
+    } while (! admission.running.compare_exchange_weak(running, running + 1));
+    return true;
+}
+
+void TrillekScheduler::Release(unsigned int lane) {
+    auto& admission = lanes[lane];
+    // a thread going to sleep increments sleepers before reading running:
+    // it sees the lane available, or we see it sleeping
+    if (admission.running.fetch_sub(1) >= admission.limit.load(std::memory_order_relaxed) && sleepers) {
+        // the tasks of the lane may be pinned to any thread
+        std::lock_guard<std::mutex> locker(m_sleep);
+        queuecheck.notify_all();
+    }
+}
+
+void TrillekScheduler::UpdateLimit(unsigned int lane) {
+    auto limit = lanes[lane].requested.load();
+    if (! limit) {
+        limit = lane == static_cast<unsigned int>(TaskLane::BACKGROUND) ?
+                    (std::max)(static_cast<unsigned int>(worker_count.load()), 2u) - 1 :
+                    (std::numeric_limits<unsigned int>::max)();
+    }
+    lanes[lane].limit = limit;
+}
+
+void TrillekScheduler::SetConcurrencyLimit(TaskLane lane, unsigned int limit) {
+    const auto l = static_cast<unsigned int>(lane);
+    lanes[l].requested = limit;
+    UpdateLimit(l);
+    if (sleepers) {
+        // the tasks of the lane may be allowed to run now
+        std::lock_guard<std::mutex> locker(m_sleep);
+        queuecheck.notify_all();
+    }
+}
+
+unsigned int TrillekScheduler::ConcurrencyLimit(TaskLane lane) const {
+    return lanes[static_cast<unsigned int>(lane)].limit;
+}
+
+void TrillekScheduler::DayWork(unsigned int id) {
+    local_scheduler = this;
+    local_worker = id;
+    auto& worker = *workers[id];
+    SCHEDULER_TELEMETRY(worker.telemetry.Start(Nanoseconds(SchedulerNow()));)
+
+    while (1) {
+        auto current_tp = SchedulerNow();
+        PromoteDelayed(id, current_tp);
+
+        TaskPtr<TaskRequestBase> task;
+        if (! FindTask(id, task)) {
+            if (StopRequested()) {
+                LOGMSGC(INFO) << "Scheduler: Terminate signal detected for this thread...";
+                // unblock all other threads waiting below
+                std::lock_guard<std::mutex> locker(m_sleep);
+                queuecheck.notify_all();
+                local_scheduler = nullptr;
+                return;
             }
-            // increment counter when possible
-            counter.fetch_add(1, std::memory_order::memory_order_relaxed);
+            // Wait for a task to do
+            std::unique_lock<std::mutex> locker(m_sleep);
+            // a thread queuing a task reads sleepers after pushing it,
+            // we read the queues after incrementing sleepers: no wakeup is lost
+            ++sleepers;
+            if (! HasReadyTask(id) && ! stop_flag) {
+                // wake up at least once per frame to check the terminate flag
+                auto max_timepoint = current_tp + one_frame;
+                // the next deadline of all wheels, since we expire them all
+                auto next_tick = injection.next_expiry.load();
+                for (const auto& w : workers) {
+                    next_tick = (std::min)(next_tick, w->next_expiry.load());
+                }
+                if (next_tick != (std::numeric_limits<uint64_t>::max)()) {
+                    max_timepoint = (std::min)(max_timepoint, scheduler_tp(frame_unit(timer_tick.count() * static_cast<int64_t>(next_tick))));
+                }
+                // threads wait here (blocking point)
+                SCHEDULER_TELEMETRY(const auto sleep_start = SchedulerNow();)
+                scheduler_clock->WaitUntil(queuecheck, locker, max_timepoint);
+                SCHEDULER_TELEMETRY(worker.telemetry.RecordSleep(Nanoseconds(SchedulerNow() - sleep_start));)
+            }
+            --sleepers;
+            continue;
         }
 
+        // the task may be queued again and change while it runs
+        const auto lane = task->Lane();
+        SCHEDULER_TELEMETRY(
+            const auto& task_type = typeid(*task);
+            const auto ready = Nanoseconds(task->Timepoint());
+            const auto run_start = Nanoseconds(SchedulerNow());
+        )
+        local_lane = lane;
         task->RunTask();
+        SCHEDULER_TELEMETRY(worker.telemetry.RecordTask(task_type, ready, run_start, Nanoseconds(SchedulerNow()));)
 
-        // decrement counter
-        counter.fetch_sub(1, std::memory_order::memory_order_relaxed);
-        countercheck.notify_all();
+        // the task is admitted in FindTask()
+        Release(static_cast<unsigned int>(lane));
     }
 }
+
+#ifdef TRILLEK_TELEMETRY
+TelemetryReport TrillekScheduler::Telemetry() const {
+    TelemetryReport report;
+    const auto now = Nanoseconds(SchedulerNow());
+    std::unordered_map<std::string,std::pair<DurationHistogram,DurationHistogram>> types;
+    for (const auto& w : workers) {
+        const auto& t = w->telemetry;
+        const auto started = t.started.load(std::memory_order_relaxed);
+        TelemetryReport::Worker r = {
+            started && now > started ? static_cast<uint64_t>(now - started) : 0,
+            t.busy.load(std::memory_order_relaxed),
+            t.sleep.load(std::memory_order_relaxed),
+            t.tasks.load(std::memory_order_relaxed),
+            t.steals.load(std::memory_order_relaxed),
+            t.failed_steals.load(std::memory_order_relaxed),
+            t.sleeps.load(std::memory_order_relaxed),
+            t.admission_rejections.load(std::memory_order_relaxed)
+        };
+        report.workers.push_back(r);
+        t.MergeTypes(types);
+    }
+    for (auto& t : types) {
+        TelemetryReport::TaskType r = {DemangleTypeName(t.first.c_str()), t.second.first, t.second.second};
+        report.task_types.push_back(std::move(r));
+    }
+    for (const auto& job : system_jobs) {
+        TelemetryReport::System r = {
+            DemangleTypeName(typeid(*job->system).name()),
+            job->telemetry.frame.Snapshot(),
+            job->telemetry.overruns.load(std::memory_order_relaxed),
+            job->telemetry.skipped.load(std::memory_order_relaxed)
+        };
+        report.systems.push_back(std::move(r));
+    }
+    return report;
+}
+
+void TrillekScheduler::SetTrace(size_t capacity) {
+    trace_capacity = capacity;
+    for (auto& w : workers) {
+        w->telemetry.SetTrace(capacity);
+    }
+}
+
+void TrillekScheduler::WriteChromeTrace(std::ostream& out) const {
+    std::vector<std::vector<TraceEvent>> threads;
+    int64_t origin = (std::numeric_limits<int64_t>::max)();
+    for (const auto& w : workers) {
+        threads.push_back(w->telemetry.TraceEvents());
+        for (const auto& e : threads.back()) {
+            origin = (std::min)(origin, e.start);
+        }
+    }
+    WriteTraceEvents(out, threads, origin);
+}
+#endif
 }
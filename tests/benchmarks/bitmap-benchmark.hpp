@@ -0,0 +1,168 @@
+#ifndef BITMAPBENCHMARK_HPP_INCLUDED
+#define BITMAPBENCHMARK_HPP_INCLUDED
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "bitmap.hpp"
+#include "bitmap-expression.hpp"
+#include "compressed-bitmap.hpp"
+
+#include "gtest/gtest.h"
+
+namespace trillek {
+
+class BitMapBenchmark : public ::testing::Test {
+public:
+    // entity ids of the bitmaps
+    static const size_t IDS = 1 << 20;
+    static const unsigned int RUNS = 200;
+
+    /** \brief Make a bitmap with a fraction of the ids set
+     *
+     */
+    static BitMap<uint32_t> Random(unsigned int seed, unsigned int one_in) {
+        std::minstd_rand random(seed);
+        BitMap<uint32_t> bitmap(IDS);
+        for (size_t id = 0; id < IDS; ++id) {
+            bitmap[id] = random() % one_in == 0;
+        }
+        return bitmap;
+    }
+
+    /** \brief Measure the number of runs per second of a function
+     *
+     */
+    template<class F>
+    static double Throughput(F&& f) {
+        f();
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < RUNS; ++i) {
+            f();
+        }
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return RUNS / elapsed;
+    }
+};
+
+TEST_F(BitMapBenchmark, Operations) {
+    const auto a = Random(1, 4);
+    const auto b = Random(2, 8);
+    const auto c = Random(3, 2);
+    size_t sink = 0;
+    auto copy_and = Throughput([&]() { sink += (a & b).LastBlock(); });
+    auto in_place = a;
+    auto and_in_place = Throughput([&]() { in_place &= b; sink += in_place.LastBlock(); });
+    auto chained = Throughput([&]() { sink += (a & b & c).LastBlock(); });
+    auto not_copy = Throughput([&]() { sink += (~a).LastBlock(); });
+    auto count = Throughput([&]() { sink += a.countTrue(); });
+    std::cout << "[ BENCH    ] " << IDS << " ids: a & b " << copy_and << "/s, a &= b " << and_in_place
+                << "/s, a & b & c " << chained << "/s, ~a " << not_copy << "/s, countTrue() " << count
+                << "/s" << std::endl;
+    ASSERT_NE(sink, 0);
+}
+
+TEST_F(BitMapBenchmark, Sparse) {
+    // a few hundred entities scattered over the ids
+    std::minstd_rand random(4);
+    BitMap<uint32_t> a, b;
+    for (unsigned int i = 0; i < 300; ++i) {
+        a[random() % IDS] = true;
+        b[random() % IDS] = true;
+    }
+    const CompressedBitMap ca(a), cb(b);
+    size_t sink = 0;
+    auto dense = Throughput([&]() { sink += (a & b).LastBlock(); });
+    auto compressed = Throughput([&]() { sink += (ca & cb).Chunks(); });
+    std::cout << "[ BENCH    ] 300 ids in " << IDS << ": BitMap a & b " << dense << "/s, "
+                << (a.LastBlock() - a.FirstBlock()) * sizeof(uint32_t) << " bytes, CompressedBitMap a & b "
+                << compressed << "/s, " << ca.MemoryUsage() << " bytes" << std::endl;
+    ASSERT_NE(sink, 0);
+}
+
+TEST_F(BitMapBenchmark, Iteration) {
+    const auto a = Random(5, 64);
+    size_t sink = 0;
+    auto enumerator = Throughput([&]() {
+        for (auto i = a.enumerator(IDS); *i < a.size(); ++i) {
+            sink += *i;
+        }
+    });
+    auto true_bits = Throughput([&]() {
+        for (auto i : a.TrueBits()) {
+            sink += i;
+        }
+    });
+    std::cout << "[ BENCH    ] " << a.countTrue() << " ids in " << IDS << ": enumerator " << enumerator
+                << "/s, TrueBits() " << true_bits << "/s" << std::endl;
+    ASSERT_NE(sink, 0);
+}
+
+TEST_F(BitMapBenchmark, Expression) {
+    const auto a = Random(6, 2);
+    const auto b = Random(7, 2);
+    const auto c = Random(8, 2);
+    const auto d = Random(9, 2);
+    size_t sink = 0;
+    auto eager = Throughput([&]() { sink += (a & b & c & ~d).countTrue(); });
+    auto lazy = Throughput([&]() { sink += (Lazy(a) & b & c & ~Lazy(d)).countTrue(); });
+    auto eager_iteration = Throughput([&]() {
+        const auto result = a & b & c & ~d;
+        for (auto i : result.TrueBits()) {
+            sink += i;
+        }
+    });
+    auto lazy_iteration = Throughput([&]() {
+        for (auto i : (Lazy(a) & b & c & ~Lazy(d)).TrueBits()) {
+            sink += i;
+        }
+    });
+    auto materialized = Throughput([&]() { sink += BitMap<uint32_t>(Lazy(a) & b & c & ~Lazy(d)).LastBlock(); });
+    std::cout << "[ BENCH    ] " << IDS << " ids: (a & b & c & ~d).countTrue() " << eager << "/s, lazy " << lazy
+                << "/s, TrueBits() " << eager_iteration << "/s, lazy " << lazy_iteration << "/s, lazy materialized "
+                << materialized << "/s" << std::endl;
+    ASSERT_NE(sink, 0);
+}
+
+TEST_F(BitMapBenchmark, Insertion) {
+    // entity ids written in 3 orders, one bit in 4
+    const size_t ids = IDS / 4;
+    std::vector<size_t> ascending;
+    for (size_t i = 0; i < ids; ++i) {
+        ascending.push_back(4 * i);
+    }
+    std::vector<size_t> descending(ascending.rbegin(), ascending.rend());
+    std::vector<size_t> shuffled = ascending;
+    std::shuffle(shuffled.begin(), shuffled.end(), std::minstd_rand(10));
+    size_t sink = 0;
+    auto insert = [&](const std::vector<size_t>& order) {
+        return Throughput([&]() {
+            BitMap<uint32_t> bitmap;
+            for (auto id : order) {
+                bitmap[id] = true;
+            }
+            sink += bitmap.LastBlock();
+        });
+    };
+    auto ascending_rate = insert(ascending);
+    auto descending_rate = insert(descending);
+    auto random_rate = insert(shuffled);
+    auto reserved = Throughput([&]() {
+        BitMap<uint32_t> bitmap;
+        bitmap.reserve(0, IDS);
+        for (auto id : shuffled) {
+            bitmap[id] = true;
+        }
+        sink += bitmap.LastBlock();
+    });
+    std::cout << "[ BENCH    ] " << ids << " ids in " << IDS << ": ascending " << ascending_rate * ids
+                << " ids/s, descending " << descending_rate * ids << " ids/s, random " << random_rate * ids
+                << " ids/s, random after reserve() " << reserved * ids << " ids/s" << std::endl;
+    ASSERT_NE(sink, 0);
+}
+}
+
+#endif // BITMAPBENCHMARK_HPP_INCLUDED
@@ -0,0 +1,95 @@
+#ifndef COMPONENTBENCHMARK_HPP_INCLUDED
+#define COMPONENTBENCHMARK_HPP_INCLUDED
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include "trillek-allocator.hpp"
+
+#include "gtest/gtest.h"
+
+namespace trillek {
+
+/** \brief Replica of component::Container and ContainerObject
+ *
+ * The real ones need the component types of the game.
+ */
+class BenchContainer {
+public:
+    explicit BenchContainer(uint32_t type) : type(type) {};
+    virtual ~BenchContainer() {};
+    uint32_t type;
+};
+
+template<class T>
+class BenchContainerObject final : public BenchContainer {
+public:
+    explicit BenchContainerObject(const T& content) : BenchContainer(1), content(content) {};
+    T content;
+};
+
+// the size of a small component, e.g. a velocity
+struct BenchComponent {
+    float linear[4];
+    float angular[4];
+};
+
+class ComponentBenchmark : public ::testing::Test {
+public:
+    static const uint32_t ENTITIES = 10000;
+    static const unsigned int OPERATIONS = 500000;
+
+    /** \brief Measure the number of insert/update/remove per second
+     *
+     * The storage is the one of SystemContainer: a std::map of shared_ptr
+     * made by allocate_shared. A = std::allocator gives the former behaviour
+     * of TrillekAllocator, which called operator new for each node.
+     */
+    template<template<class> class A>
+    double Throughput() {
+        typedef std::map<uint32_t, std::shared_ptr<BenchContainer>, std::less<uint32_t>,
+                    A<std::pair<const uint32_t, std::shared_ptr<BenchContainer>>>> container_type;
+        container_type container;
+        std::minstd_rand random(1);
+        BenchComponent component = {{0, 0, 0, 0}, {0, 0, 0, 0}};
+        auto create = [&]() {
+            return std::static_pointer_cast<BenchContainer>(std::allocate_shared<BenchContainerObject<BenchComponent>>(
+                        A<BenchContainerObject<BenchComponent>>(), component));
+        };
+        for (uint32_t id = 0; id < ENTITIES; id += 2) {
+            container.insert(std::make_pair(id, create()));
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < OPERATIONS; ++i) {
+            const uint32_t id = random() % ENTITIES;
+            auto it = container.find(id);
+            if (it == container.end()) {
+                container.insert(std::make_pair(id, create()));
+            }
+            else if (i & 1) {
+                it->second = create();
+            }
+            else {
+                container.erase(it);
+            }
+        }
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return OPERATIONS / elapsed;
+    }
+};
+
+TEST_F(ComponentBenchmark, InsertUpdateRemove) {
+    // warm up the heap and the pool
+    Throughput<std::allocator>();
+    Throughput<TrillekAllocator>();
+    auto baseline = Throughput<std::allocator>();
+    auto pooled = Throughput<TrillekAllocator>();
+    std::cout << "[ BENCH    ] component churn: operator new " << baseline
+                << " ops/s, node pool " << pooled << " ops/s" << std::endl;
+}
+}
+
+#endif // COMPONENTBENCHMARK_HPP_INCLUDED
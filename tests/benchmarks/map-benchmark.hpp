@@ -0,0 +1,90 @@
+#ifndef MAPBENCHMARK_HPP_INCLUDED
+#define MAPBENCHMARK_HPP_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+#include "atomic-map.hpp"
+#include "concurrent-map.hpp"
+
+#include "gtest/gtest.h"
+
+namespace trillek {
+
+class MapBenchmark : public ::testing::Test {
+public:
+    static const unsigned int KEYS = 4096;
+    static const unsigned int OPERATIONS = 400000;
+
+    /** \brief Measure the number of operations per second on a map
+     *
+     * Each thread does OPERATIONS / nr_thread operations on random keys, a
+     * write (insert or erase) every write_period operations, a read otherwise.
+     */
+    template<class M>
+    double Throughput(unsigned int nr_thread, unsigned int write_period) {
+        M map;
+        for (unsigned int k = 0; k < KEYS; k += 2) {
+            map.Insert(k, uint64_t(k));
+        }
+        const unsigned int per_thread = OPERATIONS / nr_thread;
+        std::atomic<bool> go(false);
+        std::atomic<uint64_t> found(0);
+        std::vector<std::thread> threads;
+        for (unsigned int t = 0; t < nr_thread; ++t) {
+            threads.emplace_back([&, t]() {
+                std::minstd_rand random(t + 1);
+                uint64_t hits = 0;
+                while (! go) {
+                    std::this_thread::yield();
+                }
+                for (unsigned int i = 0; i < per_thread; ++i) {
+                    const unsigned int key = random() % KEYS;
+                    if (i % write_period) {
+                        hits += map.Count(key);
+                    }
+                    else if (key & 1) {
+                        map.Insert(key, uint64_t(i));
+                    }
+                    else {
+                        map.Erase(key);
+                    }
+                }
+                found += hits;
+            });
+        }
+        auto start = std::chrono::steady_clock::now();
+        go = true;
+        for (auto& t : threads) {
+            t.join();
+        }
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return per_thread * nr_thread / elapsed;
+    }
+
+    template<unsigned int WRITE_PERIOD>
+    void Compare(const char* name) {
+        for (unsigned int nr_thread : {1, 2, 4, 8}) {
+            auto baseline = Throughput<AtomicMap<unsigned int,uint64_t>>(nr_thread, WRITE_PERIOD);
+            auto sharded = Throughput<ConcurrentMap<unsigned int,uint64_t>>(nr_thread, WRITE_PERIOD);
+            std::cout << "[ BENCH    ] " << name << ", " << nr_thread << " threads: AtomicMap " << baseline
+                        << " ops/s, ConcurrentMap " << sharded << " ops/s" << std::endl;
+        }
+    }
+};
+
+TEST_F(MapBenchmark, ReadHeavy) {
+    // 1 write for 20 operations
+    Compare<20>("read-heavy");
+}
+
+TEST_F(MapBenchmark, WriteHeavy) {
+    // 1 write for 2 operations
+    Compare<2>("write-heavy");
+}
+}
+
+#endif // MAPBENCHMARK_HPP_INCLUDED
@@ -0,0 +1,110 @@
+#ifndef QUEUEBENCHMARK_HPP_INCLUDED
+#define QUEUEBENCHMARK_HPP_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "atomic-queue.hpp"
+#include "bounded-queue.hpp"
+
+#include "gtest/gtest.h"
+
+namespace trillek {
+
+/** \brief Give AtomicQueue the bool Push() of the bounded queues
+ */
+template<class T>
+class UnboundedQueue final {
+public:
+    template<class U>
+    bool Push(U&& element) const {
+        q.Push(std::forward<U>(element));
+        return true;
+    }
+
+    bool Pop(T& element) const {
+        return q.Pop(element);
+    }
+
+private:
+    AtomicQueue<T> q;
+};
+
+class QueueBenchmark : public ::testing::Test {
+public:
+    static const unsigned int ELEMENTS = 400000;
+    static const size_t CAPACITY = 1024;
+
+    /** \brief Measure the number of elements per second through a queue
+     *
+     * Producers push ELEMENTS elements in total, as many consumers pop them.
+     */
+    template<class Q>
+    double Throughput(Q& q, unsigned int producers, unsigned int consumers) {
+        const unsigned int per_producer = ELEMENTS / producers;
+        const unsigned int total = per_producer * producers;
+        std::atomic<unsigned int> popped(0);
+        std::atomic<bool> go(false);
+        std::vector<std::thread> threads;
+        for (unsigned int p = 0; p < producers; ++p) {
+            threads.emplace_back([&]() {
+                while (! go) {
+                    std::this_thread::yield();
+                }
+                for (unsigned int i = 0; i < per_producer; ++i) {
+                    while (! q.Push(i)) {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+        for (unsigned int c = 0; c < consumers; ++c) {
+            threads.emplace_back([&]() {
+                unsigned int value;
+                while (popped.load(std::memory_order_relaxed) < total) {
+                    if (q.Pop(value)) {
+                        popped.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    else {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+        auto start = std::chrono::steady_clock::now();
+        go = true;
+        for (auto& t : threads) {
+            t.join();
+        }
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return total / elapsed;
+    }
+};
+
+TEST_F(QueueBenchmark, ProducerContention) {
+    for (unsigned int producers : {1, 2, 4, 8, 16}) {
+        UnboundedQueue<unsigned int> locked;
+        BoundedQueue<unsigned int> lockfree(CAPACITY);
+        auto baseline = Throughput(locked, producers, 1);
+        auto bounded = Throughput(lockfree, producers, 1);
+        std::cout << "[ BENCH    ] " << producers << " producers: AtomicQueue " << baseline
+                    << " elements/s, BoundedQueue " << bounded << " elements/s" << std::endl;
+    }
+}
+
+TEST_F(QueueBenchmark, SingleProducerPipe) {
+    UnboundedQueue<unsigned int> locked;
+    BoundedQueue<unsigned int> mpmc(CAPACITY);
+    SpscQueue<unsigned int> spsc(CAPACITY);
+    auto baseline = Throughput(locked, 1, 1);
+    auto bounded = Throughput(mpmc, 1, 1);
+    auto pipe = Throughput(spsc, 1, 1);
+    std::cout << "[ BENCH    ] 1 producer, 1 consumer: AtomicQueue " << baseline
+                << " elements/s, BoundedQueue " << bounded << " elements/s, SpscQueue "
+                << pipe << " elements/s" << std::endl;
+}
+}
+
+#endif // QUEUEBENCHMARK_HPP_INCLUDED
@@ -0,0 +1,237 @@
+#ifndef SCHEDULERBENCHMARK_HPP_INCLUDED
+#define SCHEDULERBENCHMARK_HPP_INCLUDED
+
+#include <thread>
+#include <iostream>
+#include <queue>
+#include "trillek-scheduler.hpp"
+
+#include "gtest/gtest.h"
+
+namespace trillek {
+
+/** \brief Order tasks by timepoint, the earliest on top of a heap
+ */
+struct TaskLater final {
+    bool operator()(const TaskPtr<TaskRequestBase>& lhs, const TaskPtr<TaskRequestBase>& rhs) const {
+        return rhs->Timepoint() < lhs->Timepoint();
+    }
+};
+
+/** \brief Replica of the single-queue scheduler loop, used as a baseline
+ *
+ * All threads share one priority queue protected by one mutex, and wait on a
+ * blocking point mutex before checking the queue.
+ */
+class SingleQueueScheduler final {
+public:
+    // the former compile-time admission limit
+    static const int MAX_CONCURRENT_THREAD = 4;
+
+    SingleQueueScheduler() : counter(0), stop_flag(false) {};
+
+    void Initialize(unsigned int nr_thread) {
+        std::list<std::thread> thread_list;
+        for (unsigned int i = 0; i < nr_thread; ++i) {
+            thread_list.push_back(std::thread(&SingleQueueScheduler::DayWork, this));
+        }
+        for (auto& t : thread_list) {
+            t.join();
+        }
+    }
+
+    template<class T>
+    void Queue(T&& task) {
+        m_queue.lock();
+        taskqueue.push(std::forward<T>(task));
+        m_queue.unlock();
+        queuecheck.notify_one();
+    }
+
+    void Stop() {
+        stop_flag = true;
+        queuecheck.notify_all();
+    }
+
+private:
+    void DayWork() {
+        while (1) {
+            TaskPtr<TaskRequestBase> task;
+            {
+                std::unique_lock<std::mutex> locker(m_timer);
+                m_queue.lock();
+                while (taskqueue.empty() || ! taskqueue.top()->IsNow()) {
+                    m_queue.unlock();
+                    if (stop_flag) {
+                        queuecheck.notify_all();
+                        return;
+                    }
+                    queuecheck.wait_for(locker, std::chrono::milliseconds(1));
+                    m_queue.lock();
+                }
+            }
+            task = taskqueue.top();
+            taskqueue.pop();
+            m_queue.unlock();
+            {
+                std::unique_lock<std::mutex> locker(m_count);
+                countercheck.wait(locker, [&](){return counter < MAX_CONCURRENT_THREAD;});
+                counter.fetch_add(1, std::memory_order_relaxed);
+            }
+            task->RunTask();
+            counter.fetch_sub(1, std::memory_order_relaxed);
+            countercheck.notify_all();
+        }
+    }
+
+    std::priority_queue<TaskPtr<TaskRequestBase>, std::vector<TaskPtr<TaskRequestBase>>, TaskLater> taskqueue;
+    std::condition_variable countercheck;
+    std::atomic<int> counter;
+    std::mutex m_count;
+    std::mutex m_queue;
+    std::mutex m_timer;
+    std::condition_variable queuecheck;
+    std::atomic<bool> stop_flag;
+};
+
+class SchedulerBenchmark : public ::testing::Test {
+public:
+    static const unsigned int ROOTS = 64;
+    static const unsigned int LEAVES = 1000;
+    static const unsigned int WAKEUPS = 200;
+    static const unsigned int TIMERS = 50000;
+
+    /** \brief Measure the number of tasks per second
+     *
+     * Each root task queues LEAVES tasks from inside the scheduler.
+     */
+    template<class S>
+    double Throughput(unsigned int nr_thread) {
+        S scheduler;
+        std::atomic<unsigned int> done(0);
+        std::thread runner([&]() { scheduler.Initialize(nr_thread); });
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int r = 0; r < ROOTS; ++r) {
+            scheduler.Queue(MakeTaskRequest([&]() {
+                for (unsigned int l = 0; l < LEAVES; ++l) {
+                    scheduler.Queue(MakeTaskRequest([&]() {
+                        ++done;
+                    }));
+                }
+            }));
+        }
+        while (done < ROOTS * LEAVES) {
+            std::this_thread::yield();
+        }
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        scheduler.Stop();
+        runner.join();
+        return ROOTS * LEAVES / elapsed;
+    }
+
+    /** \brief Measure the mean delay between queuing a task and running it
+     *
+     * Tasks are queued from an outside thread while all workers are idle.
+     */
+    template<class S>
+    double WakeupLatency(unsigned int nr_thread) {
+        S scheduler;
+        std::atomic<int64_t> total(0);
+        std::atomic<unsigned int> done(0);
+        std::thread runner([&]() { scheduler.Initialize(nr_thread); });
+        for (unsigned int i = 0; i < WAKEUPS; ++i) {
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+            auto queued = std::chrono::steady_clock::now();
+            scheduler.Queue(MakeTaskRequest([&, queued]() {
+                total += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - queued).count();
+                ++done;
+            }));
+            while (done <= i) {
+                std::this_thread::yield();
+            }
+        }
+        scheduler.Stop();
+        runner.join();
+        return total / double(WAKEUPS) / 1000.0;
+    }
+
+    /** \brief Measure the time spent to queue short delayed tasks
+     *
+     * A task queues TIMERS tasks with delays between 1 and 10 ms. The time
+     * returned is the time per queued task.
+     */
+    template<class S>
+    double DelayedQueue(unsigned int nr_thread) {
+        S scheduler;
+        std::atomic<unsigned int> done(0);
+        std::atomic<int64_t> queue_time(0);
+        std::thread runner([&]() { scheduler.Initialize(nr_thread); });
+        scheduler.Queue(MakeTaskRequest([&]() {
+            auto start = std::chrono::steady_clock::now();
+            for (unsigned int t = 0; t < TIMERS; ++t) {
+                scheduler.Queue(MakeTaskRequest([&]() {
+                    ++done;
+                }, frame_unit(1000000 + (t % 10) * 1000000)));
+            }
+            queue_time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        }));
+        while (done < TIMERS) {
+            std::this_thread::yield();
+        }
+        scheduler.Stop();
+        runner.join();
+        return queue_time / double(TIMERS);
+    }
+};
+
+/** \brief TrillekScheduler takes a queue of systems, the baseline does not
+ */
+class WorkStealingScheduler final {
+public:
+    void Initialize(unsigned int nr_thread) {
+        std::queue<SystemBase*> systems;
+        scheduler.Initialize(nr_thread, systems);
+    }
+
+    template<class T>
+    void Queue(T&& task) {
+        scheduler.Queue(std::forward<T>(task));
+    }
+
+    void Stop() {
+        scheduler.Stop();
+    }
+
+private:
+    TrillekScheduler scheduler;
+};
+
+TEST_F(SchedulerBenchmark, TasksPerSecond) {
+    for (unsigned int nr_thread : {1, 2, 4, 8}) {
+        auto baseline = Throughput<SingleQueueScheduler>(nr_thread);
+        auto stealing = Throughput<WorkStealingScheduler>(nr_thread);
+        std::cout << "[ BENCH    ] " << nr_thread << " threads: single queue " << baseline
+                    << " tasks/s, work stealing " << stealing << " tasks/s" << std::endl;
+    }
+}
+
+TEST_F(SchedulerBenchmark, WakeupLatency) {
+    for (unsigned int nr_thread : {1, 4, 8}) {
+        auto baseline = WakeupLatency<SingleQueueScheduler>(nr_thread);
+        auto stealing = WakeupLatency<WorkStealingScheduler>(nr_thread);
+        std::cout << "[ BENCH    ] " << nr_thread << " threads: single queue " << baseline
+                    << " us, work stealing " << stealing << " us" << std::endl;
+    }
+}
+
+TEST_F(SchedulerBenchmark, DelayedTasks) {
+    for (unsigned int nr_thread : {1, 4}) {
+        auto baseline = DelayedQueue<SingleQueueScheduler>(nr_thread);
+        auto wheel = DelayedQueue<WorkStealingScheduler>(nr_thread);
+        std::cout << "[ BENCH    ] " << nr_thread << " threads: heap " << baseline
+                    << " ns/timer, timing wheel " << wheel << " ns/timer" << std::endl;
+    }
+}
+}
+
+#endif // SCHEDULERBENCHMARK_HPP_INCLUDED
@@ -0,0 +1,40 @@
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace trillek {
+// set by the tests measuring the allocations
+std::atomic<bool> count_operator_new(false);
+// the number of calls of the global operator new while counting
+std::atomic<uint64_t> operator_new_calls(0);
+}
+
+// the replacement applies to the whole test program, but only counts when a
+// test enables it
+void* operator new(std::size_t size) {
+    if (trillek::count_operator_new.load(std::memory_order_relaxed)) {
+        trillek::operator_new_calls.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (auto p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    if (trillek::count_operator_new.load(std::memory_order_relaxed)) {
+        trillek::operator_new_calls.fetch_add(1, std::memory_order_relaxed);
+    }
+    return std::malloc(size ? size : 1);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+#if defined(__cpp_sized_deallocation)
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+#endif
@@ -1,6 +1,10 @@
 #ifndef ATOMICQUEUETEST_H_INCLUDED
 #define ATOMICQUEUETEST_H_INCLUDED
 
+#include <iterator>
+#include <list>
+#include <thread>
+#include <vector>
 #include "atomic-queue.hpp"
 
 #include "gtest/gtest.h"
@@ -31,7 +35,7 @@ TEST_F(AtomicQueueTest, AtomicQueueOneElement) {
     ASSERT_EQ(i, 1) << "Queue popped  wrong value";
     ASSERT_TRUE(q.Empty()) << "Queue is not empty";
     ASSERT_TRUE(q.Poll().empty()) << "Polled queue gives elements";
-    ASSERT_EQ(gAllocatedSize, 0) << "Allocated size is not null";
+    ASSERT_EQ(MemoryAccounting::Query(MemoryAccounting::GENERAL).current_bytes, 0) << "Allocated size is not null";
 }
 
 TEST_F(AtomicQueueTest, AtomicQueuePoll) {
@@ -47,7 +51,7 @@ TEST_F(AtomicQueueTest, AtomicQueuePoll) {
     ASSERT_EQ(ret.front(), 2) << "Second element from Poll has wrong value";
     ret.pop_front();
     ASSERT_TRUE(ret.empty()) << "Returned list from Poll() has more than 2 elements";
-    ASSERT_EQ(gAllocatedSize, 0) << "Allocated size is not null";
+    ASSERT_EQ(MemoryAccounting::Query(MemoryAccounting::GENERAL).current_bytes, 0) << "Allocated size is not null";
 }
 
 TEST_F(AtomicQueueTest, AtomicQueuePop) {
@@ -62,7 +66,7 @@ TEST_F(AtomicQueueTest, AtomicQueuePop) {
     ASSERT_EQ(i, 2) << "Pop()  wrong value";
     ASSERT_TRUE(q.Empty()) << "Queue is not empty";
     ASSERT_TRUE(q.Poll().empty()) << "Empty queue gives elements";
-    ASSERT_EQ(gAllocatedSize, 0) << "Allocated size is not null";
+    ASSERT_EQ(MemoryAccounting::Query(MemoryAccounting::GENERAL).current_bytes, 0) << "Allocated size is not null";
 }
 
 TEST_F(AtomicQueueTest, AtomicQueueCopyList) {
@@ -82,7 +86,7 @@ TEST_F(AtomicQueueTest, AtomicQueueCopyList) {
 }
 
 TEST_F(AtomicQueueTest, AtomicQueueMoveList) {
-    auto alloc_backup = gAllocatedSize;
+    auto alloc_backup = MemoryAccounting::Query(MemoryAccounting::GENERAL).current_bytes;
     std::list<uint32_t, TrillekAllocator<uint32_t>> a{1,2,3,4,5};
     q.PushList(std::move(a));
     ASSERT_FALSE(q.Empty()) << "Queue is empty";
@@ -97,5 +101,62 @@ TEST_F(AtomicQueueTest, AtomicQueueMoveList) {
     ASSERT_TRUE(q.Empty()) << "Queue is not empty";
     ASSERT_TRUE(q.Poll().empty()) << "Polled queue gives elements";
 }
+
+TEST_F(AtomicQueueTest, AtomicQueueMoveListOtherTag) {
+    const auto tag = MemoryAccounting::Tag("test queue producer");
+    const auto before = MemoryAccounting::Query(tag).current_bytes;
+    {
+        // a list built in a system, pushed to a queue built outside
+        MemoryTagScope scope(tag);
+        std::list<uint32_t, TrillekAllocator<uint32_t>> a{1,2,3};
+        q.PushList(std::move(a));
+    }
+    auto ret = q.Poll();
+    ASSERT_EQ(ret.size(), 3) << "Poll does not return all elements";
+    ASSERT_EQ(ret.back(), 3) << "Last element from Poll has wrong value";
+    ret.clear();
+    MemoryAccounting::Flush();
+    ASSERT_EQ(MemoryAccounting::Query(tag).current_bytes, before) << "Nodes not freed under their tag";
+    ASSERT_EQ(MemoryAccounting::Query(MemoryAccounting::GENERAL).current_bytes, 0) << "Allocated size is not null";
+}
+
+TEST_F(AtomicQueueTest, AtomicQueuePopBulk) {
+    for (uint32_t i = 1; i < 6; ++i) {
+        q.Push(i);
+    }
+    ASSERT_EQ(q.SizeApprox(), 5) << "Wrong size";
+    uint32_t buffer[3] = {0, 0, 0};
+    ASSERT_EQ(q.PopBulk(buffer, 3), 3) << "PopBulk() does not fill the buffer";
+    for (uint32_t i = 0; i < 3; ++i) {
+        ASSERT_EQ(buffer[i], i + 1) << i << "th element from PopBulk has wrong value";
+    }
+    ASSERT_EQ(q.SizeApprox(), 2) << "Wrong size";
+    std::vector<uint32_t> rest;
+    ASSERT_EQ(q.PopBulk(std::back_inserter(rest), 10), 2) << "PopBulk() does not pop the remaining elements";
+    ASSERT_EQ(rest.front(), 4) << "First remaining element has wrong value";
+    ASSERT_EQ(rest.back(), 5) << "Last remaining element has wrong value";
+    ASSERT_TRUE(q.Empty()) << "Queue is not empty";
+    ASSERT_EQ(q.SizeApprox(), 0) << "Wrong size";
+    ASSERT_EQ(q.PopBulk(buffer, 3), 0) << "Empty queue gives elements";
+    ASSERT_EQ(MemoryAccounting::Query(MemoryAccounting::GENERAL).current_bytes, 0) << "Allocated size is not null";
+}
+
+TEST_F(AtomicQueueTest, AtomicQueueWaitPop) {
+    uint32_t i = 0;
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_FALSE(q.WaitPop(i, std::chrono::milliseconds(20))) << "Empty queue gives an element";
+    ASSERT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(20)) << "WaitPop() returned before the timeout";
+    std::thread producer([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        q.Push(7);
+    });
+    ASSERT_TRUE(q.WaitPop(i, std::chrono::seconds(10))) << "WaitPop() missed the pushed element";
+    ASSERT_EQ(i, 7) << "WaitPop() wrong value";
+    producer.join();
+    q.Push(8);
+    ASSERT_TRUE(q.WaitPop(i, std::chrono::seconds(0))) << "WaitPop() does not pop an available element";
+    ASSERT_EQ(i, 8) << "WaitPop() wrong value";
+    ASSERT_TRUE(q.Empty()) << "Queue is not empty";
+}
 }
 #endif // ATOMICQUEUETEST_H_INCLUDED
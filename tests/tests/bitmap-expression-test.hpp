@@ -0,0 +1,101 @@
+#ifndef BITMAPEXPRESSIONTEST_HPP_INCLUDED
+#define BITMAPEXPRESSIONTEST_HPP_INCLUDED
+
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "bitmap.hpp"
+#include "bitmap-expression.hpp"
+
+#include "gtest/gtest.h"
+
+namespace trillek {
+
+class BitMapExpressionTest : public ::testing::Test {
+public:
+    /** \brief Make a bitmap storing a random range of blocks
+     *
+     */
+    static BitMap<uint32_t> Random(std::minstd_rand& random) {
+        BitMap<uint32_t> bitmap(random() % 2 != 0);
+        const size_t first = random() % 3000;
+        const size_t last = first + random() % 3000;
+        for (size_t id = first; id < last; ++id) {
+            if (random() % 3 == 0) {
+                bitmap[id] = ! bitmap.DefaultValue();
+            }
+        }
+        return bitmap;
+    }
+
+    /** \brief Check that an expression reads as its eager result
+     *
+     */
+    template<class E>
+    static void ExpectEqual(const BitMap<uint32_t>& expected, const BitMapExpression<E, uint32_t>& expression,
+                            const char* operation) {
+        ASSERT_EQ(expected.DefaultValue(), expression.DefaultValue()) << operation << ": wrong default value";
+        ASSERT_EQ(expected.size(), expression.size()) << operation << ": wrong size";
+        ASSERT_EQ(expected.countTrue(), expression.countTrue()) << operation << ": wrong countTrue()";
+        const BitMap<uint32_t> materialized = expression;
+        const auto last = expected.size() + 100;
+        std::vector<size_t> eager, visited, iterated, evaluated;
+        expected.ForEachTrue(5, last, [&](size_t i) { eager.push_back(i); });
+        expression.ForEachTrue(5, last, [&](size_t i) { visited.push_back(i); });
+        for (auto i : expression.TrueBits(5, last)) {
+            iterated.push_back(i);
+        }
+        materialized.ForEachTrue(5, last, [&](size_t i) { evaluated.push_back(i); });
+        ASSERT_EQ(eager, visited) << operation << ": wrong ForEachTrue()";
+        ASSERT_EQ(eager, iterated) << operation << ": wrong TrueBits()";
+        ASSERT_EQ(eager, evaluated) << operation << ": wrong materialized bitmap";
+        for (size_t i = 0; i < last; i += 37) {
+            ASSERT_EQ(expected.at(i), expression.at(i)) << operation << ": wrong bit " << i;
+        }
+    }
+};
+
+TEST_F(BitMapExpressionTest, BitMapExpressionOperations) {
+    std::minstd_rand random(1);
+    for (int i = 0; i < 20; ++i) {
+        const auto a = Random(random);
+        const auto b = Random(random);
+        const auto c = Random(random);
+        const auto d = Random(random);
+        ExpectEqual(a & b, Lazy(a) & b, "AND");
+        ExpectEqual(a | b, Lazy(a) | b, "OR");
+        ExpectEqual(a ^ b, a ^ Lazy(b), "XOR");
+        ExpectEqual(~a, ~Lazy(a), "NOT");
+        ExpectEqual(a & b & c & d, Lazy(a) & b & c & d, "4 ANDs");
+        ExpectEqual((a | ~b) & (c ^ d), (Lazy(a) | ~Lazy(b)) & (Lazy(c) ^ d), "Mixed operations");
+    }
+}
+
+TEST_F(BitMapExpressionTest, BitMapExpressionBlocks) {
+    BitMap<uint32_t> a, b, c(true);
+    a[100] = true;
+    a[5000] = true;
+    b[5000] = true;
+    b[9000] = true;
+    c[5000] = false;
+    // the result of a & b is bounded by the blocks stored by both
+    const auto both = Lazy(a) & b;
+    ASSERT_EQ(5000 / 32, both.FirstBlock()) << "Blocks of a & b";
+    ASSERT_EQ(a.FirstBlock(), (Lazy(a) & c).FirstBlock()) << "Blocks of a & c";
+    ASSERT_EQ(a.LastBlock(), (Lazy(a) & c).LastBlock()) << "Blocks of a & c";
+    ASSERT_EQ(1, both.countTrue()) << "countTrue() of a & b";
+    ASSERT_EQ(5000, *both.TrueBits().begin()) << "TrueBits() of a & b";
+    ASSERT_EQ(1, (Lazy(a) & c).countTrue()) << "countTrue() of a & c";
+    size_t count = 0;
+    for (auto i : (Lazy(a) | b).TrueBits()) {
+        (void) i;
+        ++count;
+    }
+    ASSERT_EQ(3, count) << "TrueBits() of a temporary expression";
+    BitMap<uint32_t> result = Lazy(a) & ~Lazy(b);
+    ASSERT_TRUE(result.at(100)) << "Materialized a & ~b";
+    ASSERT_FALSE(result.at(5000)) << "Materialized a & ~b";
+}
+}
+
+#endif // BITMAPEXPRESSIONTEST_HPP_INCLUDED
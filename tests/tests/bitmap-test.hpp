@@ -432,6 +432,186 @@ TEST_F(BitMapTest, BitMapCountTrueDefaultTrue64) {
     ASSERT_EQ(567, count) << "countTrue()";
 }
 #endif
+
+TEST_F(BitMapTest, BitMapKernels) {
+    // lengths covering the vector loops and the scalar tails
+    for (size_t n : {0, 1, 3, 4, 7, 8, 9, 31, 64, 257}) {
+        std::vector<uint32_t> a(n), b(n);
+        for (size_t i = 0; i < n; ++i) {
+            a[i] = static_cast<uint32_t>(next(0xffff) << 16 | next(0xffff));
+            b[i] = static_cast<uint32_t>(next(0xffff) << 16 | next(0xffff));
+        }
+        size_t count = 0;
+        for (auto v : a) {
+            count += util::PopCount<uint32_t>(v);
+        }
+        ASSERT_EQ(count, util::PopCountBlocks(a.data(), n)) << "PopCountBlocks() with " << n << " blocks";
+        auto and_result = a, or_result = a, xor_result = a, not_result = a;
+        util::MixBlocks(and_result.data(), b.data(), n, util::BitAnd());
+        util::MixBlocks(or_result.data(), b.data(), n, util::BitOr());
+        util::MixBlocks(xor_result.data(), b.data(), n, util::BitXor());
+        util::NotBlocks(not_result.data(), not_result.data(), n);
+        for (size_t i = 0; i < n; ++i) {
+            ASSERT_EQ(a[i] & b[i], and_result[i]) << "AND at block " << i << " of " << n;
+            ASSERT_EQ(a[i] | b[i], or_result[i]) << "OR at block " << i << " of " << n;
+            ASSERT_EQ(a[i] ^ b[i], xor_result[i]) << "XOR at block " << i << " of " << n;
+            ASSERT_EQ(~a[i], not_result[i]) << "NOT at block " << i << " of " << n;
+        }
+    }
+    std::vector<uint64_t> ones(33, ~uint64_t(0));
+    ASSERT_EQ(33 * 64, util::PopCountBlocks(ones.data(), ones.size())) << "PopCountBlocks() with 64-bit blocks";
+}
+
+TEST_F(BitMapTest, BitMapInPlace) {
+    for(auto i = 0; i < 5; ++i) {
+        BitMap<uint64_t> a((size_t) next(2500), next(2) != 0);
+        BitMap<uint64_t> b((size_t) next(2500), next(2) != 0);
+        Populate(a, b);
+        auto result = a;
+        result &= b;
+        EXPECT_TRUE(Compare(a, b, result, [](bool lhs, bool rhs) { return lhs && rhs; })) << "&= differs";
+        result = a;
+        result |= b;
+        EXPECT_TRUE(Compare(a, b, result, [](bool lhs, bool rhs) { return lhs || rhs; })) << "|= differs";
+        result = a;
+        result ^= b;
+        EXPECT_TRUE(Compare(a, b, result, [](bool lhs, bool rhs) { return lhs != rhs; })) << "^= differs";
+        // temporaries are reused
+        result = (a & b) | a;
+        EXPECT_TRUE(Compare(a, b, result, [](bool lhs, bool) { return lhs; })) << "Chained operators differ";
+        result = a;
+        result.flip();
+        for (size_t j = 0; j < a.size() + 100; ++j) {
+            ASSERT_NE(a.at(j), result.at(j)) << "flip() differs at " << j;
+        }
+        ASSERT_EQ(a.size(), a.countTrue() + (~a).countTrue()) << "countTrue() of a and ~a";
+    }
+}
+
+TEST_F(BitMapTest, BitMapForEachTrue) {
+    BitMap<uint32_t> bit_array;
+    std::vector<size_t> expected = {40, 63, 64, 100, 130};
+    for (auto i : expected) {
+        bit_array[i] = true;
+    }
+    std::vector<size_t> found;
+    bit_array.ForEachTrue(0, 200, [&](size_t i) { found.push_back(i); });
+    ASSERT_EQ(expected, found) << "ForEachTrue() on the whole bitmap";
+    found.clear();
+    bit_array.ForEachTrue(41, 130, [&](size_t i) { found.push_back(i); });
+    ASSERT_EQ(std::vector<size_t>({63, 64, 100}), found) << "ForEachTrue() on a range";
+    BitMap<uint32_t> default_true(true);
+    default_true[40] = false;
+    found.clear();
+    default_true.ForEachTrue(30, 70, [&](size_t i) { found.push_back(i); });
+    ASSERT_EQ(39, found.size()) << "ForEachTrue() with default value true";
+    ASSERT_EQ(30, found.front());
+    ASSERT_EQ(69, found.back());
+}
+
+TEST_F(BitMapTest, BitMapTrueBits) {
+    BitMap<uint32_t> bit_array;
+    std::vector<size_t> expected = {40, 63, 64, 100, 130};
+    for (auto i : expected) {
+        bit_array[i] = true;
+    }
+    std::vector<size_t> found;
+    for (auto i : bit_array.TrueBits()) {
+        found.push_back(i);
+    }
+    ASSERT_EQ(expected, found) << "TrueBits() on the whole bitmap";
+    found.clear();
+    for (auto i : bit_array.TrueBits(41, 130)) {
+        found.push_back(i);
+    }
+    ASSERT_EQ(std::vector<size_t>({63, 64, 100}), found) << "TrueBits() on a range";
+    ASSERT_TRUE(BitMap<uint32_t>().TrueBits().begin() == BitMap<uint32_t>().TrueBits().end()) << "Empty bitmap";
+    BitMap<uint32_t> far;
+    far[1000] = true;
+    ASSERT_TRUE(far.TrueBits(0, 100).begin() == far.TrueBits(0, 100).end()) << "Range before the stored blocks";
+    ASSERT_EQ(1000, *far.TrueBits(0, 2000).begin()) << "Jump to the stored blocks";
+    BitMap<uint32_t> ones(size_t(70), true);
+    ones[3] = false;
+    ASSERT_EQ(69, std::distance(ones.TrueBits().begin(), ones.TrueBits().end())) << "TrueBits() stops at size()";
+    // same bits as ForEachTrue(), including the default value outside the blocks
+    for(auto i = 0; i < 5; ++i) {
+        BitMap<uint64_t> a((size_t) next(2500), next(2) != 0);
+        BitMap<uint64_t> b((size_t) next(2500), next(2) != 0);
+        Populate(a, b);
+        const size_t first = next(500);
+        const size_t last = first + next(3000);
+        std::vector<size_t> iterated, visited;
+        for (auto j : a.TrueBits(first, last)) {
+            iterated.push_back(j);
+        }
+        a.ForEachTrue(first, last, [&](size_t j) { visited.push_back(j); });
+        ASSERT_EQ(visited, iterated) << "TrueBits(" << first << ", " << last << ") with default value " << a.DefaultValue();
+    }
+}
+
+TEST_F(BitMapTest, BitMapGrowth) {
+    // ascending, descending and random writes give the same bitmap
+    std::vector<size_t> ids;
+    for (size_t i = 0; i < 3000; ++i) {
+        ids.push_back(1000 + 7 * i);
+    }
+    BitMap<uint32_t> ascending, descending, shuffled;
+    for (auto id : ids) {
+        ascending[id] = true;
+    }
+    for (auto it = ids.rbegin(); it != ids.rend(); ++it) {
+        descending[*it] = true;
+    }
+    std::vector<size_t> order = ids;
+    for (size_t i = order.size() - 1; i > 0; --i) {
+        std::swap(order[i], order[next(static_cast<unsigned int>(i + 1))]);
+    }
+    for (auto id : order) {
+        shuffled[id] = true;
+    }
+    for (auto bitmap : {&ascending, &descending, &shuffled}) {
+        ASSERT_EQ(ids.size(), bitmap->countTrue()) << "Wrong countTrue() after growth";
+        ASSERT_EQ(1000 / 32, bitmap->FirstBlock()) << "Free blocks should not be stored";
+        ASSERT_EQ((ids.back() / 32) + 1, bitmap->LastBlock()) << "Free blocks should not be stored";
+        std::vector<size_t> found;
+        for (auto i : bitmap->TrueBits()) {
+            found.push_back(i);
+        }
+        ASSERT_EQ(ids, found) << "Wrong bits after growth";
+    }
+    // the free blocks take the default value when they are used
+    BitMap<uint32_t> default_true(true);
+    default_true[5000] = false;
+    default_true[100] = false;
+    default_true[9000] = false;
+    ASSERT_EQ(9001 - 3, default_true.countTrue()) << "Growth with default value true";
+    default_true.flip();
+    default_true[20] = false;
+    ASSERT_EQ(3, default_true.countTrue()) << "Growth after flip()";
+    BitMap<uint32_t> copy = default_true;
+    ASSERT_EQ(default_true.countTrue(), copy.countTrue()) << "Copy of a bitmap with free blocks";
+    copy.clear();
+    copy[4] = true;
+    ASSERT_EQ(1, copy.countTrue()) << "Write after clear()";
+}
+
+TEST_F(BitMapTest, BitMapReserve) {
+    BitMap<uint32_t> bitmap;
+    bitmap.reserve(1000, 100000);
+    ASSERT_EQ(0, bitmap.countTrue()) << "reserve() changed the bits";
+    ASSERT_EQ(0, bitmap.size()) << "reserve() changed the size";
+    bitmap[50000] = true;
+    const auto data = bitmap.data();
+    bitmap[1000] = true;
+    bitmap[100000] = true;
+    ASSERT_EQ(data - (50000 - 1000) / 32, bitmap.data()) << "Writes in the reserved range reallocated the blocks";
+    bitmap.reserve(0, 10);
+    ASSERT_EQ(3, bitmap.countTrue()) << "reserve() lost bits";
+    ASSERT_TRUE(bitmap.at(50000)) << "reserve() lost bits";
+    BitMap<uint32_t> empty;
+    ASSERT_NO_THROW(empty.reserve(100000, 10)) << "Reversed range not ignored";
+    ASSERT_EQ(0, empty.size());
+}
 }
 
 #endif // BITARRAYTEST_H_INCLUDED
@@ -0,0 +1,129 @@
+#ifndef BOUNDEDQUEUETEST_HPP_INCLUDED
+#define BOUNDEDQUEUETEST_HPP_INCLUDED
+
+#include <thread>
+#include <vector>
+#include "bounded-queue.hpp"
+
+#include "gtest/gtest.h"
+
+namespace trillek {
+
+TEST(BoundedQueueTest, BoundedQueueEmpty) {
+    BoundedQueue<uint32_t> q(8);
+    ASSERT_TRUE(q.Empty()) << "New queue is not empty";
+    ASSERT_EQ(q.Capacity(), 8) << "Wrong capacity";
+    uint32_t i = 0;
+    ASSERT_FALSE(q.Pop(i)) << "New queue can pop inexisting element";
+    ASSERT_EQ(i, 0) << "New queue popped  an element";
+    ASSERT_TRUE(q.Poll().empty()) << "New polled queue gives elements";
+}
+
+TEST(BoundedQueueTest, BoundedQueueOrder) {
+    BoundedQueue<uint32_t> q(4);
+    // several laps of the ring buffer
+    for (uint32_t lap = 0; lap < 3; ++lap) {
+        for (uint32_t i = 0; i < 4; ++i) {
+            ASSERT_TRUE(q.Push(lap * 4 + i)) << "Queue refuses an element before it is full";
+        }
+        ASSERT_FALSE(q.Push(100)) << "Full queue accepts an element";
+        ASSERT_FALSE(q.Empty()) << "Queue is empty";
+        uint32_t i = 0;
+        ASSERT_TRUE(q.Pop(i)) << "Queue can't pop existing element";
+        ASSERT_EQ(i, lap * 4) << "Pop() wrong value";
+        auto ret = q.Poll();
+        ASSERT_TRUE(q.Empty()) << "Queue is not empty";
+        ASSERT_EQ(ret.size(), 3) << "Poll does not return all elements";
+        for (uint32_t k = 1; k < 4; ++k) {
+            ASSERT_EQ(ret.front(), lap * 4 + k) << k << "th element from Poll has wrong value";
+            ret.pop_front();
+        }
+    }
+}
+
+TEST(BoundedQueueTest, BoundedQueueContention) {
+    const uint32_t PRODUCERS = 4;
+    const uint32_t CONSUMERS = 4;
+    const uint32_t COUNT = 20000;
+    BoundedQueue<uint32_t> q(64);
+    std::atomic<uint64_t> sum(0);
+    std::atomic<uint32_t> popped(0);
+    std::vector<std::thread> threads;
+    for (uint32_t p = 0; p < PRODUCERS; ++p) {
+        threads.emplace_back([&, p]() {
+            for (uint32_t i = 1; i <= COUNT; ++i) {
+                while (! q.Push(p * COUNT + i)) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (uint32_t c = 0; c < CONSUMERS; ++c) {
+        threads.emplace_back([&]() {
+            uint32_t value;
+            while (popped.load() < PRODUCERS * COUNT) {
+                if (q.Pop(value)) {
+                    sum += value;
+                    ++popped;
+                }
+                else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    const uint64_t n = PRODUCERS * COUNT;
+    ASSERT_EQ(popped.load(), n) << "Elements lost or duplicated";
+    ASSERT_EQ(sum.load(), n * (n + 1) / 2) << "Elements lost or duplicated";
+    ASSERT_TRUE(q.Empty()) << "Queue is not empty";
+}
+
+TEST(BoundedQueueTest, SpscQueueOrder) {
+    SpscQueue<uint32_t> q(4);
+    uint32_t i = 0;
+    ASSERT_TRUE(q.Empty()) << "New queue is not empty";
+    ASSERT_FALSE(q.Pop(i)) << "New queue can pop inexisting element";
+    for (uint32_t lap = 0; lap < 3; ++lap) {
+        for (uint32_t k = 0; k < 4; ++k) {
+            ASSERT_TRUE(q.Push(lap * 4 + k)) << "Queue refuses an element before it is full";
+        }
+        ASSERT_FALSE(q.Push(100)) << "Full queue accepts an element";
+        ASSERT_TRUE(q.Pop(i)) << "Queue can't pop existing element";
+        ASSERT_EQ(i, lap * 4) << "Pop() wrong value";
+        auto ret = q.Poll();
+        ASSERT_TRUE(q.Empty()) << "Queue is not empty";
+        ASSERT_EQ(ret.size(), 3) << "Poll does not return all elements";
+        ASSERT_EQ(ret.back(), lap * 4 + 3) << "Last element from Poll has wrong value";
+    }
+}
+
+TEST(BoundedQueueTest, SpscQueuePipe) {
+    const uint32_t COUNT = 100000;
+    SpscQueue<uint32_t> q(16);
+    std::thread producer([&]() {
+        for (uint32_t i = 0; i < COUNT; ++i) {
+            while (! q.Push(i)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+    uint32_t expected = 0;
+    uint32_t value;
+    while (expected < COUNT) {
+        if (q.Pop(value)) {
+            ASSERT_EQ(value, expected) << "Elements out of order";
+            ++expected;
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    ASSERT_TRUE(q.Empty()) << "Queue is not empty";
+}
+}
+
+#endif // BOUNDEDQUEUETEST_HPP_INCLUDED
@@ -0,0 +1,31 @@
+#ifndef COMPONENT_TEST_HPP_INCLUDED
+#define COMPONENT_TEST_HPP_INCLUDED
+
+#include "gtest/gtest.h"
+#include <stdexcept>
+#include <vector>
+
+#include "components/component.hpp"
+
+using namespace trillek;
+
+namespace {
+    TEST(ComponentTest, OnTrueNegatedBitmap) {
+        BitMap<uint32_t> has;
+        has[2] = true;
+        has[5] = true;
+        auto without = ~has;
+        std::vector<id_t> ids;
+        auto collect = [&ids](id_t id) { ids.push_back(id); };
+        // ~has is true past has.size(): a bound is required
+        ASSERT_THROW(component::OnTrue(without, collect), std::invalid_argument);
+        ASSERT_THROW(component::OnTrue(~Lazy(has), collect), std::invalid_argument);
+        component::OnTrue(without, 0, 8, collect);
+        ASSERT_EQ(ids, (std::vector<id_t>{0, 1, 3, 4, 6, 7}));
+        ids.clear();
+        component::OnTrue(has, collect);
+        ASSERT_EQ(ids, (std::vector<id_t>{2, 5}));
+    }
+}
+
+#endif // COMPONENT_TEST_HPP_INCLUDED
@@ -0,0 +1,136 @@
+#ifndef COMPRESSEDBITMAPTEST_HPP_INCLUDED
+#define COMPRESSEDBITMAPTEST_HPP_INCLUDED
+
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "bitmap.hpp"
+#include "compressed-bitmap.hpp"
+
+#include "gtest/gtest.h"
+
+namespace trillek {
+
+class CompressedBitMapTest : public ::testing::Test {
+public:
+    /** \brief Fill a BitMap and a CompressedBitMap with the same bits
+     *
+     * Sparse ids, a dense range and a long run give the 3 kinds of container.
+     */
+    void Populate(BitMap<uint64_t>& dense, CompressedBitMap& compressed, unsigned int seed) {
+        std::minstd_rand random(seed);
+        const bool value = ! dense.DefaultValue();
+        for (unsigned int i = 0; i < 300; ++i) {
+            const auto id = random() % 1000000;
+            dense[id] = value;
+            compressed[id] = value;
+        }
+        const size_t dense_start = (random() % 8) * CompressedBitMap::CHUNK_BITS;
+        for (size_t id = dense_start; id < dense_start + 20000; ++id) {
+            if (random() % 2) {
+                dense[id] = value;
+                compressed[id] = value;
+            }
+        }
+        const size_t run_start = (random() % 8) * CompressedBitMap::CHUNK_BITS + 1000;
+        for (size_t id = run_start; id < run_start + 30000; ++id) {
+            dense[id] = value;
+            compressed[id] = value;
+        }
+    }
+
+    void ExpectEqual(const BitMap<uint64_t>& dense, const CompressedBitMap& compressed, const char* operation) {
+        ASSERT_EQ(dense.DefaultValue(), compressed.DefaultValue()) << operation << ": wrong default value";
+        ASSERT_EQ(dense.countTrue(), compressed.countTrue()) << operation << ": wrong countTrue()";
+        const auto last = (std::max)(dense.size(), compressed.size()) + 100;
+        std::vector<size_t> expected, found;
+        dense.ForEachTrue(0, last, [&](size_t i) { expected.push_back(i); });
+        compressed.ForEachTrue(0, last, [&](size_t i) { found.push_back(i); });
+        ASSERT_EQ(expected, found) << operation << ": wrong bits";
+        for (size_t i = 0; i < last; i += 97) {
+            ASSERT_EQ(dense.at(i), compressed.at(i)) << operation << ": wrong bit " << i;
+        }
+    }
+};
+
+TEST_F(CompressedBitMapTest, CompressedBitMapSetClear) {
+    CompressedBitMap bitmap;
+    ASSERT_FALSE(bitmap[200]) << "Default value is not false";
+    bitmap[200] = true;
+    bitmap[70000] = true;
+    ASSERT_TRUE(bitmap[200]) << "Failed to write in bitmap";
+    ASSERT_TRUE(bitmap.at(70000)) << "Failed to write in a second chunk";
+    ASSERT_EQ(bitmap.Chunks(), 2) << "Wrong number of chunks";
+    ASSERT_EQ(bitmap.countTrue(), 2) << "Wrong countTrue()";
+    bitmap[200] = false;
+    ASSERT_FALSE(bitmap.at(200)) << "Failed to rewrite in bitmap";
+    ASSERT_EQ(bitmap.Chunks(), 1) << "Empty chunk not released";
+    // an array container becomes a bitset, then an array again
+    for (size_t i = 0; i < 2 * CompressedBitMap::ARRAY_MAX; ++i) {
+        bitmap[2 * i] = true;
+    }
+    ASSERT_EQ(bitmap.countTrue(), 2 * CompressedBitMap::ARRAY_MAX + 1) << "Wrong countTrue() of a bitset";
+    for (size_t i = 0; i < 2 * CompressedBitMap::ARRAY_MAX; ++i) {
+        bitmap.erase(2 * i);
+    }
+    ASSERT_EQ(bitmap.countTrue(), 1) << "Wrong countTrue() after erase()";
+    CompressedBitMap default_true(size_t(550), true);
+    ASSERT_TRUE(default_true[203]) << "Default value is not true";
+    default_true[203] = false;
+    ASSERT_FALSE(default_true.at(203)) << "Failed to write with default value true";
+    ASSERT_EQ(default_true.countTrue(), 549) << "Wrong countTrue() with default value true";
+}
+
+TEST_F(CompressedBitMapTest, CompressedBitMapConversion) {
+    for (bool def : {false, true}) {
+        BitMap<uint64_t> dense(def);
+        CompressedBitMap compressed(def);
+        Populate(dense, compressed, 1);
+        ExpectEqual(dense, compressed, "writes");
+        ExpectEqual(dense, CompressedBitMap(dense), "compression");
+        ExpectEqual(compressed.ToBitMap<uint64_t>(), compressed, "decompression");
+        compressed.Optimize();
+        ExpectEqual(dense, compressed, "Optimize()");
+        BitMap<uint32_t> dense32(def);
+        dense32[1000] = ! def;
+        dense32[40] = ! def;
+        CompressedBitMap compressed32(dense32);
+        ASSERT_EQ(compressed32.at(1000), ! def) << "Compression of 32-bit blocks";
+        ASSERT_EQ(compressed32.countTrue(), dense32.countTrue()) << "Compression of 32-bit blocks";
+    }
+}
+
+TEST_F(CompressedBitMapTest, CompressedBitMapOperations) {
+    unsigned int seed = 1;
+    for (bool def_a : {false, true}) {
+        for (bool def_b : {false, true}) {
+            BitMap<uint64_t> dense_a(def_a), dense_b(def_b);
+            CompressedBitMap a(def_a), b(def_b);
+            Populate(dense_a, a, ++seed);
+            Populate(dense_b, b, ++seed);
+            ExpectEqual(dense_a & dense_b, a & b, "AND");
+            ExpectEqual(dense_a | dense_b, a | b, "OR");
+            ExpectEqual(dense_a ^ dense_b, a ^ b, "XOR");
+            ExpectEqual(~dense_a, ~a, "NOT");
+            ExpectEqual(dense_a & dense_b, dense_a & b, "AND with a BitMap");
+            ExpectEqual(dense_a | dense_b, a | dense_b, "OR with a BitMap");
+        }
+    }
+}
+
+TEST_F(CompressedBitMapTest, CompressedBitMapSparse) {
+    BitMap<uint64_t> dense;
+    CompressedBitMap compressed;
+    std::minstd_rand random(7);
+    for (unsigned int i = 0; i < 300; ++i) {
+        const auto id = random() % 1000000;
+        dense[id] = true;
+        compressed[id] = true;
+    }
+    // 300 ids in 16 chunks, instead of 1M bits
+    ASSERT_LT(compressed.MemoryUsage(), 2048) << "Sparse bitmap is not compressed";
+    ASSERT_LT(CompressedBitMap(dense).MemoryUsage(), 2048) << "Sparse BitMap is not compressed";
+}
+}
+
+#endif // COMPRESSEDBITMAPTEST_HPP_INCLUDED
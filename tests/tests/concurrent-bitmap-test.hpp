@@ -0,0 +1,80 @@
+#ifndef CONCURRENTBITMAPTEST_HPP_INCLUDED
+#define CONCURRENTBITMAPTEST_HPP_INCLUDED
+
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "bitmap.hpp"
+#include "bitmap-expression.hpp"
+#include "concurrent-bitmap.hpp"
+
+#include "gtest/gtest.h"
+
+namespace trillek {
+
+TEST(ConcurrentBitMapTest, ConcurrentBitMapSetClear) {
+    ConcurrentBitMap<uint32_t> bitmap(1000);
+    ASSERT_LE(1000, bitmap.capacity()) << "Wrong capacity";
+    ASSERT_FALSE(bitmap.at(200)) << "Default value is not false";
+    ASSERT_FALSE(bitmap.Set(200, true)) << "Set() should return the previous value";
+    ASSERT_TRUE(bitmap.Set(200, true)) << "Set() should return the previous value";
+    bitmap.Set(700, true);
+    ASSERT_TRUE(bitmap.at(200)) << "Failed to write in bitmap";
+    ASSERT_EQ(701, bitmap.size()) << "Wrong size";
+    ASSERT_EQ(200 / 32, bitmap.FirstBlock()) << "Wrong first block written";
+    ASSERT_TRUE(bitmap.Set(700, false)) << "Set() should return the previous value";
+    ASSERT_FALSE(bitmap.at(700)) << "Failed to clear a bit";
+    ASSERT_THROW(bitmap.Set(bitmap.capacity(), true), std::out_of_range) << "Write out of the capacity";
+    bitmap.reserve(5000);
+    ASSERT_TRUE(bitmap.at(200)) << "reserve() lost a bit";
+    bitmap.Set(4000, true);
+    const auto snapshot = bitmap.Snapshot();
+    ASSERT_EQ(2, snapshot.countTrue()) << "Wrong snapshot";
+    ASSERT_TRUE(snapshot.at(4000)) << "Wrong snapshot";
+    ASSERT_EQ(200 / 32, snapshot.FirstBlock()) << "The snapshot should copy the blocks written only";
+    bitmap.clear();
+    ASSERT_FALSE(bitmap.at(4000)) << "clear() failed";
+    ASSERT_EQ(0, bitmap.Snapshot().countTrue()) << "clear() failed";
+    ASSERT_LE(5000, bitmap.capacity()) << "clear() should keep the capacity";
+    ConcurrentBitMap<uint32_t> default_true(550, true);
+    default_true.Set(203, false);
+    ASSERT_FALSE(default_true.at(203)) << "Failed to write with default value true";
+    ASSERT_TRUE(default_true.at(204)) << "Default value is not true";
+    ASSERT_EQ(203, default_true.Snapshot().countTrue()) << "Wrong snapshot with default value true";
+}
+
+TEST(ConcurrentBitMapTest, ConcurrentBitMapThreads) {
+    const size_t ids = 100000;
+    const unsigned int threads = 4;
+    ConcurrentBitMap<uint64_t> bitmap(ids);
+    std::vector<std::thread> writers;
+    // the threads write interleaved bits of the same blocks
+    for (unsigned int t = 0; t < threads; ++t) {
+        writers.emplace_back([&bitmap, t, threads, ids]() {
+            for (size_t id = t; id < ids; id += threads) {
+                if (id % 3 != 0) {
+                    bitmap.Set(id, true);
+                }
+            }
+            for (size_t id = t; id < ids; id += threads) {
+                if (id % 5 == 0) {
+                    bitmap.Set(id, false);
+                }
+            }
+        });
+    }
+    for (auto& w : writers) {
+        w.join();
+    }
+    const auto snapshot = bitmap.Snapshot();
+    BitMap<uint64_t> expected;
+    for (size_t id = 0; id < ids; ++id) {
+        expected[id] = id % 3 != 0 && id % 5 != 0;
+    }
+    ASSERT_EQ(expected.countTrue(), snapshot.countTrue()) << "Concurrent writes lost";
+    ASSERT_EQ(0, (Lazy(expected) ^ Lazy(bitmap)).countTrue()) << "Concurrent writes differ";
+}
+}
+
+#endif // CONCURRENTBITMAPTEST_HPP_INCLUDED
@@ -0,0 +1,115 @@
+#ifndef CONCURRENTMAPTEST_HPP_INCLUDED
+#define CONCURRENTMAPTEST_HPP_INCLUDED
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "concurrent-map.hpp"
+
+#include "gtest/gtest.h"
+
+namespace trillek {
+
+TEST(ConcurrentMapTest, ConcurrentMapOneElement) {
+    ConcurrentMap<std::string, int> q;
+    int i = 0;
+    ASSERT_EQ(q.Count("a"), 0) << "New map is not empty";
+    ASSERT_FALSE(q.Pop("a", i)) << "New map can pop inexisting element";
+    ASSERT_FALSE(q.Compare("a", 1)) << "Comparison in empty map should return false";
+    EXPECT_THROW(i = q.At("a"), std::out_of_range);
+    q.Insert("a", 1);
+    ASSERT_EQ(q.Count("a"), 1) << "Map is empty";
+    ASSERT_EQ(q.Size(), 1) << "Wrong size";
+    ASSERT_EQ(q.At("a"), 1) << "At should return 1";
+    ASSERT_TRUE(q.Compare("a", 1)) << "Compare should return true";
+    ASSERT_FALSE(q.Compare("a", 2)) << "Compare should return false";
+    q.Insert("a", 2);
+    ASSERT_EQ(q.Size(), 1) << "Insert of an existing key adds an element";
+    ASSERT_TRUE(q.Pop("a", i)) << "Map can't pop existing element";
+    ASSERT_EQ(i, 2) << "Map popped  wrong value";
+    ASSERT_EQ(q.Count("a"), 0) << "Map is not empty";
+    ASSERT_EQ(q.Size(), 0) << "Wrong size";
+}
+
+TEST(ConcurrentMapTest, ConcurrentMapUpdate) {
+    ConcurrentMap<uint32_t, uint32_t> q;
+    ASSERT_FALSE(q.Update(1, [](uint32_t& v) { ++v; })) << "Update of a missing key succeeds";
+    ASSERT_TRUE(q.Upsert(1, [](uint32_t& v) { v += 5; })) << "Upsert does not insert a missing key";
+    ASSERT_FALSE(q.Upsert(1, [](uint32_t& v) { v += 5; })) << "Upsert inserts an existing key";
+    ASSERT_TRUE(q.Update(1, [](uint32_t& v) { ++v; })) << "Update of an existing key fails";
+    ASSERT_EQ(q.At(1), 11) << "Updates are lost";
+}
+
+TEST(ConcurrentMapTest, ConcurrentMapGrowth) {
+    const uint32_t COUNT = 10000;
+    ConcurrentMap<uint32_t, uint32_t> q;
+    for (uint32_t i = 0; i < COUNT; ++i) {
+        q.Insert(i, i * 3);
+    }
+    ASSERT_EQ(q.Size(), COUNT) << "Wrong size";
+    for (uint32_t i = 0; i < COUNT; i += 2) {
+        q.Erase(i);
+    }
+    // reuse the deleted slots
+    for (uint32_t i = COUNT; i < COUNT * 2; i += 2) {
+        q.Insert(i, i * 3);
+    }
+    ASSERT_EQ(q.Size(), COUNT) << "Wrong size";
+    uint32_t value;
+    for (uint32_t i = 0; i < COUNT * 2; ++i) {
+        const bool expected = i < COUNT ? (i & 1) : ! (i & 1);
+        ASSERT_EQ(q.Find(i, value), expected) << "Wrong presence of key " << i;
+        if (expected) {
+            ASSERT_EQ(value, i * 3) << "Wrong value of key " << i;
+        }
+    }
+    auto content = q.Poll();
+    ASSERT_EQ(content.size(), COUNT) << "Poll does not return all elements";
+    ASSERT_EQ(q.Size(), 0) << "Map is not empty";
+    ASSERT_EQ(q.Count(1), 0) << "Map is not empty";
+    std::sort(content.begin(), content.end());
+    ASSERT_EQ(content.front().first, 1) << "Poll gives a wrong element";
+    ASSERT_EQ(content.front().second, 3) << "Poll gives a wrong value";
+}
+
+TEST(ConcurrentMapTest, ConcurrentMapOptimisticReads) {
+    const uint32_t KEYS = 512;
+    const uint32_t ROUNDS = 200;
+    // the two halves of a value always match, a torn read would break it
+    ConcurrentMap<uint32_t, uint64_t> q;
+    std::atomic<bool> done(false);
+    std::atomic<uint32_t> torn(0);
+    std::vector<std::thread> readers;
+    for (unsigned int r = 0; r < 2; ++r) {
+        readers.emplace_back([&]() {
+            uint64_t value = 0;
+            while (! done) {
+                for (uint32_t k = 0; k < KEYS; ++k) {
+                    if (q.Find(k, value) && (value >> 32) != (value & 0xffffffff)) {
+                        ++torn;
+                    }
+                }
+            }
+        });
+    }
+    for (uint32_t round = 1; round <= ROUNDS; ++round) {
+        for (uint32_t k = 0; k < KEYS; ++k) {
+            if ((k + round) % 7) {
+                q.Insert(k, (uint64_t(round) << 32) | round);
+            }
+            else {
+                q.Erase(k);
+            }
+        }
+    }
+    done = true;
+    for (auto& t : readers) {
+        t.join();
+    }
+    ASSERT_EQ(torn.load(), 0) << "Readers saw values being written";
+}
+}
+
+#endif // CONCURRENTMAPTEST_HPP_INCLUDED
@@ -0,0 +1,99 @@
+#ifndef COROUTINETEST_HPP_INCLUDED
+#define COROUTINETEST_HPP_INCLUDED
+
+#include <thread>
+#include <queue>
+#include "coroutine-task.hpp"
+#include "tests/scheduler-test.hpp"
+
+#include "gtest/gtest.h"
+
+#ifdef TRILLEK_COROUTINES
+namespace trillek {
+
+class CoroutineTest : public RunningSchedulerTest<2> {};
+
+CoTask Child(std::vector<int>& steps) {
+    steps.push_back(1);
+    co_await Requeue();
+    steps.push_back(2);
+}
+
+CoTask Parent(std::vector<int>& steps, std::atomic<bool>& done) {
+    steps.push_back(0);
+    co_await Child(steps);
+    steps.push_back(3);
+    done = true;
+}
+
+CoTask Sleeper(scheduler_tp& start, scheduler_tp& delayed, scheduler_tp& next_frame, std::atomic<bool>& done) {
+    start = TrillekScheduler::Now();
+    co_await Delay(frame_unit(2000000));
+    delayed = TrillekScheduler::Now();
+    co_await NextFrame();
+    next_frame = TrillekScheduler::Now();
+    done = true;
+}
+
+CoTask Thrower() {
+    throw std::runtime_error("coroutine error");
+    co_return;
+}
+
+CoTask Catcher(std::atomic<bool>& caught, std::atomic<bool>& done) {
+    try {
+        co_await Thrower();
+    }
+    catch (const std::runtime_error&) {
+        caught = true;
+    }
+    done = true;
+}
+
+CoTask Consumer(TaskFuture<int> future, std::atomic<int>& value, std::atomic<bool>& done) {
+    co_await WaitFor(future);
+    value = future.Get();
+    done = true;
+}
+
+TEST_F(CoroutineTest, AwaitCoroutine) {
+    std::vector<int> steps;
+    std::atomic<bool> done(false);
+    scheduler.Spawn(Parent(steps, done));
+    WaitFor(done, true);
+    ASSERT_TRUE(done) << "Coroutine not resumed";
+    ASSERT_EQ(std::vector<int>({0, 1, 2, 3}), steps);
+}
+
+TEST_F(CoroutineTest, DelayAndNextFrame) {
+    scheduler_tp start, delayed, next_frame;
+    std::atomic<bool> done(false);
+    scheduler.Spawn(Sleeper(start, delayed, next_frame, done));
+    WaitFor(done, true);
+    ASSERT_TRUE(done) << "Coroutine not resumed";
+    ASSERT_LE(frame_unit(2000000), delayed - start);
+    ASSERT_LE(scheduler.FrameDuration(), next_frame - delayed);
+}
+
+TEST_F(CoroutineTest, WaitForFuture) {
+    TaskPromise<int> promise;
+    std::atomic<int> value(0);
+    std::atomic<bool> done(false);
+    scheduler.Spawn(Consumer(promise.GetFuture(), value, done));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ASSERT_FALSE(done) << "Coroutine resumed before the value was set";
+    promise.SetValue(7);
+    WaitFor(done, true);
+    ASSERT_EQ(7, value);
+}
+
+TEST_F(CoroutineTest, Exception) {
+    std::atomic<bool> caught(false), done(false);
+    scheduler.Spawn(Catcher(caught, done));
+    WaitFor(done, true);
+    ASSERT_TRUE(caught) << "Exception not thrown in the awaiting coroutine";
+}
+}
+#endif // TRILLEK_COROUTINES
+
+#endif // COROUTINETEST_HPP_INCLUDED
@@ -0,0 +1,71 @@
+#ifndef CPUTOPOLOGYTEST_HPP_INCLUDED
+#define CPUTOPOLOGYTEST_HPP_INCLUDED
+
+#include <thread>
+#include <queue>
+#include "cpu-topology.hpp"
+#include "trillek-scheduler.hpp"
+#include "tests/scheduler-test.hpp"
+
+#include "gtest/gtest.h"
+
+namespace trillek {
+
+/** \brief 2 sockets of 2 cores with 2 SMT threads, numbered as Linux does
+ *
+ * CPUs 0-3 are the first threads of the cores, 4-7 their siblings.
+ */
+inline CpuTopology TwoSocketTopology() {
+    std::vector<CpuInfo> cpus;
+    for (unsigned int cpu = 0; cpu < 8; ++cpu) {
+        const unsigned int package = (cpu % 4) / 2;
+        CpuInfo info = {cpu, package, cpu % 2, package};
+        cpus.push_back(info);
+    }
+    return CpuTopology(std::move(cpus));
+}
+
+TEST(CpuTopologyTest, ParseCpuList) {
+    ASSERT_EQ(std::vector<unsigned int>({0, 1, 2, 3, 8, 10, 11}), CpuTopology::ParseCpuList("0-3,8,10-11"));
+    ASSERT_EQ(std::vector<unsigned int>({0}), CpuTopology::ParseCpuList("0\n"));
+    ASSERT_TRUE(CpuTopology::ParseCpuList("").empty());
+}
+
+TEST(CpuTopologyTest, PlacementOrder) {
+    auto topology = TwoSocketTopology();
+    ASSERT_EQ(2, topology.Packages());
+    ASSERT_EQ(2, topology.Nodes());
+    ASSERT_EQ(4, topology.PhysicalCores());
+    std::vector<unsigned int> order;
+    for (const auto& c : topology.PlacementOrder()) {
+        order.push_back(c.cpu);
+    }
+    // node 0: cores first, then siblings, then node 1
+    ASSERT_EQ(std::vector<unsigned int>({0, 1, 4, 5, 2, 3, 6, 7}), order);
+    ASSERT_NE(std::string::npos, topology.Report().find("node 1: CPUs 2 3 6 7"));
+}
+
+TEST(CpuTopologyTest, StealOrder) {
+    const std::vector<unsigned int> nodes{0, 0, 1, 1, 0};
+    ASSERT_EQ(std::vector<unsigned int>({4, 0, 2, 3}), StealOrder(1, nodes));
+    ASSERT_EQ(std::vector<unsigned int>({3, 4, 0, 1}), StealOrder(2, nodes));
+    ASSERT_TRUE(StealOrder(0, std::vector<unsigned int>(1, 0)).empty());
+}
+
+TEST(CpuTopologyTest, PinnedWorkers) {
+    auto topology = CpuTopology::Detect();
+    ASSERT_LE(1, topology.Cpus().size());
+    TrillekScheduler scheduler;
+    CountingSystem system;
+    scheduler.SetWorkerPinning(true);
+    std::queue<SystemBase*> queue;
+    queue.push(&system);
+    std::thread runner([&]() { scheduler.Initialize(2, queue); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    scheduler.Stop();
+    runner.join();
+    ASSERT_LE(3, system.frames);
+}
+}
+
+#endif // CPUTOPOLOGYTEST_HPP_INCLUDED
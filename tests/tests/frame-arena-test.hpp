@@ -0,0 +1,90 @@
+#ifndef FRAMEARENATEST_HPP_INCLUDED
+#define FRAMEARENATEST_HPP_INCLUDED
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include "frame-arena.hpp"
+
+#include "gtest/gtest.h"
+
+namespace trillek {
+
+TEST(FrameArenaTest, FrameArenaAlignment) {
+    FrameArena arena(256);
+    auto a = arena.Allocate(1, 1);
+    auto b = arena.Allocate(8, 8);
+    auto c = arena.Allocate(16, 64);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(b) % 8, 0) << "Wrong alignment";
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(c) % 64, 0) << "Wrong alignment";
+    ASSERT_NE(a, b) << "Overlapping allocations";
+    ASSERT_GE(arena.Used(), 25) << "Wrong used size";
+    // larger than a block
+    auto d = arena.Allocate(1000, 8);
+    ASSERT_NE(d, nullptr) << "Large allocation failed";
+    ASSERT_GE(arena.Capacity(), 1256) << "No block for the large allocation";
+}
+
+TEST(FrameArenaTest, FrameArenaScope) {
+    FrameArena arena(256);
+    void* first;
+    {
+        FrameScope frame(arena);
+        first = arena.Allocate(100, 8);
+        for (int i = 0; i < 10; ++i) {
+            arena.Allocate(100, 8);
+        }
+        ASSERT_GE(arena.Used(), 1100) << "Wrong used size";
+        const auto used = arena.Used();
+        {
+            FrameScope nested(arena);
+            arena.Allocate(100, 8);
+        }
+        ASSERT_EQ(arena.Used(), used) << "The nested scope is not rewound";
+    }
+    const auto capacity = arena.Capacity();
+    ASSERT_EQ(arena.Used(), 0) << "The frame is not rewound";
+    ASSERT_GE(arena.HighWater(), 1200) << "Wrong high water mark";
+    {
+        FrameScope frame(arena);
+        ASSERT_EQ(arena.Allocate(100, 8), first) << "The memory of the previous frame is not reused";
+        for (int i = 0; i < 10; ++i) {
+            arena.Allocate(100, 8);
+        }
+    }
+    ASSERT_EQ(arena.Capacity(), capacity) << "The second frame took memory from the heap";
+}
+
+TEST(FrameArenaTest, FrameAllocatorVector) {
+    FrameArena arena(1024);
+    FrameScope frame(arena);
+    std::vector<uint32_t, FrameAllocator<uint32_t>> v{FrameAllocator<uint32_t>(arena)};
+    for (uint32_t i = 0; i < 1000; ++i) {
+        v.push_back(i);
+    }
+    for (uint32_t i = 0; i < 1000; ++i) {
+        ASSERT_EQ(v[i], i) << "Wrong value";
+    }
+    const auto used = arena.Used();
+    std::vector<uint32_t, FrameAllocator<uint32_t>> w{FrameAllocator<uint32_t>(arena)};
+    w.reserve(10);
+    w.shrink_to_fit();
+    // only the alignment padding is left
+    ASSERT_LE(arena.Used(), used + alignof(uint32_t)) << "The last allocation is not given back";
+}
+
+TEST(FrameArenaTest, FrameArenaLocal) {
+    auto main_arena = &FrameArena::Local();
+    FrameArena* other_arena = nullptr;
+    std::thread other([&]() {
+        other_arena = &FrameArena::Local();
+        frame_vector<int> v;
+        v.push_back(1);
+    });
+    other.join();
+    ASSERT_EQ(main_arena, &FrameArena::Local()) << "The arena of a thread changed";
+    ASSERT_NE(main_arena, other_arena) << "Two threads share an arena";
+}
+}
+
+#endif // FRAMEARENATEST_HPP_INCLUDED
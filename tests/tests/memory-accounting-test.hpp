@@ -0,0 +1,102 @@
+#ifndef MEMORYACCOUNTINGTEST_HPP_INCLUDED
+#define MEMORYACCOUNTINGTEST_HPP_INCLUDED
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "memory-accounting.hpp"
+#include "trillek-allocator.hpp"
+
+#include "gtest/gtest.h"
+
+namespace trillek {
+
+TEST(MemoryAccountingTest, MemoryAccountingTags) {
+    const auto a = MemoryAccounting::Tag("test a");
+    const auto b = MemoryAccounting::Tag("test b");
+    ASSERT_NE(a, MemoryAccounting::GENERAL) << "A tag is the general tag";
+    ASSERT_NE(a, b) << "2 names have the same tag";
+    ASSERT_EQ(MemoryAccounting::Tag("test a"), a) << "A name has 2 tags";
+    ASSERT_EQ(MemoryAccounting::Query(a).name, "test a") << "Wrong name";
+}
+
+TEST(MemoryAccountingTest, MemoryAccountingScope) {
+    const auto tag = MemoryAccounting::Tag("test scope");
+    const auto before = MemoryAccounting::Query(tag);
+    std::vector<uint64_t, TrillekAllocator<uint64_t>> general;
+    {
+        MemoryTagScope scope(tag);
+        ASSERT_EQ(MemoryAccounting::CurrentTag(), tag) << "The scope does not set the tag";
+        std::vector<uint64_t, TrillekAllocator<uint64_t>> v(100);
+        ASSERT_EQ(v.get_allocator().Tag(), tag) << "The allocator does not take the tag of the scope";
+        auto stats = MemoryAccounting::Query(tag);
+        ASSERT_EQ(stats.current_bytes - before.current_bytes, 100 * sizeof(uint64_t)) << "Wrong size";
+        ASSERT_EQ(stats.allocations - before.allocations, 1) << "Wrong number of allocations";
+    }
+    ASSERT_EQ(MemoryAccounting::CurrentTag(), MemoryAccounting::GENERAL) << "The scope does not restore the tag";
+    auto stats = MemoryAccounting::Query(tag);
+    ASSERT_EQ(stats.current_bytes, before.current_bytes) << "Memory not given back";
+    ASSERT_GE(stats.high_water_bytes, 100 * sizeof(uint64_t)) << "Wrong high-water mark";
+    ASSERT_EQ(stats.deallocations - before.deallocations, 1) << "Wrong number of deallocations";
+    ASSERT_EQ(MemoryAccounting::Query(MemoryAccounting::GENERAL).current_bytes, 0) << "Allocated size is not null";
+}
+
+TEST(MemoryAccountingTest, MemoryAccountingMove) {
+    const auto a = MemoryAccounting::Tag("test move a");
+    const auto b = MemoryAccounting::Tag("test move b");
+    const auto before_a = MemoryAccounting::Query(a);
+    const auto before_b = MemoryAccounting::Query(b);
+    ASSERT_TRUE(TrillekAllocator<uint64_t>(a) == TrillekAllocator<uint32_t>(b)) << "Allocators of 2 tags differ";
+    {
+        std::vector<uint64_t, TrillekAllocator<uint64_t>> va(100, 0, TrillekAllocator<uint64_t>(a));
+        std::vector<uint64_t, TrillekAllocator<uint64_t>> vb(10, 0, TrillekAllocator<uint64_t>(b));
+        // the memory of va is freed by the allocator of vb
+        vb = std::move(va);
+        std::list<uint64_t, TrillekAllocator<uint64_t>> la(10, 0, TrillekAllocator<uint64_t>(a));
+        std::list<uint64_t, TrillekAllocator<uint64_t>> lb{TrillekAllocator<uint64_t>(b)};
+        lb.splice(lb.end(), la);
+        ASSERT_EQ(lb.size(), 10) << "Nodes not spliced";
+    }
+    MemoryAccounting::Flush();
+    ASSERT_EQ(MemoryAccounting::Query(a).current_bytes, before_a.current_bytes) << "Memory freed under another tag";
+    ASSERT_EQ(MemoryAccounting::Query(b).current_bytes, before_b.current_bytes) << "Memory freed under another tag";
+}
+
+TEST(MemoryAccountingTest, MemoryAccountingThreads) {
+    const auto tag = MemoryAccounting::Tag("test threads");
+    typedef std::map<uint32_t, uint64_t, std::less<uint32_t>, TrillekAllocator<std::pair<const uint32_t, uint64_t>>> map_type;
+    const auto before = MemoryAccounting::Query(tag);
+    map_type shared{std::less<uint32_t>(), map_type::allocator_type(tag)};
+    std::mutex m_shared;
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < 4; ++t) {
+        threads.push_back(std::thread([&, t]() {
+            map_type local{std::less<uint32_t>(), map_type::allocator_type(tag)};
+            for (uint32_t i = 0; i < 10000; ++i) {
+                local[i] = i;
+            }
+            std::lock_guard<std::mutex> locker(m_shared);
+            for (uint32_t i = 0; i < 1000; ++i) {
+                shared[t * 1000 + i] = i;
+            }
+        }));
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    auto stats = MemoryAccounting::Query(tag);
+    ASSERT_EQ(stats.allocations - before.allocations, 44000) << "Allocations of the threads are lost";
+    ASSERT_EQ(stats.deallocations - before.deallocations, 40000) << "Deallocations of the threads are lost";
+    ASSERT_GT(stats.current_bytes - before.current_bytes, 0) << "The shared map is not counted";
+    // freed by another thread than the one allocating
+    shared.clear();
+    MemoryAccounting::Flush();
+    ASSERT_EQ(MemoryAccounting::Query(tag).current_bytes, before.current_bytes) << "Memory not given back";
+    ASSERT_NE(MemoryAccounting::Report().find("test threads"), std::string::npos) << "The tag is not reported";
+}
+}
+
+#endif // MEMORYACCOUNTINGTEST_HPP_INCLUDED
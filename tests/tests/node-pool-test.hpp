@@ -0,0 +1,116 @@
+#ifndef NODEPOOLTEST_HPP_INCLUDED
+#define NODEPOOLTEST_HPP_INCLUDED
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <thread>
+#include <vector>
+#include "node-pool.hpp"
+#include "trillek-allocator.hpp"
+
+#include "gtest/gtest.h"
+
+namespace trillek {
+
+TEST(NodePoolTest, NodePoolReuse) {
+    std::vector<void*> blocks;
+    for (size_t size = 1; size <= NodePool::MAX_BLOCK; size += 7) {
+        auto block = NodePool::Allocate(size);
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(block) % NodePool::ALIGNMENT, 0) << "Wrong alignment";
+        // blocks do not overlap
+        std::memset(block, static_cast<int>(size), size);
+        blocks.push_back(block);
+    }
+    size_t size = 1;
+    for (auto block : blocks) {
+        ASSERT_EQ(static_cast<unsigned char*>(block)[size - 1], static_cast<unsigned char>(size)) << "Overlapping blocks";
+        NodePool::Deallocate(block, size);
+        size += 7;
+    }
+    auto first = NodePool::Allocate(40);
+    NodePool::Deallocate(first, 40);
+    ASSERT_EQ(NodePool::Allocate(33), first) << "A free block of the same size class is not reused";
+    NodePool::Deallocate(first, 33);
+}
+
+TEST(NodePoolTest, NodePoolOtherThread) {
+    const size_t COUNT = NodePool::CACHE_BLOCKS * 2;
+    std::vector<void*> blocks;
+    for (size_t i = 0; i < COUNT; ++i) {
+        blocks.push_back(NodePool::Allocate(64));
+    }
+    // released by another thread, and back to the shared lists on exit
+    std::thread other([&]() {
+        for (auto block : blocks) {
+            NodePool::Deallocate(block, 64);
+        }
+    });
+    other.join();
+    NodePool::ReleaseThreadCache();
+    const auto before = NodePool::Counters();
+    for (size_t i = 0; i < COUNT; ++i) {
+        blocks[i] = NodePool::Allocate(64);
+    }
+    ASSERT_EQ(NodePool::Counters().heap_allocations, before.heap_allocations) << "The released blocks are not reused";
+    for (auto block : blocks) {
+        NodePool::Deallocate(block, 64);
+    }
+}
+
+/** \brief Allocate blocks when the thread terminates
+ *
+ * Built before the cache of the pool, it is destroyed after it.
+ */
+struct ExitAllocator {
+    ~ExitAllocator() {
+        NodePool::Deallocate(NodePool::Allocate(NodePool::MAX_BLOCK), NodePool::MAX_BLOCK);
+        done = true;
+    }
+
+    bool done = false;
+};
+
+TEST(NodePoolTest, NodePoolAfterThreadCache) {
+    for (int t = 0; t < 50; ++t) {
+        std::thread exiting([]() {
+            static thread_local ExitAllocator exit_allocator;
+            ASSERT_FALSE(exit_allocator.done);
+            // the cache of the thread is built after exit_allocator
+            NodePool::Deallocate(NodePool::Allocate(16), 16);
+        });
+        exiting.join();
+    }
+    // the blocks taken after the cache was destroyed are in the shared lists
+    const auto before = NodePool::Counters();
+    std::vector<void*> blocks;
+    for (size_t i = 0; i < NodePool::CHUNK_BLOCKS; ++i) {
+        blocks.push_back(NodePool::Allocate(NodePool::MAX_BLOCK));
+    }
+    ASSERT_EQ(NodePool::Counters().heap_allocations, before.heap_allocations)
+        << "The blocks used after the thread cache are lost";
+    for (auto block : blocks) {
+        NodePool::Deallocate(block, NodePool::MAX_BLOCK);
+    }
+}
+
+TEST(NodePoolTest, NodePoolAllocator) {
+    typedef std::map<uint32_t, uint64_t, std::less<uint32_t>, TrillekAllocator<std::pair<const uint32_t, uint64_t>>> map_type;
+    {
+        map_type warmup;
+        for (uint32_t i = 0; i < 1000; ++i) {
+            warmup[i] = i;
+        }
+    }
+    const auto before = NodePool::Counters();
+    map_type m;
+    for (uint32_t i = 0; i < 1000; ++i) {
+        m[i] = i;
+    }
+    ASSERT_EQ(NodePool::Counters().heap_allocations, before.heap_allocations) << "The map nodes do not come from the pool";
+    m.clear();
+    ASSERT_EQ(MemoryAccounting::Query(MemoryAccounting::GENERAL).current_bytes, 0) << "Allocated size is not null";
+}
+}
+
+#endif // NODEPOOLTEST_HPP_INCLUDED
@@ -0,0 +1,90 @@
+#ifndef SCHEDULERCLOCKTEST_HPP_INCLUDED
+#define SCHEDULERCLOCKTEST_HPP_INCLUDED
+
+#include <thread>
+#include <queue>
+#include "trillek-scheduler.hpp"
+#include "scheduler-clock.hpp"
+#include "tests/scheduler-test.hpp"
+
+#include "gtest/gtest.h"
+
+namespace trillek {
+
+class SchedulerClockTest : public ::testing::Test {
+protected:
+    ~SchedulerClockTest() {
+        TrillekScheduler::SetClock(nullptr);
+    }
+
+    TrillekScheduler scheduler;
+};
+
+/** \brief Wait for a condition in wall time
+ *
+ */
+template<class F>
+bool WaitFor(F&& condition, std::chrono::milliseconds timeout = std::chrono::milliseconds(5000)) {
+    const auto end = std::chrono::steady_clock::now() + timeout;
+    while (! condition()) {
+        if (std::chrono::steady_clock::now() > end) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+TEST_F(SchedulerClockTest, VirtualClock) {
+    const frame_unit period(10000000);
+    const scheduler_tp start(frame_unit(1000000000));
+    VirtualClock clock(start);
+    TrillekScheduler::SetClock(&clock);
+    ASSERT_EQ(start, TrillekScheduler::Now());
+    CountingSystem system;
+    scheduler.RegisterSystem(&system, -1, SystemPacing(period));
+    std::atomic<bool> started(false), delayed(false);
+    scheduler.Queue(MakeTaskRequest([&started]() { started = true; }));
+    scheduler.Queue(MakeTaskRequest([&delayed]() { delayed = true; }, frame_unit(25000000)));
+    std::queue<SystemBase*> queue;
+    std::thread runner([&]() { scheduler.Initialize(2, queue); });
+    // the first frame is one period after the start of the scheduler
+    ASSERT_TRUE(WaitFor([&]() { return started.load(); }));
+    for (int i = 1; i <= 10; ++i) {
+        clock.Advance(period);
+        ASSERT_TRUE(WaitFor([&]() { return system.frames == i; })) << "Frame " << i << " did not run";
+        ASSERT_EQ((start + i * period).time_since_epoch().count(), system.last_frame);
+        if (i < 2) {
+            ASSERT_FALSE(delayed) << "A delayed task ran before its virtual timepoint";
+        }
+    }
+    // the time does not move: no frame is added
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    scheduler.Stop();
+    runner.join();
+    ASSERT_EQ(10, system.frames);
+    ASSERT_TRUE(delayed);
+    ASSERT_TRUE(system.frame_ordered);
+}
+
+TEST_F(SchedulerClockTest, FastClock) {
+    FastClock clock;
+    TrillekScheduler::SetClock(&clock);
+    CountingSystem system;
+    std::queue<SystemBase*> queue;
+    queue.push(&system);
+    const auto wall_start = std::chrono::steady_clock::now();
+    std::thread runner([&]() { scheduler.Initialize(2, queue); });
+    // one hour of frames
+    const int frames = 3600 * 60;
+    ASSERT_TRUE(WaitFor([&]() { return system.frames >= frames; }, std::chrono::milliseconds(60000)));
+    scheduler.Stop();
+    runner.join();
+    const auto wall = std::chrono::steady_clock::now() - wall_start;
+    ASSERT_LE(frames * scheduler.FrameDuration(), TrillekScheduler::Now().time_since_epoch());
+    ASSERT_GT(frame_unit(std::chrono::minutes(1)), wall) << "The clock did not run faster than the wall time";
+    ASSERT_TRUE(system.frame_ordered);
+}
+}
+
+#endif // SCHEDULERCLOCKTEST_HPP_INCLUDED
@@ -0,0 +1,121 @@
+#ifndef SCHEDULERTELEMETRYTEST_HPP_INCLUDED
+#define SCHEDULERTELEMETRYTEST_HPP_INCLUDED
+
+#include "scheduler-telemetry.hpp"
+
+#ifdef TRILLEK_TELEMETRY
+
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <queue>
+#include "trillek-scheduler.hpp"
+#include "tests/scheduler-test.hpp"
+
+#include "gtest/gtest.h"
+
+namespace trillek {
+
+TEST(SchedulerTelemetryTest, Histogram) {
+    DurationHistogram h;
+    h.Add(0);
+    for (uint64_t i = 0; i < 98; ++i) {
+        h.Add(1000);
+    }
+    h.Add(1000000);
+    ASSERT_EQ(100, h.Count());
+    ASSERT_EQ(1, h.BucketCount(0));
+    ASSERT_EQ(98, h.BucketCount(DurationHistogram::Bucket(1000)));
+    ASSERT_EQ(1000000, h.Max());
+    ASSERT_EQ(0, h.Percentile(0));
+    ASSERT_LE(1000, h.Percentile(0.5));
+    ASSERT_GT(2048, h.Percentile(0.5)) << "The percentile is not in the right bucket";
+    ASSERT_EQ(1000000, h.Percentile(1));
+    DurationHistogram m;
+    m.Merge(h);
+    m.Merge(h);
+    ASSERT_EQ(200, m.Count());
+    ASSERT_EQ(2 * h.Total(), m.Total());
+}
+
+/** \brief Record one task of N different types
+ */
+template<int N>
+struct RecordTypes {
+    static void Record(WorkerTelemetry& t) {
+        t.RecordTask(typeid(std::integral_constant<int,N>), 0, 0, 1);
+        RecordTypes<N - 1>::Record(t);
+    }
+};
+
+template<>
+struct RecordTypes<0> {
+    static void Record(WorkerTelemetry&) {}
+};
+
+TEST(SchedulerTelemetryTest, TaskTypesOverflow) {
+    std::unique_ptr<WorkerTelemetry> telemetry(new WorkerTelemetry());
+    RecordTypes<80>::Record(*telemetry);
+    RecordTypes<80>::Record(*telemetry);
+    std::unordered_map<std::string,std::pair<DurationHistogram,DurationHistogram>> types;
+    telemetry->MergeTypes(types);
+    ASSERT_EQ(WorkerTelemetry::TYPE_SLOTS + 1, types.size());
+    ASSERT_EQ(2 * (80 - WorkerTelemetry::TYPE_SLOTS), types[WorkerTelemetry::OTHER_TYPES].second.Count())
+        << "The types beyond the capacity are not counted together";
+    ASSERT_EQ(2, types[typeid(std::integral_constant<int,80>).name()].second.Count());
+}
+
+TEST(SchedulerTelemetryTest, Report) {
+    TrillekScheduler scheduler;
+    CountingSystem counting;
+    SlowSystem slow;
+    scheduler.RegisterSystem(&counting);
+    scheduler.RegisterSystem(&slow, -1, SystemPacing(frame_unit(10000000), FramePacing::SKIP_FRAMES));
+    scheduler.SetTrace(1024);
+    std::queue<SystemBase*> queue;
+    std::thread runner([&]() { scheduler.Initialize(2, queue); });
+    std::atomic<int> done(0);
+    for (int i = 0; i < 100; ++i) {
+        scheduler.Queue(MakeTaskRequest([&done]() { ++done; }));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    scheduler.Stop();
+    runner.join();
+    ASSERT_EQ(100, done);
+
+    auto report = scheduler.Telemetry();
+    ASSERT_EQ(2, report.workers.size());
+    uint64_t tasks = 0;
+    for (const auto& w : report.workers) {
+        tasks += w.tasks;
+        ASSERT_LT(0, w.elapsed);
+        ASSERT_GE(1.0, w.Utilisation());
+    }
+    ASSERT_LE(100, tasks);
+    uint64_t typed = 0;
+    for (const auto& t : report.task_types) {
+        typed += t.run.Count();
+        ASSERT_EQ(t.run.Count(), t.wait.Count());
+    }
+    ASSERT_EQ(tasks, typed) << "A task is missing in the histograms";
+    ASSERT_EQ(2, report.systems.size());
+    ASSERT_LE(5, report.systems[0].frame.Count());
+    ASSERT_LE(1, report.systems[1].overruns) << "The overruns of the slow system are not counted";
+    ASSERT_LE(1, report.systems[1].skipped);
+    ASSERT_LE(20000000, report.systems[1].frame.Max());
+
+    std::ostringstream trace;
+    scheduler.WriteChromeTrace(trace);
+    const auto json = trace.str();
+    ASSERT_EQ(0, json.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":["));
+    ASSERT_NE(std::string::npos, json.find("\"ph\":\"X\""));
+    ASSERT_NE(std::string::npos, json.find("\"cat\":\"system\""));
+    ASSERT_NE(std::string::npos, json.find("SlowSystem"));
+}
+}
+
+#endif // TRILLEK_TELEMETRY
+
+#endif // SCHEDULERTELEMETRYTEST_HPP_INCLUDED
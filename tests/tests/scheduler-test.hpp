@@ -0,0 +1,359 @@
+#ifndef SCHEDULERTEST_HPP_INCLUDED
+#define SCHEDULERTEST_HPP_INCLUDED
+
+#include <thread>
+#include <queue>
+#include <set>
+#include <algorithm>
+#include <map>
+#include <atomic>
+#include <cstdint>
+#include "trillek-scheduler.hpp"
+#include "systems/system-base.hpp"
+#include "systems/dispatcher.hpp"
+
+#include "gtest/gtest.h"
+
+namespace trillek {
+// defined with the replacement of operator new in tests/src/operator-new-counter.cpp
+extern std::atomic<bool> count_operator_new;
+extern std::atomic<uint64_t> operator_new_calls;
+
+/** \brief A system counting its calls
+ */
+class CountingSystem final : public SystemBase {
+public:
+    CountingSystem() : thread_inits(0), frames(0), batches(0), terminated(0), last_frame(0) {};
+
+    void ThreadInit() override {
+        ++thread_inits;
+    }
+
+    void HandleEvents(frame_tp timepoint) override {
+        std::lock_guard<std::mutex> locker(m);
+        threads.insert(std::this_thread::get_id());
+        frame_ordered = frame_ordered && timepoint > last_frame;
+        last_frame = timepoint;
+        ++frames;
+    }
+
+    void RunBatch() const override {
+        ++batches;
+    }
+
+    void Terminate() override {
+        ++terminated;
+    }
+
+    std::atomic<int> thread_inits;
+    std::atomic<int> frames;
+    mutable std::atomic<int> batches;
+    std::atomic<int> terminated;
+    std::set<std::thread::id> threads;
+    bool frame_ordered = true;
+    frame_tp last_frame;
+    std::mutex m;
+};
+
+/** \brief A system slower than its frame period
+ */
+class SlowSystem final : public SystemBase {
+public:
+    void HandleEvents(frame_tp timepoint) override {
+        frames.push_back(timepoint);
+    }
+
+    void RunBatch() const override {
+        std::this_thread::sleep_for(std::chrono::milliseconds(25));
+    }
+
+    void Terminate() override {}
+
+    std::vector<frame_tp> frames;
+};
+
+/** \brief Record the overrun events
+ */
+class OverrunRecorder final : public event::Subscriber<FrameOverrun> {
+public:
+    OverrunRecorder() {
+        event::Dispatcher<FrameOverrun>::GetInstance()->Subscribe(this);
+    }
+
+    ~OverrunRecorder() {
+        event::Dispatcher<FrameOverrun>::GetInstance()->Unsubscribe(this);
+    }
+
+    void Notify(const FrameOverrun* data) override {
+        std::lock_guard<std::mutex> locker(m);
+        events.push_back(*data);
+    }
+
+    std::vector<FrameOverrun> events;
+    std::mutex m;
+};
+
+class SchedulerTest : public ::testing::Test {
+protected:
+    TrillekScheduler scheduler;
+};
+
+/** \brief A scheduler running during each test
+ *
+ * The threads are started before the test, and stopped after it.
+ */
+template<unsigned int THREADS>
+class RunningSchedulerTest : public ::testing::Test {
+public:
+    void SetUp() override {
+        runner = std::thread([&]() {
+            std::queue<SystemBase*> systems;
+            scheduler.Initialize(THREADS, systems);
+        });
+        scheduler.WaitStarted();
+    }
+
+    void TearDown() override {
+        scheduler.Stop();
+        runner.join();
+    }
+
+    /** \brief Wait up to 2 s for a value set by the tasks
+     *
+     */
+    template<class T>
+    void WaitFor(const std::atomic<T>& value, T expected) {
+        auto limit = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+        while (value != expected && std::chrono::steady_clock::now() < limit) {
+            std::this_thread::yield();
+        }
+    }
+
+protected:
+    TrillekScheduler scheduler;
+    std::thread runner;
+};
+
+TEST_F(SchedulerTest, MoreSystemsThanThreads) {
+    std::vector<CountingSystem> systems(5);
+    std::queue<SystemBase*> queue;
+    for (auto& s : systems) {
+        queue.push(&s);
+    }
+    std::thread runner([&]() { scheduler.Initialize(2, queue); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    scheduler.Stop();
+    runner.join();
+    for (auto& s : systems) {
+        ASSERT_LE(5, s.frames) << "A system did not run on each frame";
+        ASSERT_EQ(s.frames, s.batches) << "RunBatch() not called after HandleEvents()";
+        ASSERT_TRUE(s.frame_ordered) << "Frames not in order";
+        ASSERT_EQ(1, s.thread_inits) << "ThreadInit() not called once";
+        ASSERT_EQ(1, s.threads.size()) << "A system changed of thread";
+        ASSERT_EQ(1, s.terminated) << "Terminate() not called once";
+    }
+}
+
+TEST_F(SchedulerTest, SystemAffinity) {
+    CountingSystem pinned, free;
+    scheduler.RegisterSystem(&pinned, 1);
+    scheduler.RegisterSystem(&free);
+    std::queue<SystemBase*> queue;
+    std::thread runner([&]() { scheduler.Initialize(4, queue); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    scheduler.Stop();
+    runner.join();
+    ASSERT_LE(5, pinned.frames);
+    ASSERT_LE(5, free.frames);
+    ASSERT_EQ(1, pinned.threads.size()) << "Pinned system ran on several threads";
+    ASSERT_EQ(1, pinned.thread_inits);
+}
+
+TEST_F(SchedulerTest, FramePacing) {
+    const frame_unit period(10000000);
+    SlowSystem fixed, skip, variable;
+    OverrunRecorder recorder;
+    scheduler.RegisterSystem(&fixed, -1, SystemPacing(period, FramePacing::FIXED_STEP, 1));
+    scheduler.RegisterSystem(&skip, -1, SystemPacing(period, FramePacing::SKIP_FRAMES));
+    scheduler.RegisterSystem(&variable, -1, SystemPacing(period, FramePacing::VARIABLE_STEP));
+    std::queue<SystemBase*> queue;
+    std::thread runner([&]() { scheduler.Initialize(4, queue); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    scheduler.Stop();
+    runner.join();
+    for (auto system : {&fixed, &skip, &variable}) {
+        ASSERT_LE(3, system->frames.size());
+        for (size_t i = 1; i < system->frames.size(); ++i) {
+            const auto step = system->frames[i] - system->frames[i - 1];
+            if (system == &variable) {
+                ASSERT_LE(25000000, step) << "Variable step frame started before the end of the previous one";
+            }
+            else {
+                ASSERT_EQ(0, step % period.count()) << "Frame out of cadence";
+                ASSERT_LT(period.count(), step) << "Late frame not dropped";
+            }
+        }
+    }
+    std::map<SystemBase*, std::vector<FrameOverrun>> events;
+    for (auto& e : recorder.events) {
+        events[e.system].push_back(e);
+    }
+    for (auto system : {&fixed, &skip, &variable}) {
+        ASSERT_LE(system->frames.size() - 1, events[system].size()) << "Overrun not reported";
+        for (auto& e : events[system]) {
+            ASSERT_LE(frame_unit(25000000), e.duration);
+            ASSERT_LT(frame_unit(0), e.lateness);
+            if (system == &variable) {
+                ASSERT_EQ(0, e.skipped) << "Frames dropped in variable step";
+            }
+            else {
+                ASSERT_LE(1, e.skipped) << "Late frames not dropped";
+            }
+        }
+    }
+}
+
+TEST_F(SchedulerTest, SteadyStateAllocations) {
+    std::queue<SystemBase*> queue;
+    std::thread runner([&]() { scheduler.Initialize(2, queue); });
+    std::atomic<int> done(0);
+    auto count = [&done]() { ++done; };
+    auto run_batch = [&](int n) {
+        done = 0;
+        for (int i = 0; i < n; ++i) {
+            scheduler.Queue(MakeTaskRequest(count));
+        }
+        while (done < n) {
+            std::this_thread::yield();
+        }
+    };
+    // enough blocks for the tasks in flight and the blocks cached by the threads
+    TaskPool::Reserve(sizeof(TaskRequest<decltype(count)>), 1000 + 3 * (TaskPool::CACHE_BLOCKS + TaskPool::CHUNK_BLOCKS));
+    // let the queues grow
+    run_batch(1000);
+    auto before = TaskPool::Counters();
+    const uint64_t new_before = operator_new_calls;
+    count_operator_new = true;
+    for (int i = 0; i < 20; ++i) {
+        run_batch(1000);
+    }
+    count_operator_new = false;
+    const uint64_t new_after = operator_new_calls;
+    auto after = TaskPool::Counters();
+    scheduler.Stop();
+    runner.join();
+    ASSERT_EQ(before.heap_allocations, after.heap_allocations) << "Tasks allocated from the heap in steady state";
+    ASSERT_EQ(new_before, new_after) << "operator new called in steady state";
+    ASSERT_EQ(0, after.oversized);
+}
+
+TEST_F(SchedulerTest, ParallelForInline) {
+    std::vector<int> values(1000, 0);
+    scheduler.ParallelFor(0, values.size(), 64, [&](size_t first, size_t last) {
+        for (auto i = first; i < last; ++i) {
+            ++values[i];
+        }
+    });
+    ASSERT_EQ(std::vector<int>(1000, 1), values) << "Range not covered once without threads";
+}
+
+TEST_F(SchedulerTest, ParallelReduce) {
+    std::queue<SystemBase*> queue;
+    std::thread runner([&]() { scheduler.Initialize(4, queue); });
+    scheduler.WaitStarted();
+    std::vector<int> values(100000, 0);
+    scheduler.ParallelFor(0, values.size(), 100, [&](size_t first, size_t last) {
+        for (auto i = first; i < last; ++i) {
+            ++values[i];
+        }
+    });
+    auto sum = scheduler.ParallelReduce(10, 100010, 100, uint64_t(0),
+        [](size_t first, size_t last) -> uint64_t {
+            uint64_t partial = 0;
+            for (auto i = first; i < last; ++i) {
+                partial += i;
+            }
+            return partial;
+        },
+        [](uint64_t a, uint64_t b) { return a + b; });
+    std::vector<size_t> order = scheduler.ParallelReduce(0, 1000, 1, std::vector<size_t>(),
+        [](size_t first, size_t last) { return std::vector<size_t>(1, first); },
+        [](std::vector<size_t>&& a, std::vector<size_t>&& b) -> std::vector<size_t> {
+            a.insert(a.end(), b.begin(), b.end());
+            return std::move(a);
+        });
+    scheduler.Stop();
+    runner.join();
+    ASSERT_EQ(std::vector<int>(100000, 1), values) << "Range not covered once";
+    ASSERT_EQ(uint64_t(100010) * 100009 / 2 - 45, sum);
+    ASSERT_TRUE(std::is_sorted(order.begin(), order.end())) << "Partial results not reduced in order";
+    ASSERT_LT(1, order.size());
+}
+
+TEST_F(SchedulerTest, TaskLanes) {
+    scheduler.SetConcurrencyLimit(TaskLane::BACKGROUND, 2);
+    std::queue<SystemBase*> queue;
+    std::thread runner([&]() { scheduler.Initialize(4, queue); });
+    scheduler.WaitStarted();
+    std::atomic<int> running(0), max_running(0), background_done(0), frame_done(0), background_at_frame_end(-1);
+    for (int i = 0; i < 40; ++i) {
+        auto task = MakeTaskRequest([&]() {
+            const int r = ++running;
+            int m = max_running;
+            while (r > m && ! max_running.compare_exchange_weak(m, r)) {}
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            --running;
+            ++background_done;
+        });
+        task->SetLane(TaskLane::BACKGROUND);
+        scheduler.Queue(std::move(task));
+    }
+    for (int i = 0; i < 10; ++i) {
+        scheduler.Queue(MakeTaskRequest([&]() {
+            if (++frame_done == 10) {
+                background_at_frame_end = background_done.load();
+            }
+        }));
+    }
+    for (int i = 0; i < 200 && background_done < 40; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    const auto frame_limit = scheduler.ConcurrencyLimit(TaskLane::FRAME);
+    scheduler.SetConcurrencyLimit(TaskLane::BACKGROUND, 0);
+    const auto default_limit = scheduler.ConcurrencyLimit(TaskLane::BACKGROUND);
+    scheduler.Stop();
+    runner.join();
+    ASSERT_EQ(40, background_done);
+    ASSERT_EQ(2, max_running) << "The limit of the lane is not applied";
+    ASSERT_EQ(10, frame_done);
+    ASSERT_GT(20, background_at_frame_end) << "Frame tasks waited for background tasks";
+    ASSERT_EQ((std::numeric_limits<unsigned int>::max)(), frame_limit);
+    ASSERT_EQ(3, default_limit) << "Background tasks do not leave one thread by default";
+}
+
+TEST_F(SchedulerTest, DelayedTaskOfBusyWorker) {
+    std::queue<SystemBase*> queue;
+    std::thread runner([&]() { scheduler.Initialize(4, queue); });
+    std::atomic<bool> fired(false);
+    std::atomic<int64_t> latency(0);
+    // the timer goes into the wheel of the worker, which then stays busy
+    scheduler.Queue(MakeTaskRequest([&]() {
+        const auto queued = TrillekScheduler::Now();
+        scheduler.Queue(MakeTaskRequest([&, queued]() {
+            latency = (TrillekScheduler::Now() - queued).count();
+            fired = true;
+        }, frame_unit(2000000)));
+        const auto busy_end = std::chrono::steady_clock::now() + std::chrono::milliseconds(300);
+        while (std::chrono::steady_clock::now() < busy_end) {}
+    }));
+    for (int i = 0; i < 100 && ! fired; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    scheduler.Stop();
+    runner.join();
+    ASSERT_TRUE(fired) << "The delayed task did not run";
+    ASSERT_GT(100000000, latency) << "The delayed task waited for the busy worker";
+}
+}
+
+#endif // SCHEDULERTEST_HPP_INCLUDED
@@ -0,0 +1,98 @@
+#ifndef TASKGRAPHTEST_HPP_INCLUDED
+#define TASKGRAPHTEST_HPP_INCLUDED
+
+#include <thread>
+#include <queue>
+#include <algorithm>
+#include "task-graph.hpp"
+#include "tests/scheduler-test.hpp"
+
+#include "gtest/gtest.h"
+
+namespace trillek {
+
+class TaskGraphTest : public RunningSchedulerTest<4> {};
+
+TEST_F(TaskGraphTest, TaskGraphDiamond) {
+    TaskGraph graph;
+    std::atomic<int> step(0);
+    int a_step = -1, b_step = -1, c_step = -1, d_step = -1;
+    auto a = graph.AddNode("a", [&]() { a_step = step++; });
+    auto b = graph.AddNode("b", [&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        b_step = step++;
+    });
+    auto c = graph.AddNode("c", [&]() { c_step = step++; });
+    auto d = graph.AddNode("d", [&]() { d_step = step++; });
+    graph.Precede(a, b);
+    graph.Precede(a, c);
+    graph.Precede(b, d);
+    graph.Precede(c, d);
+    for (frame_tp frame = 0; frame < 3; ++frame) {
+        step = 0;
+        ASSERT_TRUE(scheduler.Launch(graph, frame)) << "Graph not launched";
+        graph.Wait();
+        ASSERT_TRUE(graph.Done());
+        ASSERT_EQ(0, a_step) << "Fork did not run first";
+        ASSERT_EQ(3, d_step) << "Join did not run last";
+        ASSERT_LT(0, b_step);
+        ASSERT_LT(0, c_step);
+        const auto& report = graph.LastReport();
+        ASSERT_EQ(frame, report.frame);
+        ASSERT_EQ(std::vector<size_t>({a, b, d}), report.critical_path) << graph.CriticalPathReport();
+        ASSERT_LE(report.critical_length, report.span);
+    }
+}
+
+TEST_F(TaskGraphTest, TaskGraphOnComplete) {
+    TaskGraph graph;
+    std::atomic<int> count(0);
+    auto root = graph.AddNode("root", [&]() { ++count; });
+    for (int i = 0; i < 100; ++i) {
+        graph.Precede(root, graph.AddNode("leaf", [&]() { ++count; }));
+    }
+    std::atomic<bool> completed(false);
+    graph.OnComplete([&](const TaskGraphReport& report) { completed = count == 101; });
+    ASSERT_TRUE(scheduler.Launch(graph));
+    graph.Wait();
+    ASSERT_TRUE(completed) << "Continuation did not run after all nodes";
+}
+
+TEST_F(TaskGraphTest, TaskGraphRelaunch) {
+    TaskGraph graph;
+    std::atomic<int> count(0);
+    graph.Precede(graph.AddNode("a", [&]() { ++count; }), graph.AddNode("b", [&]() { ++count; }));
+    std::atomic<int> runs(0);
+    std::vector<frame_tp> frames;
+    std::mutex m;
+    graph.OnComplete([&](const TaskGraphReport& report) {
+        const auto frame = report.frame;
+        if (++runs < 3) {
+            ASSERT_TRUE(scheduler.Launch(graph, frame + 1)) << "Continuation could not launch the graph";
+        }
+        std::lock_guard<std::mutex> locker(m);
+        frames.push_back(report.frame);
+        ASSERT_EQ(frame, report.frame) << "Report modified by the next run";
+    });
+    ASSERT_TRUE(scheduler.Launch(graph));
+    graph.Wait();
+    ASSERT_TRUE(graph.Done());
+    ASSERT_EQ(3, runs);
+    ASSERT_EQ(6, count);
+    ASSERT_EQ(2, graph.LastReport().frame);
+    std::sort(frames.begin(), frames.end());
+    ASSERT_EQ(std::vector<frame_tp>({0, 1, 2}), frames);
+}
+
+TEST_F(TaskGraphTest, TaskGraphCycle) {
+    TaskGraph graph;
+    auto a = graph.AddNode("a", []() {});
+    auto b = graph.AddNode("b", []() {});
+    graph.Precede(a, b);
+    graph.Precede(b, a);
+    ASSERT_FALSE(scheduler.Launch(graph)) << "Graph with a cycle was launched";
+    ASSERT_TRUE(graph.Done());
+}
+}
+
+#endif // TASKGRAPHTEST_HPP_INCLUDED
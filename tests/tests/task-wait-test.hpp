@@ -0,0 +1,64 @@
+#ifndef TASKWAITTEST_HPP_INCLUDED
+#define TASKWAITTEST_HPP_INCLUDED
+
+#include <thread>
+#include <queue>
+#include "task-wait.hpp"
+#include "tests/scheduler-test.hpp"
+
+#include "gtest/gtest.h"
+
+namespace trillek {
+
+class TaskWaitTest : public RunningSchedulerTest<2> {};
+
+TEST_F(TaskWaitTest, Counter) {
+    TaskCounter counter(10);
+    std::atomic<int> done(0), joined(-1);
+    counter.Wait(scheduler, MakeTaskRequest([&]() { joined = done.load(); }));
+    for (int i = 0; i < 10; ++i) {
+        scheduler.Queue(MakeTaskRequest([&]() {
+            ++done;
+            counter.Decrement();
+        }));
+    }
+    WaitFor(joined, 10);
+    ASSERT_EQ(10, joined) << "Continuation did not run after all tasks";
+    std::atomic<int> late(0);
+    counter.Wait(scheduler, MakeTaskRequest([&]() { late = 1; }));
+    WaitFor(late, 1);
+    ASSERT_EQ(1, late) << "Task not queued when the counter is already 0";
+}
+
+TEST_F(TaskWaitTest, Future) {
+    TaskPromise<int> promise;
+    auto future = promise.GetFuture();
+    std::atomic<int> value(0);
+    future.Wait(scheduler, MakeTaskRequest([&]() { value = future.Get(); }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ASSERT_EQ(0, value) << "Task ran before the value was set";
+    ASSERT_TRUE(promise.SetValue(42));
+    ASSERT_FALSE(promise.SetValue(43)) << "Value set twice";
+    WaitFor(value, 42);
+    ASSERT_EQ(42, value);
+}
+
+TEST_F(TaskWaitTest, FrameTrigger) {
+    FrameTrigger<frame_tp> trigger;
+    std::atomic<int> released(0);
+    for (frame_tp f = 1; f <= 3; ++f) {
+        trigger.Wait(f, scheduler, MakeTaskRequest([&]() { ++released; }));
+    }
+    trigger.Reach(2);
+    WaitFor(released, 2);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ASSERT_EQ(2, released) << "Tasks released for the wrong frames";
+    trigger.Wait(1, scheduler, MakeTaskRequest([&]() { ++released; }));
+    trigger.Reach(3);
+    WaitFor(released, 4);
+    ASSERT_EQ(4, released);
+    ASSERT_EQ(3, trigger.Reached());
+}
+}
+
+#endif // TASKWAITTEST_HPP_INCLUDED
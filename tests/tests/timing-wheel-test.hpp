@@ -0,0 +1,110 @@
+#ifndef TIMINGWHEELTEST_HPP_INCLUDED
+#define TIMINGWHEELTEST_HPP_INCLUDED
+
+#include <vector>
+#include "timing-wheel.hpp"
+
+#include "gtest/gtest.h"
+
+namespace trillek {
+
+class TimerElement final : public TimerNode {
+public:
+    TimerElement() : expired_at(0) {};
+    uint64_t expired_at;
+};
+
+class TimingWheelTest : public ::testing::Test {
+public:
+    TimingWheelTest() : wheel(1000) {};
+
+    size_t AdvanceTo(uint64_t tick) {
+        return wheel.Advance(tick, [&](TimerElement* e) { e->expired_at = wheel.Now(); });
+    }
+
+protected:
+    TimingWheel<TimerElement> wheel;
+};
+
+TEST_F(TimingWheelTest, TimingWheelEmpty) {
+    ASSERT_TRUE(wheel.Empty()) << "New wheel is not empty";
+    ASSERT_EQ(0, AdvanceTo(5000)) << "Empty wheel expired elements";
+    ASSERT_EQ(5000, wheel.Now()) << "Empty wheel did not jump to the tick";
+    ASSERT_TRUE(wheel.Reset(6000)) << "Empty wheel can not be reset";
+}
+
+TEST_F(TimingWheelTest, TimingWheelPastDeadline) {
+    TimerElement e;
+    ASSERT_FALSE(wheel.Insert(&e, 1000)) << "Element inserted with a deadline already reached";
+    ASSERT_EQ(nullptr, e.TimerOwner()) << "Rejected element has an owner";
+}
+
+TEST_F(TimingWheelTest, TimingWheelExpireOnDeadline) {
+    // one element on each level, and one parked beyond the last level
+    std::vector<uint64_t> deltas{1, 63, 64, 100, 4095, 4096, 5000, 262144, 300000, 16777216, 20000000};
+    std::vector<TimerElement> elements(deltas.size());
+    for (size_t i = 0; i < deltas.size(); ++i) {
+        ASSERT_TRUE(wheel.Insert(&elements[i], 1000 + deltas[i]));
+    }
+    ASSERT_EQ(deltas.size(), wheel.Size());
+    ASSERT_FALSE(wheel.Reset(0)) << "Non-empty wheel was reset";
+    size_t total = 0;
+    while (! wheel.Empty()) {
+        auto next = wheel.NextExpiry();
+        ASSERT_GT(next, wheel.Now()) << "Next expiry is in the past";
+        total += AdvanceTo(next);
+    }
+    ASSERT_EQ(deltas.size(), total);
+    for (size_t i = 0; i < deltas.size(); ++i) {
+        ASSERT_EQ(1000 + deltas[i], elements[i].expired_at) << "Element " << i << " expired at wrong tick";
+        ASSERT_EQ(nullptr, elements[i].TimerOwner()) << "Expired element has an owner";
+    }
+}
+
+TEST_F(TimingWheelTest, TimingWheelBulkExpire) {
+    std::vector<TimerElement> elements(1000);
+    for (auto& e : elements) {
+        wheel.Insert(&e, 1010);
+    }
+    ASSERT_EQ(0, AdvanceTo(1009)) << "Elements expired before their deadline";
+    ASSERT_EQ(1000, AdvanceTo(1010)) << "Not all elements expired on their deadline";
+    ASSERT_TRUE(wheel.Empty());
+}
+
+TEST_F(TimingWheelTest, TimingWheelCancel) {
+    TimerElement a, b, c;
+    wheel.Insert(&a, 1005);
+    wheel.Insert(&b, 1005);
+    wheel.Insert(&c, 3000);
+    ASSERT_TRUE(wheel.Cancel(&b)) << "Can not cancel an element";
+    ASSERT_FALSE(wheel.Cancel(&b)) << "Element cancelled twice";
+    ASSERT_TRUE(wheel.Cancel(&c)) << "Can not cancel an element on upper level";
+    ASSERT_EQ(1, wheel.Size());
+    ASSERT_EQ(1005, wheel.NextExpiry()) << "Next expiry is wrong after cancel";
+    ASSERT_EQ(1, AdvanceTo(10000));
+    ASSERT_EQ(1005, a.expired_at);
+    ASSERT_EQ(0, b.expired_at) << "Cancelled element expired";
+    ASSERT_EQ(0, c.expired_at) << "Cancelled element expired";
+}
+
+TEST_F(TimingWheelTest, TimingWheelExpireNext) {
+    TimerElement a, b, c, d;
+    wheel.Insert(&a, 1001);
+    wheel.Insert(&b, 1001);
+    wheel.Insert(&c, 1002);
+    // on the second level until the wrap at 1088
+    wheel.Insert(&d, 1088);
+    auto expire = [](TimerElement* e) { e->expired_at = 1; };
+    ASSERT_EQ(1, wheel.ExpireNext([&](TimerElement* e) { return e != &b; }, expire));
+    ASSERT_EQ(1, a.expired_at) << "Due element of the next tick not expired";
+    ASSERT_EQ(nullptr, a.TimerOwner());
+    ASSERT_EQ(0, c.expired_at) << "Element after the next tick expired";
+    ASSERT_EQ(1000, wheel.Now()) << "The wheel moved";
+    ASSERT_EQ(2, AdvanceTo(1087));
+    ASSERT_EQ(1, wheel.ExpireNext([](TimerElement*) { return true; }, expire));
+    ASSERT_EQ(1, d.expired_at) << "Element not cascaded yet was not expired";
+    ASSERT_TRUE(wheel.Empty());
+}
+}
+
+#endif // TIMINGWHEELTEST_HPP_INCLUDED